@@ -122,6 +122,12 @@
 #define CMD_GET_DIGITAL_VOICE 0x3c
 #define CMD_SET_DIGITAL_VOICE 0x3d
 
+// argument: alsa device (0 radio capture, 1 radio playback, 2 loopback capture, 3 loopback playback)
+#define CMD_GET_XRUNS 0x3e
+
+// rx audio level before the agc and agc gain, two int16: dBFS * 10 and dB * 10
+#define CMD_GET_SIGNAL_LEVEL 0x3f
+
 // ================================= //
 
 
@@ -184,4 +190,8 @@
 #define CMD_RESP_GET_DIGITAL_VOICE_ON 0x29
 #define CMD_RESP_GET_DIGITAL_VOICE_OFF 0x2a
 
+#define CMD_RESP_GET_XRUNS 0x2b
+
+#define CMD_RESP_GET_SIGNAL_LEVEL 0x2c
+
 #endif // HAVE_CMDS_H__
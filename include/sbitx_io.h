@@ -28,6 +28,7 @@
 #include <stdbool.h>
 #include <stdatomic.h>
 #include <pthread.h>
+#include <string.h>
 
 
 #ifdef __cplusplus
@@ -38,6 +39,7 @@ extern "C" {
 #define MAX_BUF_SIZE 4096
 
 #define SYSV_SHM_CONTROLLER_KEY_STR 66650 // key for the controller_conn struct
+#define SYSV_SHM_SPECTRUM_KEY 66651 // key for the spectrum_page struct
 
 #define MAX_MESSAGE_SIZE 128
 
@@ -61,6 +63,37 @@ typedef struct
 } controller_conn;
 
 
+#define SPECTRUM_MAX_BINS 1024
+
+// RX spectrum of the controller (waterfall), updated spectrum_fps times per
+// second while in rx. seq is odd while the controller writes the page, read
+// it with spectrum_read().
+typedef struct
+{
+    _Atomic uint32_t seq;
+    uint32_t frame; // frame counter
+    uint32_t freq; // dial frequency, Hz
+    float first_hz; // center of bin 0, from the dial frequency, Hz
+    float bin_hz; // bin width, Hz
+    uint32_t n_bins;
+    uint32_t fps;
+    float db[SPECTRUM_MAX_BINS]; // dBFS
+} spectrum_page;
+
+// seqlock read, the copy is a whole frame
+static inline void spectrum_read(spectrum_page *page, spectrum_page *copy)
+{
+    uint32_t seq;
+
+    do
+    {
+        while ((seq = atomic_load_explicit(&page->seq, memory_order_acquire)) & 1)
+            ;
+        memcpy(copy, page, sizeof(spectrum_page));
+        atomic_thread_fence(memory_order_acquire);
+    } while (atomic_load_explicit(&page->seq, memory_order_relaxed) != seq);
+}
+
 // returns true is response was received
 // response is copied to response... so pass a valid 5 bytes pointer
 bool radio_cmd(controller_conn *connector, uint8_t *srv_cmd, uint8_t *response);
@@ -0,0 +1,270 @@
+/* sBitx controller - audio ring benchmark
+ *
+ * Copyright (C) 2025 Rhizomatica
+ * Author: Rafael Diniz <rafael@riseup.net>
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ *
+ */
+
+// Moves blocks between two threads through the lock-free SPSC ring of
+// sbitx_buffer.c, and through the mutex/condvar ring it replaced (kept here
+// as the reference). The producer writes one block per period, as the ALSA
+// capture threads do, and the consumer sleeps in read_buffer() as
+// the dsp threads do. It reports the wakeup latency (write to read
+// return) and the context switches per second. With -f the producer runs
+// free, which measures the ring throughput.
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/resource.h>
+
+#include "sbitx_buffer.h"
+
+#define BENCH_DEFAULT_BLOCKS 1000
+#define BENCH_DEFAULT_BLOCK_BYTES 2048 // 512 frames S32, the 96 kHz capture period
+#define BENCH_DEFAULT_PERIOD_US 5333 // 512 frames at 96 kHz
+#define BENCH_RING_ORDER 18 // as initialize_buffers()
+
+// the mutex/condvar ring as it was before the lock-free one
+typedef struct
+{
+    pthread_mutex_t    mutex;
+    pthread_cond_t     cond;
+    struct ring_buffer buf;
+} legacy_buffer;
+
+static void legacy_read(legacy_buffer *buf_in, uint8_t *buffer_out, int size)
+{
+try_again_read:
+    pthread_mutex_lock(&buf_in->mutex);
+    if (ring_buffer_count_bytes(&buf_in->buf) >= size)
+    {
+        memcpy(buffer_out, ring_buffer_read_address(&buf_in->buf), size);
+        ring_buffer_read_advance(&buf_in->buf, size);
+        pthread_cond_signal(&buf_in->cond);
+        pthread_mutex_unlock(&buf_in->mutex);
+    }
+    else
+    {
+        pthread_cond_wait(&buf_in->cond, &buf_in->mutex);
+        pthread_mutex_unlock(&buf_in->mutex);
+        goto try_again_read;
+    }
+}
+
+static void legacy_write(legacy_buffer *buf_out, uint8_t *buffer_in, int size)
+{
+try_again_write:
+    pthread_mutex_lock(&buf_out->mutex);
+    if (ring_buffer_count_free_bytes(&buf_out->buf) >= size)
+    {
+        memcpy(ring_buffer_write_address(&buf_out->buf), buffer_in, size);
+        ring_buffer_write_advance(&buf_out->buf, size);
+        pthread_cond_signal(&buf_out->cond);
+        pthread_mutex_unlock(&buf_out->mutex);
+    }
+    else
+    {
+        pthread_cond_wait(&buf_out->cond, &buf_out->mutex);
+        pthread_mutex_unlock(&buf_out->mutex);
+        goto try_again_write;
+    }
+}
+
+struct bench_run {
+    bool legacy;
+    bool free_running;
+    uint32_t blocks;
+    uint32_t block_bytes;
+    uint32_t period_us;
+
+    buffer ring;
+    legacy_buffer legacy_ring;
+
+    uint64_t *latency_ns; // per block
+};
+
+static uint64_t now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void *producer_thread(void *arg)
+{
+    struct bench_run *run = (struct bench_run *) arg;
+    uint8_t *block = calloc(run->block_bytes, 1);
+    struct timespec next;
+    clock_gettime(CLOCK_MONOTONIC, &next);
+
+    for (uint32_t b = 0; b < run->blocks; b++)
+    {
+        if (!run->free_running)
+        {
+            next.tv_nsec += run->period_us * 1000L;
+            while (next.tv_nsec >= 1000000000L)
+            {
+                next.tv_nsec -= 1000000000L;
+                next.tv_sec++;
+            }
+            clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+        }
+
+        // the write time travels in the block
+        uint64_t t = now_ns();
+        memcpy(block, &t, sizeof(t));
+
+        if (run->legacy)
+            legacy_write(&run->legacy_ring, block, run->block_bytes);
+        else
+            write_buffer(&run->ring, block, run->block_bytes);
+    }
+
+    free(block);
+    return NULL;
+}
+
+static void *consumer_thread(void *arg)
+{
+    struct bench_run *run = (struct bench_run *) arg;
+    uint8_t *block = malloc(run->block_bytes);
+
+    for (uint32_t b = 0; b < run->blocks; b++)
+    {
+        if (run->legacy)
+            legacy_read(&run->legacy_ring, block, run->block_bytes);
+        else
+            read_buffer(&run->ring, block, run->block_bytes);
+
+        uint64_t t;
+        memcpy(&t, block, sizeof(t));
+        run->latency_ns[b] = now_ns() - t;
+    }
+
+    free(block);
+    return NULL;
+}
+
+static int compare_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *) a, y = *(const uint64_t *) b;
+    return (x > y) - (x < y);
+}
+
+static void run_bench(struct bench_run *run)
+{
+    if (run->legacy)
+    {
+        pthread_mutex_init(&run->legacy_ring.mutex, NULL);
+        pthread_cond_init(&run->legacy_ring.cond, NULL);
+        ring_buffer_create(&run->legacy_ring.buf, BENCH_RING_ORDER);
+    }
+    else
+        initialize_buffer(&run->ring, BENCH_RING_ORDER);
+
+    run->latency_ns = malloc(run->blocks * sizeof(uint64_t));
+
+    struct rusage ru_start, ru_end;
+    getrusage(RUSAGE_SELF, &ru_start);
+    uint64_t start = now_ns();
+
+    pthread_t producer, consumer;
+    pthread_create(&consumer, NULL, consumer_thread, run);
+    pthread_create(&producer, NULL, producer_thread, run);
+    pthread_join(producer, NULL);
+    pthread_join(consumer, NULL);
+
+    double seconds = (now_ns() - start) / 1e9;
+    getrusage(RUSAGE_SELF, &ru_end);
+    long switches = (ru_end.ru_nvcsw - ru_start.ru_nvcsw) + (ru_end.ru_nivcsw - ru_start.ru_nivcsw);
+
+    qsort(run->latency_ns, run->blocks, sizeof(uint64_t), compare_u64);
+    double mean = 0;
+    for (uint32_t b = 0; b < run->blocks; b++)
+        mean += run->latency_ns[b];
+    mean /= run->blocks;
+
+    printf("%-14s %6u blocks  %9.0f blocks/s  wakeup latency mean %7.1f us  p50 %7.1f us  p99 %7.1f us  max %7.1f us  %8.0f context switches/s\n",
+           run->legacy ? "mutex/condvar" : "lock-free spsc", run->blocks, run->blocks / seconds,
+           mean / 1e3, run->latency_ns[run->blocks / 2] / 1e3, run->latency_ns[(run->blocks * 99) / 100] / 1e3,
+           run->latency_ns[run->blocks - 1] / 1e3, switches / seconds);
+
+    free(run->latency_ns);
+    if (run->legacy)
+        ring_buffer_free(&run->legacy_ring.buf);
+    else
+        ring_buffer_free(&run->ring.buf);
+}
+
+int main(int argc, char *argv[])
+{
+    struct bench_run run;
+    memset(&run, 0, sizeof(run));
+    run.blocks = BENCH_DEFAULT_BLOCKS;
+    run.block_bytes = BENCH_DEFAULT_BLOCK_BYTES;
+    run.period_us = BENCH_DEFAULT_PERIOD_US;
+
+    int o;
+    while ((o = getopt(argc, argv, "hn:b:p:f")) != -1)
+    {
+        switch (o)
+        {
+        case 'n':
+            run.blocks = atoi(optarg);
+            break;
+        case 'b':
+            run.block_bytes = atoi(optarg);
+            break;
+        case 'p':
+            run.period_us = atoi(optarg);
+            break;
+        case 'f':
+            run.free_running = true;
+            break;
+        case 'h':
+        default:
+            fprintf(stderr, "Usage: %s [-n blocks] [-b block_bytes] [-p period_us] [-f]\n", argv[0]);
+            fprintf(stderr, "\nOptions:\n");
+            fprintf(stderr, " -n blocks                  Number of blocks (default %d)\n", BENCH_DEFAULT_BLOCKS);
+            fprintf(stderr, " -b block_bytes             Block size in bytes (default %d)\n", BENCH_DEFAULT_BLOCK_BYTES);
+            fprintf(stderr, " -p period_us               Producer period in microseconds (default %d)\n", BENCH_DEFAULT_PERIOD_US);
+            fprintf(stderr, " -f                         Free running producer (throughput)\n");
+            fprintf(stderr, " -h                         Prints this help.\n");
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (run.blocks == 0 || run.block_bytes < sizeof(uint64_t) || run.block_bytes > (1U << BENCH_RING_ORDER) / 2)
+    {
+        fprintf(stderr, "Invalid number of blocks or block size\n");
+        return EXIT_FAILURE;
+    }
+
+    run.legacy = true;
+    run_bench(&run);
+    run.legacy = false;
+    run_bench(&run);
+
+    return EXIT_SUCCESS;
+}
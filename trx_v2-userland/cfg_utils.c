@@ -30,6 +30,7 @@
 #endif
 
 #include "cfg_utils.h"
+#include "sbitx_spectrum.h"
 
 extern _Atomic bool shutdown_;
 
@@ -154,6 +155,62 @@ bool init_config_core(radio *radio_h, char *ini_name)
     // printf("Enable Shared Memory Control Interface:       [%d]\n", b);
     radio_h->enable_shm_control = (bool) b;
 
+    i = iniparser_getint(ini, "main:rx_decimation", 2);
+    // printf("RX Decimation:      [%d]\n", i);
+    radio_h->rx_decimation = (uint32_t) i;
+
+    i = iniparser_getint(ini, "main:dsp_block_size", 1024);
+    // printf("DSP block size:      [%d]\n", i);
+    radio_h->dsp_block_size = (uint32_t) i;
+
+    radio_h->alsa_cpu = iniparser_getint(ini, "main:alsa_cpu", 1);
+    radio_h->dsp_rx_cpu = iniparser_getint(ini, "main:dsp_rx_cpu", 2);
+    radio_h->dsp_tx_cpu = iniparser_getint(ini, "main:dsp_tx_cpu", 3);
+    // printf("ALSA / DSP RX / DSP TX cpus:      [%d %d %d]\n", radio_h->alsa_cpu, radio_h->dsp_rx_cpu, radio_h->dsp_tx_cpu);
+
+    radio_h->alsa_priority = iniparser_getint(ini, "main:alsa_priority", 99);
+    radio_h->dsp_rx_priority = iniparser_getint(ini, "main:dsp_rx_priority", 90);
+    radio_h->dsp_tx_priority = iniparser_getint(ini, "main:dsp_tx_priority", 90);
+    // printf("ALSA / DSP RX / DSP TX priorities:      [%d %d %d]\n", radio_h->alsa_priority, radio_h->dsp_rx_priority, radio_h->dsp_tx_priority);
+
+    b = iniparser_getboolean(ini, "main:full_duplex", 1);
+    // printf("Full duplex DSP:       [%d]\n", b);
+    radio_h->full_duplex = (bool) b;
+
+    b = iniparser_getboolean(ini, "main:loopback_resampler", 1);
+    // printf("Loopback resampler:    [%d]\n", b);
+    radio_h->loopback_resampler = (bool) b;
+
+    i = iniparser_getint(ini, "main:spectrum_fps", 10);
+    // printf("Spectrum fps:          [%d]\n", i);
+    if (i < 0 || i > SPECTRUM_MAX_FPS)
+        i = 10;
+    radio_h->spectrum_fps = (uint32_t) i;
+
+    i = iniparser_getint(ini, "main:spectrum_bins", 512);
+    // printf("Spectrum bins:         [%d]\n", i);
+    if (i < 64 || i > SPECTRUM_MAX_BINS || (i & (i - 1)))
+        i = 512;
+    radio_h->spectrum_bins = (uint32_t) i;
+
+    i = iniparser_getint(ini, "main:tx_monitor_level", 0);
+    // printf("TX monitor level:      [%d]\n", i);
+    if (i < 0 || i > 100)
+        i = 0;
+    radio_h->tx_monitor_level = (uint32_t) i;
+
+    i = iniparser_getint(ini, "main:cw_pitch", 700);
+    // printf("CW pitch:              [%d]\n", i);
+    if (i < 400 || i > 1200)
+        i = 700;
+    radio_h->cw_pitch = (uint32_t) i;
+
+    i = iniparser_getint(ini, "main:cw_bandwidth", 500);
+    // printf("CW bandwidth:          [%d]\n", i);
+    if (i < 100 || i > 600)
+        i = 500;
+    radio_h->cw_bandwidth = (uint32_t) i;
+
     s = iniparser_getstring(ini, "main:i2c_dev", NULL);
     // printf("I2C device:     [%s]\n", s ? s : "UNDEF");
     if (s)
@@ -250,6 +307,8 @@ bool init_config_user(radio *radio_h, char *ini_name)
             radio_h->profiles[k].mode = MODE_USB;
         else if (!strcmp(s, "LSB"))
             radio_h->profiles[k].mode = MODE_LSB;
+        else if (!strcmp(s, "CW"))
+            radio_h->profiles[k].mode = MODE_CW;
 
         sprintf(profile_field, "%s:operating_mode", profile_name);
         i = iniparser_getint(ini, profile_field, 1);
@@ -299,7 +358,7 @@ bool init_config_user(radio *radio_h, char *ini_name)
         if (!strcmp(s, "OFF"))
             radio_h->profiles[k].compressor = COMPRESSOR_OFF;
         else if (!strcmp(s, "ON"))
-            radio_h->profiles[k].compressor = COMPRESSOR_OFF;
+            radio_h->profiles[k].compressor = COMPRESSOR_ON;
 
         sprintf(profile_field, "%s:bpf_low", profile_name);
         i = iniparser_getint(ini, profile_field, 50);
@@ -331,6 +390,11 @@ bool init_config_user(radio *radio_h, char *ini_name)
         // printf("%s:      [%d]\n", profile_field, b);
         radio_h->profiles[k].digital_voice = (bool) b;
 
+        sprintf(profile_field, "%s:denoise", profile_name);
+        b = iniparser_getboolean(ini, profile_field, 0);
+        // printf("%s:      [%d]\n", profile_field, b);
+        radio_h->profiles[k].denoise = (bool) b;
+
     }
 
     return true;
@@ -0,0 +1,1982 @@
+/* sBitx controller - offline DSP benchmark
+ *
+ * Copyright (C) 2025 Rhizomatica
+ * Author: Rafael Diniz <rafael@riseup.net>
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ *
+ */
+
+// Feeds recorded (WAV or raw S32_LE) or synthetic audio through the very
+// same dsp_process_rx() / dsp_process_tx() calls used by the dsp threads,
+// without any sBitx hardware, codec or ALSA loopback. For each scenario it
+// reports the DSP cost per block and optionally records or checks the
+// outputs against golden vectors, so DSP optimizations can not silently
+// change the audio.
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+#include <time.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <pthread.h>
+#include <alsa/asoundlib.h>
+#include <complex.h>
+#include <fftw3.h>
+
+#include "sbitx_core.h"
+#include "sbitx_dsp.h"
+#include "sbitx_convert.h"
+#include "sbitx_resampler.h"
+#include "sbitx_spectrum.h"
+#include "sbitx_agc.h"
+#include "sbitx_compressor.h"
+#include "sbitx_cw.h"
+#include "sbitx_nco.h"
+#include "shm_utils.h"
+
+// symbols the DSP code expects from the rest of the controller
+snd_pcm_format_t format = SND_PCM_FORMAT_S32_LE;
+_Atomic bool shutdown_ = false;
+
+extern _Atomic bool tx_starting;
+extern _Atomic bool rx_starting;
+
+// no ALSA rings here, the DSP state reset is all we need
+void clear_buffers()
+{
+}
+
+void clear_tx_buffers()
+{
+}
+
+#define BENCH_RATE 96000
+#define BENCH_DEFAULT_BLOCKS 500
+#define BENCH_WARMUP_BLOCKS 8
+#define BENCH_DEFAULT_TOLERANCE 90.0 // minimum output to error ratio, in dB
+
+struct bench_scenario {
+    const char *name;
+    bool tx;
+    uint16_t mode;
+    uint16_t agc;
+    uint16_t operating_mode; // OPERATING_MODE_FULL_VOICE (96 kHz mic) or OPERATING_MODE_FULL_LOOPBACK (48 kHz stereo)
+    bool tone_generation;
+};
+
+static const struct bench_scenario scenarios[] = {
+    { "rx_usb",         false, MODE_USB, AGC_OFF,    OPERATING_MODE_FULL_VOICE,    false },
+    { "rx_lsb",         false, MODE_LSB, AGC_OFF,    OPERATING_MODE_FULL_VOICE,    false },
+    { "rx_usb_agc",     false, MODE_USB, AGC_MEDIUM, OPERATING_MODE_FULL_VOICE,    false },
+    { "rx_lsb_agc",     false, MODE_LSB, AGC_MEDIUM, OPERATING_MODE_FULL_VOICE,    false },
+    { "tx_usb_mic",     true,  MODE_USB, AGC_OFF,    OPERATING_MODE_FULL_VOICE,    false },
+    { "tx_lsb_mic",     true,  MODE_LSB, AGC_OFF,    OPERATING_MODE_FULL_VOICE,    false },
+    { "tx_usb_loop",    true,  MODE_USB, AGC_OFF,    OPERATING_MODE_FULL_LOOPBACK, false },
+    { "tx_lsb_loop",    true,  MODE_LSB, AGC_OFF,    OPERATING_MODE_FULL_LOOPBACK, false },
+    { "tx_usb_tone",    true,  MODE_USB, AGC_OFF,    OPERATING_MODE_FULL_VOICE,    true  },
+};
+
+#define N_SCENARIOS (sizeof(scenarios) / sizeof(scenarios[0]))
+
+// the three output streams of each DSP call, in the order they are stored
+#define N_STREAMS 3
+static const char *stream_names[N_STREAMS] = { "speaker", "loopback", "tx" };
+
+struct bench_input {
+    int32_t *samples; // interleaved, S32_LE with 24 valid bits in the MSBs
+    uint32_t frames;
+    uint32_t channels;
+};
+
+struct bench_options {
+    uint32_t blocks;
+    double tolerance;
+    char *record_dir;
+    char *check_dir;
+    char *input_file;
+    char *loopback_file;
+    char *only;
+    uint32_t rx_decimation;
+    uint32_t block_size;
+    bool mode_stress;
+    bool kernel_check;
+    bool tr_recovery;
+    bool resampler_check;
+    bool spectrum_check;
+    bool denoise_check;
+    bool agc_check;
+    bool compressor_check;
+    bool cw_check;
+    bool nco_check;
+};
+
+// reads a WAV (32 bit PCM) or headerless S32_LE file
+static bool load_input(const char *path, uint32_t raw_channels, struct bench_input *in)
+{
+    FILE *f = fopen(path, "rb");
+    if (f == NULL)
+    {
+        fprintf(stderr, "Can not open %s: %s\n", path, strerror(errno));
+        return false;
+    }
+
+    fseek(f, 0, SEEK_END);
+    long file_size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+
+    uint8_t hdr[12];
+    long data_offset = 0;
+    long data_size = file_size;
+    in->channels = raw_channels;
+
+    if (fread(hdr, 1, 12, f) == 12 && !memcmp(hdr, "RIFF", 4) && !memcmp(hdr + 8, "WAVE", 4))
+    {
+        uint8_t chunk[8];
+        bool fmt_ok = false;
+        data_size = 0;
+
+        while (fread(chunk, 1, 8, f) == 8)
+        {
+            uint32_t chunk_size;
+            memcpy(&chunk_size, chunk + 4, 4);
+
+            if (!memcmp(chunk, "fmt ", 4))
+            {
+                uint8_t fmt[16];
+                if (chunk_size < 16 || fread(fmt, 1, 16, f) != 16)
+                    break;
+                uint16_t audio_format, channels, bits;
+                memcpy(&audio_format, fmt, 2);
+                memcpy(&channels, fmt + 2, 2);
+                memcpy(&bits, fmt + 14, 2);
+                // 1 is PCM, 0xfffe is WAVE_FORMAT_EXTENSIBLE
+                if ((audio_format != 1 && audio_format != 0xfffe) || bits != 32)
+                {
+                    fprintf(stderr, "%s: only 32 bit PCM WAV files are supported\n", path);
+                    break;
+                }
+                in->channels = channels;
+                fmt_ok = true;
+                fseek(f, chunk_size - 16 + (chunk_size & 1), SEEK_CUR);
+            }
+            else if (!memcmp(chunk, "data", 4))
+            {
+                data_offset = ftell(f);
+                data_size = chunk_size;
+                break;
+            }
+            else
+            {
+                fseek(f, chunk_size + (chunk_size & 1), SEEK_CUR);
+            }
+        }
+
+        if (!fmt_ok || data_size == 0)
+        {
+            fprintf(stderr, "%s: invalid or unsupported WAV file\n", path);
+            fclose(f);
+            return false;
+        }
+    }
+
+    fseek(f, data_offset, SEEK_SET);
+    in->frames = data_size / (sizeof(int32_t) * in->channels);
+    in->samples = malloc(in->frames * in->channels * sizeof(int32_t));
+    in->frames = fread(in->samples, sizeof(int32_t) * in->channels, in->frames, f);
+    fclose(f);
+
+    if (in->frames == 0)
+    {
+        fprintf(stderr, "%s: no samples\n", path);
+        return false;
+    }
+
+    return true;
+}
+
+// deterministic white noise, so the synthetic inputs are the same in every run
+static double noise(uint32_t *state)
+{
+    *state = *state * 1664525 + 1013904223;
+    return ((double) (*state >> 8) / 8388608.0) - 1.0;
+}
+
+static int32_t to_s32(double v)
+{
+    if (v > 1.0)
+        v = 1.0;
+    if (v < -1.0)
+        v = -1.0;
+    return ((int32_t) (v * 8388607.0)) << 8;
+}
+
+// 96 kHz mono IF capture at a weak signal level: a tone 1 kHz above and one 1.5 kHz below the 24 kHz
+// carrier (so both USB and LSB have something to listen to) plus wideband noise
+static void synth_rx(struct bench_input *in, uint32_t frames)
+{
+    uint32_t seed = 0x5b17;
+    in->frames = frames;
+    in->channels = 1;
+    in->samples = malloc(frames * sizeof(int32_t));
+    for (uint32_t i = 0; i < frames; i++)
+    {
+        double t = (double) i / BENCH_RATE;
+        double s = 0.0002 * sin(2 * M_PI * 25000.0 * t) + 0.0001 * sin(2 * M_PI * 22500.0 * t) + 0.00002 * noise(&seed);
+        in->samples[i] = to_s32(s);
+    }
+}
+
+// 96 kHz mono microphone: two voice band tones plus noise
+static void synth_mic(struct bench_input *in, uint32_t frames)
+{
+    uint32_t seed = 0xa11ce;
+    in->frames = frames;
+    in->channels = 1;
+    in->samples = malloc(frames * sizeof(int32_t));
+    for (uint32_t i = 0; i < frames; i++)
+    {
+        double t = (double) i / BENCH_RATE;
+        double s = 0.3 * sin(2 * M_PI * 700.0 * t) + 0.3 * sin(2 * M_PI * 1900.0 * t) + 0.01 * noise(&seed);
+        in->samples[i] = to_s32(s);
+    }
+}
+
+// 48 kHz stereo loopback, as a modem would play it (L == R)
+static void synth_loopback(struct bench_input *in, uint32_t frames)
+{
+    uint32_t seed = 0x1009;
+    in->frames = frames;
+    in->channels = 2;
+    in->samples = malloc(frames * 2 * sizeof(int32_t));
+    for (uint32_t i = 0; i < frames; i++)
+    {
+        double t = (double) i / (BENCH_RATE / 2);
+        double s = 0.4 * sin(2 * M_PI * 1500.0 * t) + 0.2 * sin(2 * M_PI * 2300.0 * t) + 0.01 * noise(&seed);
+        in->samples[2 * i] = to_s32(s);
+        in->samples[2 * i + 1] = in->samples[2 * i];
+    }
+}
+
+// copies one block of the input (looping over the file if it is too short)
+// as the control thread would receive it: 96 kHz mono, or 48 kHz stereo
+static void fill_block(struct bench_input *in, uint32_t block, uint32_t block_size, bool stereo_48k, int32_t *out)
+{
+    uint32_t frames_per_block = stereo_48k ? block_size / 2 : block_size;
+    uint64_t start = (uint64_t) block * frames_per_block;
+
+    for (uint32_t i = 0; i < frames_per_block; i++)
+    {
+        uint32_t frame = (start + i) % in->frames;
+        int32_t *s = &in->samples[frame * in->channels];
+        if (stereo_48k)
+        {
+            out[2 * i] = s[0];
+            out[2 * i + 1] = (in->channels > 1) ? s[1] : s[0];
+        }
+        else
+        {
+            out[i] = s[0];
+        }
+    }
+}
+
+static uint64_t now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void init_radio(radio *radio_h, const struct bench_scenario *sc, struct bench_options *opt)
+{
+    memset(radio_h, 0, sizeof(radio));
+
+    radio_h->profiles_count = 1;
+    radio_h->profile_active_idx = 0;
+    radio_h->profile_default_idx = 0;
+    radio_h->tone_generation = sc->tone_generation;
+    radio_h->txrx_state = sc->tx ? IN_TX : IN_RX;
+
+    radio_h->band_power[0].f_start = 500000;
+    radio_h->band_power[0].f_stop = 30000000;
+    radio_h->band_power[0].scale = 1.0;
+    radio_h->band_power_count = 1;
+    radio_h->rx_decimation = opt->rx_decimation;
+    radio_h->dsp_block_size = opt->block_size;
+    // rx_starting restarts the rx chain, so each run starts from a clean state
+    radio_h->full_duplex = false;
+    radio_h->cw_pitch = 700;
+    radio_h->cw_bandwidth = 500;
+
+    radio_profile *p = &radio_h->profiles[0];
+    p->freq = 7050000;
+    p->operating_mode = sc->operating_mode;
+    p->mode = sc->mode;
+    p->agc = sc->agc;
+    p->compressor = COMPRESSOR_OFF;
+    p->bpf_low = 100;
+    p->bpf_high = 3000;
+    p->power_level_percentage = 100;
+}
+
+static char *golden_path(const char *dir, const char *scenario, int stream)
+{
+    static char path[4096];
+    snprintf(path, sizeof(path), "%s/%s_%s.raw", dir, scenario, stream_names[stream]);
+    return path;
+}
+
+// compares one output stream against its golden vector, returns true if
+// the output to error ratio is at least tolerance dB. The golden vector may
+// be shorter than the run (the committed ones are the first blocks only),
+// n_compared is the samples of both
+static bool check_stream(const char *path, int32_t *out, uint32_t n_samples, double tolerance, double *ratio_db, int32_t *max_diff, uint32_t *n_compared)
+{
+    FILE *f = fopen(path, "rb");
+    if (f == NULL)
+    {
+        fprintf(stderr, "Can not open golden vector %s: %s\n", path, strerror(errno));
+        return false;
+    }
+
+    int32_t *golden = malloc(n_samples * sizeof(int32_t));
+    size_t n_read = fread(golden, sizeof(int32_t), n_samples, f);
+    fclose(f);
+
+    if (n_read == 0)
+    {
+        fprintf(stderr, "Golden vector %s is empty\n", path);
+        free(golden);
+        return false;
+    }
+    n_samples = *n_compared = n_read;
+
+    double signal = 0, error = 0;
+    *max_diff = 0;
+    for (uint32_t i = 0; i < n_samples; i++)
+    {
+        // compare the 24 valid bits only
+        double g = golden[i] >> 8;
+        double d = (double) (out[i] >> 8) - g;
+        signal += g * g;
+        error += d * d;
+        if (fabs(d) > *max_diff)
+            *max_diff = (int32_t) fabs(d);
+    }
+    free(golden);
+
+    if (error == 0)
+    {
+        *ratio_db = INFINITY;
+        return true;
+    }
+
+    if (signal == 0)
+    {
+        *ratio_db = -INFINITY;
+        return false;
+    }
+
+    *ratio_db = 10.0 * log10(signal / error);
+    return *ratio_db >= tolerance;
+}
+
+static bool write_stream(const char *path, int32_t *out, uint32_t n_samples)
+{
+    FILE *f = fopen(path, "wb");
+    if (f == NULL)
+    {
+        fprintf(stderr, "Can not write golden vector %s: %s\n", path, strerror(errno));
+        return false;
+    }
+    bool ok = fwrite(out, sizeof(int32_t), n_samples, f) == n_samples;
+    fclose(f);
+    return ok;
+}
+
+// one DSP call, as the dsp threads do it (here with all the outputs), the outputs go at offset
+static void process_block(const struct bench_scenario *sc, struct bench_options *opt, bool stereo_48k, int32_t *block_in, int32_t **outputs, uint32_t offset)
+{
+    if (sc->tx)
+        dsp_process_tx((uint8_t *) block_in, (uint8_t *) &outputs[0][offset], (uint8_t *) &outputs[1][offset], (uint8_t *) &outputs[2][offset], opt->block_size, stereo_48k);
+    else
+        dsp_process_rx((uint8_t *) block_in, (uint8_t *) &outputs[0][offset], (uint8_t *) &outputs[1][offset], (uint8_t *) &outputs[2][offset], opt->block_size);
+}
+
+struct mode_stress {
+    radio *radio_h;
+    _Atomic bool stop;
+    uint64_t switches;
+};
+
+// what a CMD_SET_MODE storm from the shm or websocket thread does, through set_mode()
+static void *mode_stress_thread(void *arg)
+{
+    struct mode_stress *ms = (struct mode_stress *) arg;
+
+    while (!ms->stop)
+    {
+        ms->radio_h->profiles[0].mode = (ms->radio_h->profiles[0].mode == MODE_USB) ? MODE_LSB : MODE_USB;
+        dsp_set_filters();
+        ms->switches++;
+    }
+
+    return NULL;
+}
+
+// Streams the input while another thread keeps switching between USB and
+// LSB. The DSP keeps no filter dependent state across blocks (with the AGC
+// off), so every block must match, bit for bit, the same block of a plain
+// USB or LSB run: anything else is a filter torn mid-block.
+static int run_mode_stress(const struct bench_scenario *sc, struct bench_options *opt, radio *radio_h, struct bench_input *input, bool stereo_48k, int32_t *block_in, int32_t **outputs)
+{
+    if (sc->agc != AGC_OFF || sc->tone_generation)
+    {
+        printf("%-14s mode stress skipped (AGC and tone state depend on the whole run)\n", sc->name);
+        return EXIT_SUCCESS;
+    }
+
+    uint16_t modes[2] = { MODE_USB, MODE_LSB };
+    int32_t *refs[2][N_STREAMS];
+    size_t stream_bytes = (size_t) opt->blocks * opt->block_size * sizeof(int32_t);
+
+    for (int m = 0; m < 2; m++)
+    {
+        radio_h->profiles[0].mode = modes[m];
+        dsp_set_filters();
+        rx_starting = true;
+        tx_starting = true;
+        for (int s = 0; s < N_STREAMS; s++)
+            refs[m][s] = malloc(stream_bytes);
+        for (uint32_t b = 0; b < opt->blocks; b++)
+        {
+            fill_block(input, b, opt->block_size, stereo_48k, block_in);
+            process_block(sc, opt, stereo_48k, block_in, refs[m], b * opt->block_size);
+        }
+    }
+
+    struct mode_stress ms = { .radio_h = radio_h, .stop = false, .switches = 0 };
+    pthread_t tid;
+    rx_starting = true;
+    tx_starting = true;
+    pthread_create(&tid, NULL, mode_stress_thread, &ms);
+
+    for (uint32_t b = 0; b < opt->blocks; b++)
+    {
+        fill_block(input, b, opt->block_size, stereo_48k, block_in);
+        process_block(sc, opt, stereo_48k, block_in, outputs, b * opt->block_size);
+    }
+
+    ms.stop = true;
+    pthread_join(tid, NULL);
+
+    // the rx linear interpolation (rx_decimation > 1) starts each block from
+    // the last sample of the previous one, filtered with the previous filter
+    uint32_t skip = (!sc->tx && opt->rx_decimation > 1) ? opt->rx_decimation : 0;
+    uint32_t matched[2] = { 0, 0 }, torn = 0;
+
+    for (uint32_t b = 0; b < opt->blocks; b++)
+    {
+        size_t offset = (size_t) b * opt->block_size + skip;
+        size_t bytes = (opt->block_size - skip) * sizeof(int32_t);
+        int found = -1;
+
+        for (int m = 0; m < 2 && found < 0; m++)
+        {
+            bool same = true;
+            for (int s = 0; s < N_STREAMS; s++)
+                same = same && !memcmp(&outputs[s][offset], &refs[m][s][offset], bytes);
+            if (same)
+                found = m;
+        }
+
+        if (found < 0)
+            torn++;
+        else
+            matched[found]++;
+    }
+
+    printf("%-14s mode stress: %lu mode switches, %u usb blocks, %u lsb blocks, %u torn blocks %s\n",
+           sc->name, (unsigned long) ms.switches, matched[0], matched[1], torn, torn ? "FAIL" : "OK");
+
+    for (int m = 0; m < 2; m++)
+        for (int s = 0; s < N_STREAMS; s++)
+            free(refs[m][s]);
+
+    return torn ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+#define TR_TX_BLOCKS 32 // about 340 ms of tx with 1024 samples blocks
+#define TR_ERROR_DB -40.0 // recovered when the error to the reference stays below this
+
+// An rx run with a tx in the middle, as tr_switch() does it, against the
+// same run without the tx: the rx audio is recovered at the last sample
+// whose error exceeds TR_ERROR_DB of the reference peak. The restart
+// (full_duplex = 0) stops the rx chain during tx and resets it at the end,
+// the warm one (full_duplex = 1) keeps it running, muted. The receiver
+// input during tx is the same IF signal, as after the relays switch back.
+static int run_tr_recovery(const struct bench_scenario *sc, struct bench_options *opt, radio *radio_h, struct bench_input *input, int32_t *block_in, int32_t **outputs)
+{
+    if (sc->tx || sc->agc != AGC_OFF)
+    {
+        printf("%-14s T/R recovery skipped (%s)\n", sc->name, sc->tx ? "rx only" : "the agc gain is held during tx, it depends on the whole run");
+        return EXIT_SUCCESS;
+    }
+
+    uint32_t tx_start = opt->blocks / 4;
+    uint32_t tx_end = tx_start + TR_TX_BLOCKS;
+    if (tx_end >= opt->blocks)
+    {
+        fprintf(stderr, "T/R recovery needs more than %u blocks\n", tx_end);
+        return EXIT_FAILURE;
+    }
+
+    size_t stream_bytes = (size_t) opt->blocks * opt->block_size * sizeof(int32_t);
+    int32_t *ref = malloc(stream_bytes);
+    double peak = 0;
+
+    for (int run = 0; run < 3; run++)
+    {
+        radio_h->full_duplex = (run == 2);
+        radio_h->txrx_state = IN_RX;
+        rx_starting = true;
+
+        // full_duplex does not reset at rx_starting, start it from the same state
+        if (run == 2)
+            fft_reset_m_bins();
+
+        uint64_t tx_ns = 0;
+        for (uint32_t b = 0; b < opt->blocks; b++)
+        {
+            uint32_t offset = b * opt->block_size;
+            if (run > 0 && b == tx_start)
+                radio_h->txrx_state = IN_TX;
+            if (run > 0 && b == tx_end)
+            {
+                rx_starting = true;
+                radio_h->txrx_state = IN_RX;
+            }
+
+            fill_block(input, b, opt->block_size, false, block_in);
+            uint64_t start = now_ns();
+            if (radio_h->txrx_state == IN_TX && !radio_h->full_duplex)
+            {
+                // what dsp_rx_thread() writes when the chain is stopped
+                memset(&outputs[0][offset], 0, opt->block_size * sizeof(int32_t));
+                memset(&outputs[1][offset], 0, opt->block_size * sizeof(int32_t));
+            }
+            else
+                process_block(sc, opt, false, block_in, outputs, offset);
+            if (radio_h->txrx_state == IN_TX)
+                tx_ns += now_ns() - start;
+        }
+
+        if (run == 0)
+        {
+            memcpy(ref, outputs[0], stream_bytes);
+            for (size_t i = (size_t) tx_end * opt->block_size; i < (size_t) opt->blocks * opt->block_size; i++)
+                if (fabs((double) ref[i]) > peak)
+                    peak = fabs((double) ref[i]);
+            continue;
+        }
+
+        double limit = peak * pow(10.0, TR_ERROR_DB / 20.0);
+        size_t first = (size_t) tx_end * opt->block_size, last = first;
+        for (size_t i = first; i < (size_t) opt->blocks * opt->block_size; i++)
+            if (fabs((double) outputs[0][i] - (double) ref[i]) > limit)
+                last = i + 1;
+
+        printf("%-14s T/R recovery %-7s %7.2f ms (%zu samples) after the end of tx, rx dsp during tx %7.0f ns per block\n",
+               sc->name, run == 1 ? "restart" : "warm", 1e3 * (last - first) / BENCH_RATE, last - first, (double) tx_ns / TR_TX_BLOCKS);
+    }
+
+    free(ref);
+    return EXIT_SUCCESS;
+}
+
+// runs in its own process, so the static state kept by the DSP (AGC gain,
+// tone phase, overlap buffers) always starts from scratch
+static int run_scenario(const struct bench_scenario *sc, struct bench_options *opt)
+{
+    radio radio_h;
+    struct bench_input input;
+    bool stereo_48k = sc->tx && sc->operating_mode == OPERATING_MODE_FULL_LOOPBACK;
+
+    init_radio(&radio_h, sc, opt);
+
+    if (sc->tx && stereo_48k)
+    {
+        if (opt->loopback_file)
+        {
+            if (!load_input(opt->loopback_file, 2, &input))
+                return EXIT_FAILURE;
+        }
+        else
+            synth_loopback(&input, opt->blocks * opt->block_size / 2);
+    }
+    else if (opt->input_file)
+    {
+        if (!load_input(opt->input_file, 1, &input))
+            return EXIT_FAILURE;
+    }
+    else if (sc->tx)
+        synth_mic(&input, opt->blocks * opt->block_size);
+    else
+        synth_rx(&input, opt->blocks * opt->block_size);
+
+    dsp_init(&radio_h);
+
+    uint32_t block_bytes = opt->block_size * sizeof(int32_t);
+    int32_t *block_in = malloc(block_bytes);
+    int32_t *outputs[N_STREAMS];
+    for (int s = 0; s < N_STREAMS; s++)
+        outputs[s] = malloc((size_t) opt->blocks * block_bytes);
+
+    // warm up caches and the branch predictors, then start from a clean state
+    for (uint32_t b = 0; b < BENCH_WARMUP_BLOCKS; b++)
+    {
+        fill_block(&input, b, opt->block_size, stereo_48k, block_in);
+        process_block(sc, opt, stereo_48k, block_in, outputs, 0);
+    }
+    rx_starting = true;
+    tx_starting = true;
+
+    if (opt->mode_stress || opt->tr_recovery)
+    {
+        int ret = opt->mode_stress ? run_mode_stress(sc, opt, &radio_h, &input, stereo_48k, block_in, outputs) :
+            run_tr_recovery(sc, opt, &radio_h, &input, block_in, outputs);
+        for (int s = 0; s < N_STREAMS; s++)
+            free(outputs[s]);
+        free(block_in);
+        free(input.samples);
+        dsp_free(&radio_h);
+        return ret;
+    }
+
+    uint64_t total_ns = 0, max_ns = 0, min_ns = UINT64_MAX;
+    for (uint32_t b = 0; b < opt->blocks; b++)
+    {
+        uint32_t offset = b * opt->block_size;
+        fill_block(&input, b, opt->block_size, stereo_48k, block_in);
+
+        uint64_t start = now_ns();
+        process_block(sc, opt, stereo_48k, block_in, outputs, offset);
+        uint64_t elapsed = now_ns() - start;
+
+        total_ns += elapsed;
+        if (elapsed > max_ns)
+            max_ns = elapsed;
+        if (elapsed < min_ns)
+            min_ns = elapsed;
+    }
+
+    double budget_ns = 1e9 * opt->block_size / BENCH_RATE;
+    double mean_ns = (double) total_ns / opt->blocks;
+
+    printf("%-14s %6u blocks  mean %9.0f ns  min %9lu ns  max %9lu ns  %9.1f blocks/s  load %5.2f%% of %.2f ms  headroom %6.1fx  latency %.2f ms\n",
+           sc->name, opt->blocks, mean_ns, min_ns, max_ns, 1e9 / mean_ns,
+           100.0 * mean_ns / budget_ns, budget_ns / 1e6, budget_ns / mean_ns,
+           1e3 * dsp_latency(sc->tx) / BENCH_RATE);
+
+    int ret = EXIT_SUCCESS;
+    uint32_t n_samples = opt->blocks * opt->block_size;
+
+    for (int s = 0; s < N_STREAMS; s++)
+    {
+        if (opt->record_dir)
+        {
+            if (!write_stream(golden_path(opt->record_dir, sc->name, s), outputs[s], n_samples))
+                ret = EXIT_FAILURE;
+        }
+
+        if (opt->check_dir)
+        {
+            double ratio_db = 0;
+            int32_t max_diff = 0;
+            uint32_t n_compared = 0;
+            bool ok = check_stream(golden_path(opt->check_dir, sc->name, s), outputs[s], n_samples, opt->tolerance, &ratio_db, &max_diff, &n_compared);
+            printf("%-14s   %-8s golden %s  (%u blocks, output/error %.1f dB, max diff %d LSB)\n", "", stream_names[s], ok ? "OK  " : "FAIL",
+                   n_compared / opt->block_size, ratio_db, max_diff);
+            if (!ok)
+                ret = EXIT_FAILURE;
+        }
+    }
+
+    for (int s = 0; s < N_STREAMS; s++)
+        free(outputs[s]);
+    free(block_in);
+    free(input.samples);
+    dsp_free(&radio_h);
+
+    return ret;
+}
+
+// the sample conversion kernels against plain C, for every tail length,
+// then their cost over one 1024 samples block
+#define KERNEL_MAX 1024
+#define KERNEL_ITERATIONS 20000
+
+static int run_kernel_check()
+{
+    static int32_t in_s32[2 * KERNEL_MAX + 8], out_a[2 * KERNEL_MAX + 8], out_b[2 * KERNEL_MAX + 8], out_c[2 * KERNEL_MAX + 8], out_d[2 * KERNEL_MAX + 8];
+    static dsp_real in_real[2 * KERNEL_MAX + 8], real_a[KERNEL_MAX + 8], real_b[KERNEL_MAX + 8];
+    static float f_a[KERNEL_MAX + 8], f_b[KERNEL_MAX + 8];
+    const dsp_real scale_in = (dsp_real) (1.0 / 8388607.0);
+    const dsp_real scale_out = (dsp_real) 8388607.0;
+    uint32_t state = 1;
+    int failures = 0;
+
+    for (int i = 0; i < 2 * KERNEL_MAX + 8; i++)
+    {
+        in_s32[i] = to_s32(noise(&state) * 0.9) | (int32_t) (i & 0xff); // the low byte must be dropped
+        in_real[i] = (dsp_real) (noise(&state) * 0.9);
+    }
+
+    for (uint32_t n = 0; n <= KERNEL_MAX; n = (n < 40) ? n + 1 : n * 2)
+    {
+        bool ok = true;
+
+        deinterleave_s32(in_s32, out_a, out_b, n);
+        interleave_s32(out_a, out_b, out_c, n);
+        for (uint32_t i = 0; i < n; i++)
+            ok &= out_a[i] == in_s32[2 * i] && out_b[i] == in_s32[2 * i + 1] && out_c[2 * i] == in_s32[2 * i] && out_c[2 * i + 1] == in_s32[2 * i + 1];
+
+        for (uint32_t stride = 1; stride <= 2; stride++)
+        {
+            convert_s32_to_real(in_s32, stride, real_a, n, scale_in);
+            for (uint32_t i = 0; i < n; i++)
+                ok &= real_a[i] == (dsp_real) (in_s32[i * stride] >> 8) * scale_in;
+
+            convert_real_to_s32(in_real, stride, out_a, n, scale_out, 8);
+            for (uint32_t i = 0; i < n; i++)
+                ok &= out_a[i] == (int32_t) (in_real[i * stride] * scale_out) << 8;
+        }
+
+        convert_real_to_s32_rx(in_real, out_a, out_b, n, scale_out);
+        for (uint32_t i = 0; i < n; i++)
+            ok &= out_a[i] == (int32_t) (in_real[i] * scale_out) << 8 && out_b[i] == (int32_t) (in_real[i & ~1] * scale_out) << 4;
+
+        convert_real_to_float(in_real, f_a, n);
+        convert_float_to_real(f_a, real_b, n);
+        for (uint32_t i = 0; i < n; i++)
+            ok &= f_a[i] == (float) in_real[i] && real_b[i] == (dsp_real) f_a[i];
+
+        if (!ok)
+        {
+            printf("kernel check FAIL at %u samples\n", n);
+            failures++;
+        }
+    }
+
+    // keep the compiler from dropping the timed calls
+    memset(out_d, 0, sizeof(out_d));
+    const char *names[] = { "deinterleave_s32", "interleave_s32", "convert_s32_to_real", "convert_s32_to_real (stereo)",
+                            "convert_real_to_s32", "convert_real_to_s32 (complex)", "convert_real_to_s32_rx", "convert_real_to_float" };
+    for (int k = 0; k < 8; k++)
+    {
+        uint64_t start = now_ns();
+        for (int it = 0; it < KERNEL_ITERATIONS; it++)
+        {
+            switch (k)
+            {
+            case 0: deinterleave_s32(in_s32, out_a, out_b, KERNEL_MAX); break;
+            case 1: interleave_s32(out_a, out_b, out_c, KERNEL_MAX); break;
+            case 2: convert_s32_to_real(in_s32, 1, real_a, KERNEL_MAX, scale_in); break;
+            case 3: convert_s32_to_real(in_s32, 2, real_a, KERNEL_MAX, scale_in); break;
+            case 4: convert_real_to_s32(in_real, 1, out_a, KERNEL_MAX, scale_out, 8); break;
+            case 5: convert_real_to_s32(in_real, 2, out_a, KERNEL_MAX, scale_out, 8); break;
+            case 6: convert_real_to_s32_rx(in_real, out_a, out_b, KERNEL_MAX, scale_out); break;
+            case 7: convert_real_to_float(in_real, f_b, KERNEL_MAX); break;
+            }
+            out_d[it & 7] += out_a[it & 7] + out_b[it & 7] + (int32_t) real_a[it & 7] + (int32_t) f_b[it & 7];
+        }
+        printf("%-30s %8.1f ns per %d samples block\n", names[k], (now_ns() - start) / (double) KERNEL_ITERATIONS, KERNEL_MAX);
+    }
+
+    printf("kernel check: %s\n", failures ? "FAIL" : "ok");
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+// the loopback resampler: a tone through a fixed ratio (quality and cost),
+// then both loopback rings against a drifting snd-aloop clock, simulated
+// in time: the dsp side moves a block at the codec rate, the alsa side a
+// period at the codec rate times (1 + ppm)
+#define RS_RATE 48000
+#define RS_PERIOD 256
+#define RS_BLOCK 512
+#define RS_SECONDS 300
+#define RS_SETTLE_SECONDS 100
+#define RS_FIFO_FRAMES 16384
+
+struct rs_fifo {
+    int32_t data[RS_FIFO_FRAMES * 2]; // stereo frames
+    uint32_t head, tail; // frames, free running
+};
+
+static void rs_push(struct rs_fifo *f, const int32_t *in, uint32_t frames)
+{
+    for (uint32_t i = 0; i < frames; i++, f->head++)
+    {
+        f->data[2 * (f->head % RS_FIFO_FRAMES)] = in[2 * i];
+        f->data[2 * (f->head % RS_FIFO_FRAMES) + 1] = in[2 * i + 1];
+    }
+}
+
+static void rs_pop(struct rs_fifo *f, int32_t *out, uint32_t frames)
+{
+    for (uint32_t i = 0; i < frames; i++, f->tail++)
+    {
+        out[2 * i] = f->data[2 * (f->tail % RS_FIFO_FRAMES)];
+        out[2 * i + 1] = f->data[2 * (f->tail % RS_FIFO_FRAMES) + 1];
+    }
+}
+
+static void rs_tone(int32_t *out, uint32_t frames, uint64_t *n)
+{
+    for (uint32_t i = 0; i < frames; i++, (*n)++)
+        out[2 * i] = out[2 * i + 1] = to_s32(0.5 * sin(2 * M_PI * 1000.0 * *n / RS_RATE));
+}
+
+// ppm > 0 is a snd-aloop faster than the codec. Returns the failures
+static int rs_drift(bool capture, double ppm)
+{
+    static struct resampler r;
+    static struct rs_fifo fifo;
+    int32_t in[(RS_BLOCK + RESAMPLER_TAPS) * 2], out[(RS_BLOCK + RESAMPLER_TAPS) * 2];
+    double alsa_period = RS_PERIOD / (RS_RATE * (1 + ppm * 1e-6));
+    double dsp_period = (double) RS_BLOCK / RS_RATE;
+    double t_alsa = 0, t_dsp = 0;
+    uint32_t target = capture ? RS_BLOCK + RS_PERIOD : RS_BLOCK / 2 + RS_PERIOD;
+    uint32_t xruns = 0, xruns_settled = 0, max_err = 0;
+    uint64_t tone = 0;
+
+    memset(&fifo, 0, sizeof(fifo));
+    resampler_init(&r, 2, RS_RATE, RS_BLOCK, target, capture);
+
+    // start the ring at the target, as the prefill does
+    memset(in, 0, sizeof(in));
+    for (uint32_t f = 0; f < target; f += RS_PERIOD)
+        rs_push(&fifo, in, RS_PERIOD);
+
+    while (t_alsa < RS_SECONDS && t_dsp < RS_SECONDS)
+    {
+        bool settled = t_alsa > RS_SETTLE_SECONDS;
+        uint32_t fill = fifo.head - fifo.tail;
+
+        if (t_alsa <= t_dsp)
+        {
+            // the alsa thread of the direction, as in sbitx_alsa.c
+            resampler_control(&r, fill, (uint64_t) (t_alsa * 1e9) + 1);
+            if (capture)
+            {
+                rs_tone(in, RS_PERIOD, &tone);
+                uint32_t n = resampler_process(&r, in, RS_PERIOD, out, RS_PERIOD + RESAMPLER_TAPS);
+                rs_push(&fifo, out, n);
+            }
+            else
+            {
+                uint32_t needed = resampler_needed(&r, RS_PERIOD);
+                if (needed > fill)
+                {
+                    xruns++;
+                    xruns_settled += settled;
+                }
+                else
+                {
+                    rs_pop(&fifo, in, needed);
+                    resampler_process(&r, in, needed, out, RS_PERIOD);
+                }
+            }
+            t_alsa += alsa_period;
+        }
+        else
+        {
+            // the dsp thread
+            if (capture)
+            {
+                if (fill < RS_BLOCK)
+                {
+                    xruns++;
+                    xruns_settled += settled;
+                }
+                else
+                    rs_pop(&fifo, out, RS_BLOCK);
+            }
+            else
+            {
+                rs_tone(in, RS_BLOCK, &tone);
+                rs_push(&fifo, in, RS_BLOCK);
+            }
+            resampler_block(&r, (uint64_t) (t_dsp * 1e9) + 1);
+            t_dsp += dsp_period;
+        }
+
+        if (settled)
+        {
+            uint32_t err = abs((int32_t) r.fill - (int32_t) target);
+            if (err > max_err)
+                max_err = err;
+        }
+    }
+
+    bool ok = xruns_settled == 0 && fabs(r.ppm - ppm) < 2.0 && max_err < RS_PERIOD;
+    printf("%-8s drift %+6.0f ppm: estimated %+8.2f ppm, fill %4u (target %u, max error %3u) frames, %s %u (%u after %d s) %s\n",
+           capture ? "capture" : "playback", ppm, r.ppm, r.fill, target, max_err,
+           capture ? "starved blocks" : "underruns", xruns, xruns_settled, RS_SETTLE_SECONDS, ok ? "ok" : "FAIL");
+
+    return ok ? 0 : 1;
+}
+
+static int run_resampler_check()
+{
+    static struct resampler r;
+    static int32_t in[RS_PERIOD * 2], out[(RS_PERIOD + RESAMPLER_TAPS) * 2];
+    const double ratio = 1 + 200e-6;
+    const uint32_t periods = 2000;
+    const double w = 2 * M_PI * 1000.0 / RS_RATE;
+    double sc = 0, ss = 0, cc = 0, ys = 0, yc = 0, yy = 0;
+    uint64_t tone = 0, n = 0, process_ns = 0;
+    int failures = 0;
+
+    // a 1 kHz tone at a fixed ratio, the output is the tone at 1 kHz * ratio:
+    // least squares fit of it, the residual is the resampler error
+    resampler_init(&r, 2, RS_RATE, RS_PERIOD, 0, true);
+    r.ratio = ratio;
+    for (uint32_t p = 0; p < periods; p++)
+    {
+        rs_tone(in, RS_PERIOD, &tone);
+        uint64_t start = now_ns();
+        uint32_t frames = resampler_process(&r, in, RS_PERIOD, out, RS_PERIOD + RESAMPLER_TAPS);
+        process_ns += now_ns() - start;
+        for (uint32_t i = 0; i < frames; i++, n++)
+        {
+            // past the initial silence of the history
+            if (n < RESAMPLER_TAPS * 4)
+                continue;
+            double y = out[2 * i] / 2147483648.0;
+            double s = sin(w * ratio * n), c = cos(w * ratio * n);
+            ss += s * s; cc += c * c; sc += s * c;
+            ys += y * s; yc += y * c; yy += y * y;
+        }
+    }
+    double det = ss * cc - sc * sc;
+    double a = (ys * cc - yc * sc) / det, b = (yc * ss - ys * sc) / det;
+    double fit = a * ys + b * yc;
+    double snr = 10 * log10(fit / (yy - fit));
+    bool ok = snr > 80;
+    failures += !ok;
+    printf("resampler 1 kHz tone at %+.0f ppm: SNR %.1f dB, %.0f ns per %d frames stereo period %s\n",
+           (ratio - 1) * 1e6, snr, (double) process_ns / periods, RS_PERIOD, ok ? "ok" : "FAIL");
+
+    const double drifts[] = { 0, 50, -50, 300, -300 };
+    for (uint32_t i = 0; i < sizeof(drifts) / sizeof(drifts[0]); i++)
+    {
+        failures += rs_drift(false, drifts[i]);
+        failures += rs_drift(true, drifts[i]);
+    }
+
+    printf("resampler check: %s\n", failures ? "FAIL" : "ok");
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+// a -6 dBFS tone (1125 Hz above the dial, centered on a bin for every block size) in noise
+// through the rx dsp with the spectrum on: level and frequency of the peak,
+// and the cost of spectrum_tap() in the dsp thread
+#define SPECTRUM_TONE_HZ 1125.0
+#define SPECTRUM_TONE_DBFS -6.02
+
+static int run_spectrum_check(struct bench_options *opt)
+{
+    radio radio_h;
+    pthread_t spectrum_tid;
+    int failures = 0;
+
+    if (shm_is_created(SYSV_SHM_SPECTRUM_KEY, sizeof(spectrum_page)))
+    {
+        fprintf(stderr, "The spectrum SHM exists, is sbitx_controller running? Not touching it.\n");
+        return EXIT_FAILURE;
+    }
+
+    init_radio(&radio_h, &scenarios[0], opt);
+    radio_h.spectrum_fps = 10;
+    radio_h.spectrum_bins = 512;
+
+    spectrum_init(&radio_h, &spectrum_tid);
+    if (!spectrum_shm)
+        return EXIT_FAILURE;
+    dsp_init(&radio_h);
+
+    uint32_t block_bytes = opt->block_size * sizeof(int32_t);
+    int32_t *block_in = malloc(block_bytes);
+    int32_t *out = malloc(3 * block_bytes);
+    uint32_t seed = 0x5bec;
+    uint64_t n = 0;
+
+    // 2 s of signal
+    uint32_t blocks = 2 * BENCH_RATE / opt->block_size;
+    for (uint32_t b = 0; b < blocks; b++)
+    {
+        for (uint32_t i = 0; i < opt->block_size; i++, n++)
+        {
+            double t = (double) n / BENCH_RATE;
+            block_in[i] = to_s32(0.5 * sin(2 * M_PI * (24000.0 + SPECTRUM_TONE_HZ) * t) + 0.001 * noise(&seed));
+        }
+        dsp_process_rx((uint8_t *) block_in, (uint8_t *) out, (uint8_t *) (out + opt->block_size), (uint8_t *) (out + 2 * opt->block_size), opt->block_size);
+    }
+    // let the spectrum thread publish the last frame
+    usleep(100000);
+
+    spectrum_page page;
+    spectrum_read(spectrum_shm, &page);
+
+    uint32_t peak = 0;
+    float floor_db = 0;
+    for (uint32_t j = 0; j < page.n_bins; j++)
+    {
+        if (page.db[j] > page.db[peak])
+            peak = j;
+        floor_db += page.db[j] / page.n_bins;
+    }
+    double peak_hz = page.first_hz + peak * page.bin_hz;
+
+    // the bins are capped at the n_fft / 2 of the smaller blocks
+    uint32_t n_bins = (opt->block_size < radio_h.spectrum_bins) ? opt->block_size : radio_h.spectrum_bins;
+    bool ok = page.n_bins == n_bins && page.frame >= 15 && fabs(peak_hz - SPECTRUM_TONE_HZ) <= page.bin_hz / 2 &&
+        fabs(page.db[peak] - SPECTRUM_TONE_DBFS) < 0.5;
+    failures += !ok;
+    printf("spectrum: %u frames of %u bins, %.2f Hz each from %+.1f Hz, tone at %+.1f Hz %.2f dBFS (mean %.1f dBFS) %s\n",
+           page.frame, page.n_bins, page.bin_hz, page.first_hz, peak_hz, page.db[peak], floor_db, ok ? "ok" : "FAIL");
+
+    uint8_t frame[SPECTRUM_WS_HEADER + SPECTRUM_MAX_BINS];
+    uint32_t len = spectrum_ws_frame(&page, frame);
+    double ws_db = SPECTRUM_WS_DB_MIN + frame[SPECTRUM_WS_HEADER + peak] * SPECTRUM_WS_DB_STEP;
+    ok = len == SPECTRUM_WS_HEADER + page.n_bins && fabs(ws_db - page.db[peak]) <= SPECTRUM_WS_DB_STEP / 2;
+    failures += !ok;
+    printf("spectrum: websocket frame %u bytes, tone %.2f dBFS %s\n", len, ws_db, ok ? "ok" : "FAIL");
+
+    // the tap alone, on the spectrum of a block
+    uint32_t n_fft = 2 * opt->block_size;
+    dsp_complex *fft_out = DSP_FFTW(alloc_complex)(n_fft / 2 + 1);
+    for (uint32_t i = 0; i <= n_fft / 2; i++)
+        fft_out[i] = noise(&seed) + I * noise(&seed);
+    const uint32_t iterations = 20000;
+    uint64_t start = now_ns();
+    for (uint32_t i = 0; i < iterations; i++)
+        spectrum_tap(fft_out, n_fft);
+    double tap_ns = (double) (now_ns() - start) / iterations;
+    printf("spectrum: spectrum_tap() %.0f ns per %u samples block, %.3f%% of the block time\n",
+           tap_ns, opt->block_size, 100.0 * tap_ns / (1e9 * opt->block_size / BENCH_RATE));
+
+    DSP_FFTW(free)(fft_out);
+    spectrum_shutdown(&spectrum_tid);
+    shm_dettach(SYSV_SHM_SPECTRUM_KEY, sizeof(spectrum_page), spectrum_shm);
+    shm_destroy(SYSV_SHM_SPECTRUM_KEY, sizeof(spectrum_page));
+    free(block_in);
+    free(out);
+    dsp_free(&radio_h);
+
+    printf("spectrum check: %s\n", failures ? "FAIL" : "ok");
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+// two tones (700 and 1900 Hz in USB), keyed 0.5 s on and 0.5 s off, in white
+// noise, through the rx dsp with the denoise off and on: the output SNR (least
+// squares fit of the keyed tones, the residual is noise and distortion, away
+// from the key transitions) and the dsp time per block
+#define DENOISE_SECONDS 8
+#define DENOISE_SETTLE 2 // seconds not measured, the noise floor starts from scratch
+#define DENOISE_GUARD 0.03 // seconds not measured around each transition
+
+static double denoise_run(struct bench_options *opt, radio *radio_h, bool denoise, double *mean_ns)
+{
+    static const double tone_hz[2] = { 700, 1900 };
+
+    // each run from a clean rx chain
+    radio_h->profiles[0].denoise = denoise;
+    rx_starting = true;
+
+    uint32_t block_bytes = opt->block_size * sizeof(int32_t);
+    int32_t *block_in = malloc(block_bytes);
+    int32_t *out = malloc(3 * block_bytes);
+    uint32_t blocks = DENOISE_SECONDS * BENCH_RATE / opt->block_size;
+    uint32_t latency = dsp_latency(false);
+    uint32_t seed = 0xde401;
+    uint64_t n = 0, total_ns = 0;
+
+    // normal equations of the 4 regressors (sin and cos of each keyed tone)
+    double ata[4][4] = { { 0 } }, aty[4] = { 0 }, yy = 0;
+
+    for (uint32_t b = 0; b < blocks; b++)
+    {
+        for (uint32_t i = 0; i < opt->block_size; i++)
+        {
+            double t = (double) (n + i) / BENCH_RATE;
+            double key = (fmod(t, 1.0) < 0.5) ? 1 : 0;
+            double x = 0.01 * noise(&seed);
+            for (int k = 0; k < 2; k++)
+                x += key * 0.002 * sin(2 * M_PI * (24000.0 + tone_hz[k]) * t);
+            block_in[i] = to_s32(x);
+        }
+
+        uint64_t start = now_ns();
+        dsp_process_rx((uint8_t *) block_in, (uint8_t *) out, (uint8_t *) (out + opt->block_size), (uint8_t *) (out + 2 * opt->block_size), opt->block_size);
+        total_ns += now_ns() - start;
+
+        // the loopback is the 48 kHz output of the inverse fft, no interpolation
+        for (uint32_t i = 0; i < opt->block_size; i += 2)
+        {
+            double t = ((double) (n + i) - latency) / BENCH_RATE;
+            double phase = fmod(t, 0.5);
+            if (t < DENOISE_SETTLE || phase < DENOISE_GUARD || phase > 0.5 - DENOISE_GUARD)
+                continue;
+
+            double key = (fmod(t, 1.0) < 0.5) ? 1 : 0;
+            double a[4], y = out[opt->block_size + i] / 2147483648.0;
+            double tt = (double) (n + i) / BENCH_RATE;
+            for (int k = 0; k < 2; k++)
+            {
+                a[2 * k] = key * sin(2 * M_PI * tone_hz[k] * tt);
+                a[2 * k + 1] = key * cos(2 * M_PI * tone_hz[k] * tt);
+            }
+            for (int r = 0; r < 4; r++)
+            {
+                for (int c = 0; c < 4; c++)
+                    ata[r][c] += a[r] * a[c];
+                aty[r] += a[r] * y;
+            }
+            yy += y * y;
+        }
+        n += opt->block_size;
+    }
+
+    // gaussian elimination, the system is well conditioned
+    double x[4];
+    for (int r = 0; r < 4; r++)
+        for (int r2 = r + 1; r2 < 4; r2++)
+        {
+            double f = ata[r2][r] / ata[r][r];
+            for (int c = r; c < 4; c++)
+                ata[r2][c] -= f * ata[r][c];
+            aty[r2] -= f * aty[r];
+        }
+    for (int r = 3; r >= 0; r--)
+    {
+        x[r] = aty[r];
+        for (int c = r + 1; c < 4; c++)
+            x[r] -= ata[r][c] * x[c];
+        x[r] /= ata[r][r];
+    }
+    double fit = 0;
+    for (int r = 0; r < 4; r++)
+        fit += x[r] * aty[r];
+
+    *mean_ns = (double) total_ns / blocks;
+
+    free(block_in);
+    free(out);
+
+    return 10 * log10(fit / (yy - fit));
+}
+
+static int run_denoise_check(struct bench_options *opt)
+{
+    radio radio_h;
+    double off_ns, on_ns;
+
+    init_radio(&radio_h, &scenarios[0], opt);
+    dsp_init(&radio_h);
+    double snr_off = denoise_run(opt, &radio_h, false, &off_ns);
+    double snr_on = denoise_run(opt, &radio_h, true, &on_ns);
+    dsp_free(&radio_h);
+    double budget_ns = 1e9 * opt->block_size / BENCH_RATE;
+
+    bool ok = snr_on - snr_off > 6;
+    printf("denoise: output SNR %.1f dB off, %.1f dB on, %+.1f dB %s\n", snr_off, snr_on, snr_on - snr_off, ok ? "ok" : "FAIL");
+    printf("denoise: rx dsp %.0f ns off, %.0f ns on per %u samples block, the denoise is %.2f%% of the block time\n",
+           off_ns, on_ns, opt->block_size, 100.0 * (on_ns - off_ns) / budget_ns);
+
+    printf("denoise check: %s\n", ok ? "ok" : "FAIL");
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// a 1 kHz tone at -34 dBFS, 30 dB up for 2 s, then back, through the agc of
+// each preset: the highest output peak, the time the output takes to come
+// down to the reference (+3 dB) after the step up and back up to it (-3 dB)
+// after the step down, and the agc time per block
+#define AGC_STEP_LOW 0.02
+#define AGC_STEP_HIGH 0.63
+#define AGC_STEP_START 2.0 // seconds
+#define AGC_STEP_END 4.0
+#define AGC_STEP_SECONDS 8.0
+
+static int run_agc_check(struct bench_options *opt)
+{
+    static const char *names[] = { "OFF", "SLOW", "MEDIUM", "FAST" };
+    uint32_t n = opt->block_size;
+    uint32_t blocks = (uint32_t) (AGC_STEP_SECONDS * BENCH_RATE / n);
+    dsp_real *block = malloc(sizeof(dsp_real) * n);
+    double budget_ns = 1e9 * n / BENCH_RATE;
+    double recovery_last = AGC_STEP_SECONDS;
+    int failures = 0;
+
+    for (uint16_t p = AGC_SLOW; p <= AGC_FAST; p++)
+    {
+        struct agc agc;
+        agc_init(&agc);
+
+        double peak_max = 0, attack = -1, recovery = -1;
+        uint64_t total_ns = 0;
+
+        for (uint32_t b = 0; b < blocks; b++)
+        {
+            for (uint32_t i = 0; i < n; i++)
+            {
+                double t = (double) (b * n + i) / BENCH_RATE;
+                double a = (t >= AGC_STEP_START && t < AGC_STEP_END) ? AGC_STEP_HIGH : AGC_STEP_LOW;
+                block[i] = a * sin(2 * M_PI * 1000 * t);
+            }
+
+            uint64_t t0 = now_ns();
+            agc_process(&agc, block, n, p);
+            total_ns += now_ns() - t0;
+
+            for (uint32_t c = 0; c < n; c += AGC_CHUNK)
+            {
+                double t = (double) (b * n + c) / BENCH_RATE;
+                double peak = 0;
+                for (uint32_t i = c; i < c + AGC_CHUNK; i++)
+                    peak = fmax(peak, fabs(block[i]));
+
+                if (t > 1.0 && peak > peak_max)
+                    peak_max = peak;
+                if (t >= AGC_STEP_START && t < AGC_STEP_END && attack < 0 && peak < AGC_REFERENCE * M_SQRT2)
+                    attack = t - AGC_STEP_START;
+                if (t >= AGC_STEP_END && recovery < 0 && peak > AGC_REFERENCE / M_SQRT2)
+                    recovery = t - AGC_STEP_END;
+            }
+        }
+
+        // the clip level is never crossed, the attack is in a few ms, and each
+        // preset recovers faster than the previous one
+        bool ok = peak_max <= AGC_CLIP && attack >= 0 && attack < 0.02 && recovery > 0 && recovery < recovery_last;
+        recovery_last = recovery;
+        failures += !ok;
+
+        printf("agc %-6s  peak %5.1f dBFS  attack %5.1f ms  recovery %6.1f ms  %6.0f ns per %u samples block (%.3f%%)  %s\n",
+               names[p], 20 * log10(peak_max), attack * 1e3, recovery * 1e3,
+               (double) total_ns / blocks, n, 100.0 * total_ns / blocks / budget_ns, ok ? "ok" : "FAIL");
+    }
+
+    free(block);
+    printf("agc check: %s\n", failures ? "FAIL" : "ok");
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+// speech like mic input (five voice band tones, 4 syllables per second, the
+// level swinging 16 dB every 3 s) through the tx dsp in USB, with the
+// compressor off and on, and the tx tone: the mean and peak output power, the
+// worst splatter bin (Welch, outside the passband plus COMP_GUARD_HZ) against
+// the mean passband bin, and the tx dsp time per block
+#define COMP_SECONDS 7
+#define COMP_SETTLE 1 // seconds not measured
+#define COMP_GUARD_HZ 300
+#define COMP_FFT 8192
+#define COMP_SPLATTER_MAX_DB -50
+
+struct comp_result {
+    double mean_db; // output power, dB
+    double peak_db; // output peak power, dB
+    double splatter_db; // worst bin off the channel, dB from the mean passband bin
+    double mean_ns;
+};
+
+static void compressor_run(struct bench_options *opt, radio *radio_h, bool on, bool tone, struct comp_result *r)
+{
+    static const double tone_hz[5] = { 430, 810, 1270, 1730, 2390 };
+
+    // each run from a clean tx chain
+    radio_h->profiles[0].compressor = on ? COMPRESSOR_ON : COMPRESSOR_OFF;
+    radio_h->tone_generation = tone;
+    tx_starting = true;
+
+    uint32_t block_bytes = opt->block_size * sizeof(int32_t);
+    int32_t *block_in = malloc(block_bytes);
+    int32_t *out = malloc(3 * block_bytes);
+    uint32_t blocks = COMP_SECONDS * BENCH_RATE / opt->block_size;
+    uint32_t settle = COMP_SETTLE * BENCH_RATE;
+    double *y = malloc(sizeof(double) * blocks * opt->block_size);
+    uint32_t seed = 0xc0de, n_y = 0;
+    uint64_t n = 0, total_ns = 0;
+
+    for (uint32_t b = 0; b < blocks; b++)
+    {
+        for (uint32_t i = 0; i < opt->block_size; i++)
+        {
+            double t = (double) (n + i) / BENCH_RATE;
+            double level = pow(10.0, (-20 + 8 * sin(2 * M_PI * t / 3)) / 20) * COMPRESSOR_CLIP / sqrt(2.5);
+            double syllable = sin(M_PI * 4 * t);
+            double x = 0.0005 * COMPRESSOR_CLIP * noise(&seed);
+            for (int k = 0; k < 5; k++)
+                x += level * syllable * syllable * sin(2 * M_PI * tone_hz[k] * t + k);
+            block_in[i] = to_s32(x);
+        }
+
+        uint64_t start = now_ns();
+        dsp_process_tx((uint8_t *) block_in, (uint8_t *) out, (uint8_t *) (out + opt->block_size), (uint8_t *) (out + 2 * opt->block_size), opt->block_size, false);
+        total_ns += now_ns() - start;
+
+        for (uint32_t i = 0; i < opt->block_size; i++)
+            if (n + i >= settle)
+                y[n_y++] = out[2 * opt->block_size + i] / 2147483648.0;
+        n += opt->block_size;
+    }
+
+    double sum = 0, peak = 0;
+    for (uint32_t i = 0; i < n_y; i++)
+    {
+        sum += y[i] * y[i];
+        peak = fmax(peak, y[i] * y[i]);
+    }
+
+    // Welch, hann window, half overlap
+    double *seg = fftw_alloc_real(COMP_FFT);
+    fftw_complex *spec = fftw_alloc_complex(COMP_FFT / 2 + 1);
+    fftw_plan plan = fftw_plan_dft_r2c_1d(COMP_FFT, seg, spec, FFTW_ESTIMATE);
+    double *psd = calloc(COMP_FFT / 2 + 1, sizeof(double));
+    for (uint32_t start = 0; start + COMP_FFT <= n_y; start += COMP_FFT / 2)
+    {
+        for (uint32_t i = 0; i < COMP_FFT; i++)
+            seg[i] = y[start + i] * (0.5 - 0.5 * cos(2 * M_PI * i / COMP_FFT));
+        fftw_execute(plan);
+        for (uint32_t k = 0; k <= COMP_FFT / 2; k++)
+            psd[k] += creal(spec[k]) * creal(spec[k]) + cimag(spec[k]) * cimag(spec[k]);
+    }
+
+    // USB: the passband is bpf_low to bpf_high above 24 kHz
+    double bin_hz = (double) BENCH_RATE / COMP_FFT;
+    double low = 24000.0 + radio_h->profiles[0].bpf_low, high = 24000.0 + radio_h->profiles[0].bpf_high;
+    double in_band = 0, worst = 0;
+    uint32_t in_bins = 0;
+    for (uint32_t k = 1; k < COMP_FFT / 2; k++)
+    {
+        double f = k * bin_hz;
+        if (f >= low && f <= high)
+        {
+            in_band += psd[k];
+            in_bins++;
+        }
+        else if (f < low - COMP_GUARD_HZ || f > high + COMP_GUARD_HZ)
+            worst = fmax(worst, psd[k]);
+    }
+
+    r->mean_db = 10 * log10(sum / n_y);
+    r->peak_db = 10 * log10(peak);
+    r->splatter_db = 10 * log10(worst / (in_band / in_bins) + 1e-30);
+    r->mean_ns = (double) total_ns / blocks;
+
+    fftw_destroy_plan(plan);
+    fftw_free(seg);
+    fftw_free(spec);
+    free(psd);
+    free(y);
+    free(block_in);
+    free(out);
+}
+
+static int run_compressor_check(struct bench_options *opt)
+{
+    radio radio_h;
+    struct comp_result off, on, tone;
+
+    init_radio(&radio_h, &scenarios[4], opt);
+    dsp_init(&radio_h);
+    compressor_run(opt, &radio_h, false, false, &off);
+    compressor_run(opt, &radio_h, true, false, &on);
+    compressor_run(opt, &radio_h, false, true, &tone);
+    dsp_free(&radio_h);
+    double budget_ns = 1e9 * opt->block_size / BENCH_RATE;
+
+    printf("compressor off: mean %6.1f dB  peak %6.1f dB  PAPR %4.1f dB  splatter %6.1f dB\n", off.mean_db, off.peak_db, off.peak_db - off.mean_db, off.splatter_db);
+    printf("compressor on:  mean %6.1f dB  peak %6.1f dB  PAPR %4.1f dB  splatter %6.1f dB\n", on.mean_db, on.peak_db, on.peak_db - on.mean_db, on.splatter_db);
+    printf("tx tone:        mean %6.1f dB  peak %6.1f dB\n", tone.mean_db, tone.peak_db);
+
+    // more talk power for the same peak, the peaks up to the tone, and the
+    // clipping products kept off the channel
+    double talk_db = (off.peak_db - off.mean_db) - (on.peak_db - on.mean_db);
+    bool ok = talk_db > 3 && on.peak_db - tone.peak_db < 0.5 && on.splatter_db < COMP_SPLATTER_MAX_DB;
+    printf("compressor: %+.1f dB of talk power at the same peak, peak %+.1f dB from the tone, splatter %.1f dB %s\n",
+           talk_db, on.peak_db - tone.peak_db, on.splatter_db, ok ? "ok" : "FAIL");
+    printf("compressor: tx dsp %.0f ns off, %.0f ns on per %u samples block, the compressor is %.2f%% of the block time\n",
+           off.mean_ns, on.mean_ns, opt->block_size, 100.0 * (on.mean_ns - off.mean_ns) / budget_ns);
+
+    printf("compressor check: %s\n", ok ? "ok" : "FAIL");
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// cw: the key edges of CW_TEXT at CW_WPM (PARIS timing), from t0 seconds,
+// down and up alternately
+#define CW_TEXT "CQ CQ DE SBITX 73"
+#define CW_WPM 20
+#define CW_MAX_EDGES 512
+
+static uint32_t cw_keying(const char *text, double wpm, double t0, double *edges)
+{
+    static const char *letters[26] = {
+        ".-", "-...", "-.-.", "-..", ".", "..-.", "--.", "....", "..", ".---", "-.-", ".-..", "--",
+        "-.", "---", ".--.", "--.-", ".-.", "...", "-", "..-", "...-", ".--", "-..-", "-.--", "--.."
+    };
+    static const char *digits[10] = {
+        "-----", ".----", "..---", "...--", "....-", ".....", "-....", "--...", "---..", "----."
+    };
+    double dit = 1.2 / wpm, t = t0;
+    uint32_t n = 0;
+
+    for (const char *c = text; *c; c++)
+    {
+        if (*c == ' ')
+        {
+            t += 4 * dit; // 3 more after the character gap
+            continue;
+        }
+        const char *code = (*c >= '0' && *c <= '9') ? digits[*c - '0'] : letters[*c - 'A'];
+        for (const char *e = code; *e; e++)
+        {
+            edges[n++] = t;
+            t += (*e == '-') ? 3 * dit : dit;
+            edges[n++] = t;
+            t += dit;
+        }
+        t += 2 * dit;
+    }
+
+    return n;
+}
+
+// keyer: the edges of CW_TEXT stamped by the gpio poll (0 to CW_GPIO_POLL_US
+// late), the blocks rendered on a virtual clock with 0 to CW_CALL_JITTER_MS
+// of scheduling jitter each, the first one CW_BREAK_IN_MS after the first
+// edge (io tick and t/r switch). The pitch gives a 128 samples period, so
+// the envelope is the output demodulated by the keyer oscillator and averaged
+// twice over a period (flat on the ramps whatever the phase of the tone), and
+// the edges are its 50 % crossings: their latency from the true key edges (the
+// output sample 0 leaving at the first call) and its spread
+#define CW_BENCH_PITCH 750
+#define CW_CALL_JITTER_MS 3.0
+#define CW_BREAK_IN_MS 15.0
+
+static bool cw_keyer_check(struct bench_options *opt)
+{
+    uint32_t n = opt->block_size;
+    double edges[CW_MAX_EDGES];
+    uint32_t n_edges = cw_keying(CW_TEXT, CW_WPM, 0, edges);
+    double seconds = edges[n_edges - 1] + 0.5;
+    uint32_t blocks = (uint32_t) (seconds * BENCH_RATE / n) + 1;
+    dsp_real *out = malloc(sizeof(dsp_real) * blocks * n);
+    uint32_t seed = 0xc3, next = 0;
+    uint64_t total_ns = 0;
+
+    struct cw_tx k;
+    cw_tx_init(&k, CW_BENCH_PITCH);
+
+    // the stamps as the gpio thread takes them, in ns from an arbitrary origin
+    const uint64_t base_ns = 1000000000;
+    uint64_t stamps[CW_MAX_EDGES];
+    for (uint32_t e = 0; e < n_edges; e++)
+        stamps[e] = base_ns + (uint64_t) ((edges[e] + (noise(&seed) + 1) / 2 * CW_GPIO_POLL_US * 1e-6) * 1e9);
+
+    uint64_t first_call = base_ns + (uint64_t) (CW_BREAK_IN_MS * 1e6);
+    for (uint32_t b = 0; b < blocks; b++)
+    {
+        uint64_t call_ns = first_call + (uint64_t) ((b * (double) n / BENCH_RATE + (noise(&seed) + 1) / 2 * CW_CALL_JITTER_MS * 1e-3) * 1e9);
+        while (next < n_edges && stamps[next] <= call_ns)
+        {
+            cw_key_event(!(next & 1), stamps[next]);
+            next++;
+        }
+
+        uint64_t start = now_ns();
+        cw_tx_process(&k, out + b * n, n, call_ns);
+        total_ns += now_ns() - start;
+    }
+
+    // 50 % crossings of the envelope, delayed by a period, which the first
+    // two periods fill
+    const uint32_t period = BENCH_RATE / CW_BENCH_PITCH;
+    const double half = 0.5 * CW_LEVEL;
+    double *demod = malloc(sizeof(double) * blocks * n);
+    double *box = malloc(sizeof(double) * blocks * n);
+    double lat_min[2] = { 1e9, 1e9 }, lat_max[2] = { -1e9, -1e9 }, lat_sum = 0;
+    double env_last = 0, sum = 0, sum2 = 0;
+    uint32_t found = 0;
+    bool count_ok = true;
+    for (uint32_t i = 0; i < blocks * n; i++)
+    {
+        demod[i] = 2 * out[i] * sin(2 * M_PI * CW_BENCH_PITCH * i / BENCH_RATE);
+        sum += demod[i] - ((i >= period) ? demod[i - period] : 0);
+        box[i] = sum / period;
+        sum2 += box[i] - ((i >= period) ? box[i - period] : 0);
+        double env = sum2 / period;
+        bool up = env_last < half && env >= half, down = env_last >= half && env < half;
+        if ((up || down) && i >= 2 * period)
+        {
+            if (found >= n_edges || up != !(found & 1))
+            {
+                count_ok = false;
+                break;
+            }
+            double t = (i - 1 + (half - env_last) / (env - env_last) - (period - 1)) / BENCH_RATE;
+            double lat = (first_call - base_ns) * 1e-9 + t - edges[found];
+            lat_min[!up] = fmin(lat_min[!up], lat);
+            lat_max[!up] = fmax(lat_max[!up], lat);
+            lat_sum += lat;
+            found++;
+        }
+        env_last = env;
+    }
+    count_ok = count_ok && found == n_edges;
+
+    double jitter = fmax(lat_max[0] - lat_min[0], lat_max[1] - lat_min[1]);
+    bool ok = count_ok && k.late == 0 && jitter < 1e-3;
+    double budget_ns = 1e9 * n / BENCH_RATE;
+
+    printf("cw keyer: %u of %u edges, %u late, latency %.2f ms (mid ramp, break-in of %.0f ms), jitter %.0f us key down, %.0f us key up  %s\n",
+           found, n_edges, k.late, 1e3 * lat_sum / (found ? found : 1), CW_BREAK_IN_MS,
+           1e6 * (lat_max[0] - lat_min[0]), 1e6 * (lat_max[1] - lat_min[1]), ok ? "ok" : "FAIL");
+    printf("cw keyer: %.0f ns per %u samples block (%.3f%%)\n", (double) total_ns / blocks, n, 100.0 * total_ns / blocks / budget_ns);
+
+    free(demod);
+    free(box);
+    free(out);
+    return ok;
+}
+
+// decoder: CW_TEXT keyed (raised cosine edges) at the pitch above the 24 kHz
+// carrier, plus wideband noise, through the rx dsp in cw mode, and the text
+// of the websocket
+static bool cw_decoder_check(struct bench_options *opt)
+{
+    radio radio_h;
+    uint32_t n = opt->block_size;
+    double edges[CW_MAX_EDGES];
+    uint32_t n_edges = cw_keying(CW_TEXT, CW_WPM, 1.0, edges);
+    uint32_t blocks = (uint32_t) ((edges[n_edges - 1] + 1.0) * BENCH_RATE / n);
+    int32_t *block_in = malloc(n * sizeof(int32_t));
+    int32_t *out = malloc(3 * n * sizeof(int32_t));
+    dsp_real *audio = malloc(sizeof(dsp_real) * blocks * n);
+    uint32_t seed = 0xc0ffee, e = 0;
+    uint64_t total_ns = 0, decoder_ns = 0;
+    double rise = CW_RISE_MS * 1e-3;
+
+    init_radio(&radio_h, &scenarios[0], opt);
+    radio_h.profiles[0].mode = MODE_CW;
+    dsp_init(&radio_h);
+
+    for (uint32_t b = 0; b < blocks; b++)
+    {
+        for (uint32_t i = 0; i < n; i++)
+        {
+            double t = (double) (b * n + i) / BENCH_RATE;
+            while (e + 2 < n_edges && t >= edges[e + 1])
+                e += 2;
+            double on = fmin(fmax((t - edges[e]) / rise, 0), 1) - fmin(fmax((t - edges[e + 1]) / rise, 0), 1);
+            double key = 0.5 - 0.5 * cos(M_PI * on);
+            double x = 0.004 * key * sin(2 * M_PI * (24000.0 + radio_h.cw_pitch) * t) + 0.01 * noise(&seed);
+            block_in[i] = to_s32(x);
+        }
+
+        uint64_t start = now_ns();
+        dsp_process_rx((uint8_t *) block_in, (uint8_t *) out, (uint8_t *) (out + n), (uint8_t *) (out + 2 * n), n);
+        total_ns += now_ns() - start;
+
+        for (uint32_t i = 0; i < n; i++)
+            audio[b * n + i] = out[i] / 2147483648.0;
+    }
+    dsp_free(&radio_h);
+
+    char text[CW_TEXT_SIZE];
+    cw_text_read(text, sizeof(text));
+    uint32_t wpm = cw_rx_wpm;
+
+    // the decoder alone, over the speaker audio, its text is dropped
+    struct cw_rx d;
+    cw_rx_init(&d, radio_h.cw_pitch);
+    for (uint32_t b = 0; b < blocks; b++)
+    {
+        uint64_t start = now_ns();
+        cw_rx_process(&d, audio + b * n, n);
+        decoder_ns += now_ns() - start;
+    }
+    char dropped[CW_TEXT_SIZE];
+    cw_text_read(dropped, sizeof(dropped));
+    uint32_t len = strlen(text);
+    while (len && text[len - 1] == ' ')
+        text[--len] = 0;
+
+    bool ok = !strcmp(text, CW_TEXT) && abs((int) wpm - CW_WPM) <= 1;
+    double budget_ns = 1e9 * n / BENCH_RATE;
+
+    printf("cw decoder: \"%s\" at %u wpm  %s\n", text, wpm, ok ? "ok" : "FAIL");
+    printf("cw decoder: rx dsp %.0f ns per %u samples block, the decoder %.0f ns (%.3f%%)\n",
+           (double) total_ns / blocks, n, (double) decoder_ns / blocks, 100.0 * decoder_ns / blocks / budget_ns);
+
+    free(block_in);
+    free(out);
+    free(audio);
+    return ok;
+}
+
+static int run_cw_check(struct bench_options *opt)
+{
+    bool ok = cw_keyer_check(opt);
+    ok = cw_decoder_check(opt) && ok;
+
+    printf("cw check: %s\n", ok ? "ok" : "FAIL");
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// nco: the 1 kHz tone and the two-tone of the tx against a double precision
+// reference at the exact frequency of their phase steps (the error to the
+// tone), their worst spur (the highest bin of the error spectrum against the
+// tone bin, as the window leakage of the tone itself hides anything below
+// -92 dBc with a Blackman-Harris window), the peak of
+// the two-tone against the single one, and the fill time per block against
+// the previous per sample oscillator (a 16 bit phase, a quarter wave table
+// and a 1.46 Hz frequency step)
+#define NCO_SECONDS 10
+#define NCO_FFT 65536
+#define NCO_MAX_ERROR_DB -100
+#define NCO_MAX_SPUR_DB -100
+
+static int16_t lut_sin[16385];
+
+static void lut_fill(uint32_t *phase, uint32_t increment, dsp_real *out, uint32_t n)
+{
+    for (uint32_t i = 0; i < n; i++)
+    {
+        uint32_t p = *phase;
+        int32_t v;
+        if (p < 16384)
+            v = lut_sin[p];
+        else if (p < 32768)
+            v = lut_sin[32767 - p];
+        else if (p < 49152)
+            v = -lut_sin[p - 32768];
+        else
+            v = -lut_sin[65535 - p];
+        out[i] = (dsp_real) (v * (NCO_TONE_LEVEL / 32767.0));
+        *phase = (p + increment) & 0xffff;
+    }
+}
+
+struct nco_result {
+    double error_db; // worst error against the reference, dB from the tone peak
+    double spur_db; // worst spur, dBc
+    double peak; // highest sample
+    double ns; // per block
+};
+
+static void nco_measure(struct bench_options *opt, struct nco *o, struct nco_result *r)
+{
+    uint32_t n = opt->block_size;
+    uint32_t blocks = NCO_SECONDS * BENCH_RATE / n;
+    double *y = malloc(sizeof(double) * blocks * n);
+    double *ref = malloc(sizeof(double) * blocks * n);
+    dsp_real *block = malloc(sizeof(dsp_real) * n);
+    double amp = 0, worst = 0;
+    uint64_t total_ns = 0;
+
+    nco_reset(o);
+    for (uint32_t b = 0; b < blocks; b++)
+    {
+        uint64_t start = now_ns();
+        nco_fill(o, block, n);
+        total_ns += now_ns() - start;
+        for (uint32_t i = 0; i < n; i++)
+            y[b * n + i] = block[i];
+    }
+
+    // the exact phase of each sample, modulo 2^32
+    r->peak = 0;
+    for (uint32_t k = 0; k < o->n_tones; k++)
+        amp += o->amp[k];
+    for (uint64_t i = 0; i < (uint64_t) blocks * n; i++)
+    {
+        ref[i] = 0;
+        for (uint32_t k = 0; k < o->n_tones; k++)
+            ref[i] += o->amp[k] * sin(2 * M_PI * (double) ((i * o->step[k]) & 0xffffffff) / 4294967296.0);
+        worst = fmax(worst, fabs(y[i] - ref[i]));
+        r->peak = fmax(r->peak, fabs(y[i]));
+    }
+    r->error_db = 20 * log10(worst / amp + 1e-30);
+
+    // Blackman-Harris spectra of the reference and of the error, over the
+    // last NCO_FFT samples
+    double *seg = fftw_alloc_real(NCO_FFT);
+    fftw_complex *spec = fftw_alloc_complex(NCO_FFT / 2 + 1);
+    fftw_plan plan = fftw_plan_dft_r2c_1d(NCO_FFT, seg, spec, FFTW_ESTIMATE);
+    double peak_bin[2] = {0, 0}; // tone, spur
+    for (int pass = 0; pass < 2; pass++)
+    {
+        uint64_t first = (uint64_t) blocks * n - NCO_FFT;
+        for (uint32_t i = 0; i < NCO_FFT; i++)
+        {
+            double a = 2 * M_PI * i / NCO_FFT;
+            double w = 0.35875 - 0.48829 * cos(a) + 0.14128 * cos(2 * a) - 0.01168 * cos(3 * a);
+            seg[i] = (pass ? y[first + i] - ref[first + i] : ref[first + i]) * w;
+        }
+        fftw_execute(plan);
+        for (uint32_t b = 1; b < NCO_FFT / 2; b++)
+            peak_bin[pass] = fmax(peak_bin[pass], creal(spec[b]) * creal(spec[b]) + cimag(spec[b]) * cimag(spec[b]));
+    }
+    r->spur_db = 10 * log10(peak_bin[1] / peak_bin[0] + 1e-30);
+    r->ns = (double) total_ns / blocks;
+
+    fftw_destroy_plan(plan);
+    fftw_free(seg);
+    fftw_free(spec);
+    free(block);
+    free(ref);
+    free(y);
+}
+
+static int run_nco_check(struct bench_options *opt)
+{
+    struct nco tone, two_tone;
+    struct nco_result one, two;
+    uint32_t n = opt->block_size;
+    double budget_ns = 1e9 * n / BENCH_RATE;
+
+    nco_init(&tone, BENCH_RATE);
+    nco_tone(&tone, 0, 1000, NCO_TONE_LEVEL);
+    nco_init(&two_tone, BENCH_RATE);
+    nco_tone(&two_tone, 0, 700, NCO_TONE_LEVEL / 2);
+    nco_tone(&two_tone, 1, 1900, NCO_TONE_LEVEL / 2);
+
+    nco_measure(opt, &tone, &one);
+    nco_measure(opt, &two_tone, &two);
+
+    // the previous oscillator, for the cost and the frequency
+    for (int i = 0; i < 16385; i++)
+        lut_sin[i] = (int16_t) (sin((M_PI / 2) * i / 16385.0) * 32767);
+    uint32_t lut_phase = 0, lut_increment = (1000 * 65536) / BENCH_RATE;
+    dsp_real *block = malloc(sizeof(dsp_real) * n);
+    uint32_t blocks = NCO_SECONDS * BENCH_RATE / n;
+    uint64_t lut_ns = 0;
+    for (uint32_t b = 0; b < blocks; b++)
+    {
+        uint64_t start = now_ns();
+        lut_fill(&lut_phase, lut_increment, block, n);
+        lut_ns += now_ns() - start;
+    }
+    free(block);
+
+    bool one_ok = one.error_db < NCO_MAX_ERROR_DB && one.spur_db < NCO_MAX_SPUR_DB && fabs(nco_freq(&tone, 0) - 1000) < 1e-3;
+    bool two_ok = two.error_db < NCO_MAX_ERROR_DB && two.spur_db < NCO_MAX_SPUR_DB && fabs(20 * log10(two.peak / one.peak)) < 0.01;
+
+    printf("nco tone:     %.6f Hz (was %.2f Hz)  error %6.1f dB  spur %6.1f dBc  %s\n", nco_freq(&tone, 0),
+           lut_increment * (double) BENCH_RATE / 65536, one.error_db, one.spur_db, one_ok ? "ok" : "FAIL");
+    printf("nco two-tone: %.6f + %.6f Hz  error %6.1f dB  spur %6.1f dBc  peak %+.3f dB from the tone  %s\n",
+           nco_freq(&two_tone, 0), nco_freq(&two_tone, 1), two.error_db, two.spur_db, 20 * log10(two.peak / one.peak), two_ok ? "ok" : "FAIL");
+    printf("nco: %.0f ns one tone, %.0f ns two tones, %.0f ns per sample oscillator, per %u samples block (%.3f%% of the block time)\n",
+           one.ns, two.ns, (double) lut_ns / blocks, n, 100.0 * one.ns / budget_ns);
+
+    bool ok = one_ok && two_ok;
+    printf("nco check: %s\n", ok ? "ok" : "FAIL");
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int main(int argc, char *argv[])
+{
+    struct bench_options opt;
+    memset(&opt, 0, sizeof(opt));
+    opt.blocks = BENCH_DEFAULT_BLOCKS;
+    opt.tolerance = BENCH_DEFAULT_TOLERANCE;
+    opt.rx_decimation = 2; // as in core.ini
+    opt.block_size = 1024; // as in core.ini
+
+    int o;
+    while ((o = getopt(argc, argv, "hn:i:l:r:c:t:s:d:b:mkpawegxyo")) != -1)
+    {
+        switch (o)
+        {
+        case 'n':
+            opt.blocks = atoi(optarg);
+            break;
+        case 'i':
+            opt.input_file = optarg;
+            break;
+        case 'l':
+            opt.loopback_file = optarg;
+            break;
+        case 'r':
+            opt.record_dir = optarg;
+            break;
+        case 'c':
+            opt.check_dir = optarg;
+            break;
+        case 't':
+            opt.tolerance = atof(optarg);
+            break;
+        case 's':
+            opt.only = optarg;
+            break;
+        case 'd':
+            opt.rx_decimation = atoi(optarg);
+            break;
+        case 'b':
+            opt.block_size = atoi(optarg);
+            break;
+        case 'm':
+            opt.mode_stress = true;
+            break;
+        case 'k':
+            opt.kernel_check = true;
+            break;
+        case 'p':
+            opt.tr_recovery = true;
+            break;
+        case 'a':
+            opt.resampler_check = true;
+            break;
+        case 'w':
+            opt.spectrum_check = true;
+            break;
+        case 'e':
+            opt.denoise_check = true;
+            break;
+        case 'g':
+            opt.agc_check = true;
+            break;
+        case 'x':
+            opt.compressor_check = true;
+            break;
+        case 'y':
+            opt.cw_check = true;
+            break;
+        case 'o':
+            opt.nco_check = true;
+            break;
+        case 'h':
+        default:
+            fprintf(stderr, "Usage: %s [-n blocks] [-i input] [-l loopback_input] [-r golden_dir] [-c golden_dir] [-t dB] [-s scenario] [-d rx_decimation] [-b block_size] [-m] [-k] [-p] [-a] [-w] [-e] [-g] [-x] [-y] [-o]\n", argv[0]);
+            fprintf(stderr, "\nOptions:\n");
+            fprintf(stderr, " -n blocks                  Number of blocks per scenario (default %d)\n", BENCH_DEFAULT_BLOCKS);
+            fprintf(stderr, " -i input                   96 kHz mono WAV or raw S32_LE input for rx and mic scenarios (default: synthetic)\n");
+            fprintf(stderr, " -l loopback_input          48 kHz stereo WAV or raw S32_LE input for loopback scenarios (default: synthetic)\n");
+            fprintf(stderr, " -r golden_dir              Record the outputs as golden vectors in golden_dir\n");
+            fprintf(stderr, " -c golden_dir              Compare the outputs against the golden vectors in golden_dir\n");
+            fprintf(stderr, " -t dB                      Minimum output to error ratio for the comparison (default %.0f dB)\n", BENCH_DEFAULT_TOLERANCE);
+            fprintf(stderr, " -s scenario                Run just this scenario\n");
+            fprintf(stderr, " -d rx_decimation           RX decimation mode, 1 (off), 2, 4 or 8 (default 2)\n");
+            fprintf(stderr, " -b block_size              DSP block size, 256, 512 or 1024 samples (default 1024)\n");
+            fprintf(stderr, " -m                         Mode stress: switch USB/LSB from another thread while streaming, and check for torn blocks\n");
+            fprintf(stderr, " -k                         Check the sample conversion kernels against plain C, and time them\n");
+            fprintf(stderr, " -p                         T/R recovery: time until the rx audio is back after a tx, restarted vs warm rx chain\n");
+            fprintf(stderr, " -a                         Loopback resampler: tone quality and cost, and the ring fill control against a drifting clock\n");
+            fprintf(stderr, " -w                         RX spectrum tap: level and frequency of a tone, and the cost in the rx dsp\n");
+            fprintf(stderr, " -e                         RX noise reduction: SNR gain on keyed tones in noise, and the cost in the rx dsp\n");
+            fprintf(stderr, " -g                         RX AGC: step response of each preset, and the cost per block\n");
+            fprintf(stderr, " -x                         TX compressor: talk power, peak and splatter against the compressor off, and the cost in the tx dsp\n");
+            fprintf(stderr, " -y                         CW: keying latency and jitter of the keyer, text decoded from keyed tones in noise, and the costs\n");
+            fprintf(stderr, " -o                         TX tone oscillator: frequency, error and spurs of the tone and the two-tone, and the cost per block\n");
+            fprintf(stderr, " -h                         Prints this help.\n");
+            fprintf(stderr, "\nScenarios:");
+            for (int i = 0; i < N_SCENARIOS; i++)
+                fprintf(stderr, " %s", scenarios[i].name);
+            fprintf(stderr, "\n");
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (opt.blocks == 0)
+    {
+        fprintf(stderr, "Number of blocks must be > 0\n");
+        return EXIT_FAILURE;
+    }
+
+    if (opt.block_size != 256 && opt.block_size != 512 && opt.block_size != 1024)
+    {
+        fprintf(stderr, "Block size must be 256, 512 or 1024\n");
+        return EXIT_FAILURE;
+    }
+
+    if (opt.kernel_check)
+        return run_kernel_check();
+
+    if (opt.resampler_check)
+        return run_resampler_check();
+
+    if (opt.spectrum_check)
+        return run_spectrum_check(&opt);
+
+    if (opt.denoise_check)
+        return run_denoise_check(&opt);
+
+    if (opt.agc_check)
+        return run_agc_check(&opt);
+
+    if (opt.compressor_check)
+        return run_compressor_check(&opt);
+
+    if (opt.cw_check)
+        return run_cw_check(&opt);
+
+    if (opt.nco_check)
+        return run_nco_check(&opt);
+
+    if (opt.record_dir)
+        mkdir(opt.record_dir, 0755);
+
+    // keep the stdout order sane across the forked scenarios
+    setvbuf(stdout, NULL, _IOLBF, 0);
+
+    int failures = 0;
+    for (int i = 0; i < N_SCENARIOS; i++)
+    {
+        if (opt.only && strcmp(opt.only, scenarios[i].name))
+            continue;
+
+        pid_t pid = fork();
+        if (pid < 0)
+        {
+            perror("fork");
+            return EXIT_FAILURE;
+        }
+        if (pid == 0)
+            exit(run_scenario(&scenarios[i], &opt));
+
+        int status;
+        waitpid(pid, &status, 0);
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS)
+            failures++;
+    }
+
+    if (failures)
+    {
+        printf("%d scenario(s) failed\n", failures);
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
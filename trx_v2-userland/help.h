@@ -110,6 +110,31 @@ const char format_str[] =
 "  * 0 | 1\n"
 "  * Resp: OK | ERROR\n\n"
 
+"* get_agc\n"
+"  * Specify profile\n"
+"  * No Argument\n"
+"  * Resp: OFF | SLOW | MEDIUM | FAST | ERROR\n\n"
+
+"* set_agc\n"
+"  * Specify profile\n"
+"  * OFF | SLOW | MEDIUM | FAST\n"
+"  * Resp: OK | ERROR\n\n"
+
+"* get_compressor\n"
+"  * Specify profile\n"
+"  * No Argument\n"
+"  * Resp: ON | OFF | ERROR\n\n"
+
+"* set_compressor\n"
+"  * Specify profile\n"
+"  * 0 | 1\n"
+"  * Resp: OK | ERROR\n\n"
+
+"* get_signal_level\n"
+"  * Do not specify profile\n"
+"  * No Argument\n"
+"  * Resp: RX audio level before the AGC (dBFS) and AGC gain (dB) | ERROR\n\n"
+
 "* get_serial\n"
 "  * Do not specify profile\n"
 "  * No Argument\n"
@@ -153,11 +178,11 @@ const char format_str[] =
 "* get_tone\n"
 "  * Do not specify profile\n"
 "  * No Argument\n"
-"  * Resp: 0 (disabled) | 1 (enabled) | ERROR\n\n"
+"  * Resp: 0 (disabled) | 1 (1 kHz tone) | 2 (700 + 1900 Hz two-tone) | ERROR\n\n"
 
 "* set_tone\n"
 "  * Do not specify profile\n"
-"  * Set transmit tone (0 to disable, 1 to enable)\n"
+"  * Set transmit tone (0 to disable, 1 for a 1 kHz tone, 2 for the 700 + 1900 Hz two-tone IMD test)\n"
 "  * Resp: OK | ERROR\n\n"
 
 "* reset_protection\n"
@@ -230,6 +255,11 @@ const char format_str[] =
 "  * Transmitted bytes by modem\n"
 "  * Resp: OK | ERROR\n\n"
 
+"* get_xruns\n"
+"  * Do not specify profile\n"
+"  * ALSA device: 0 (radio capture), 1 (radio playback), 2 (loopback capture) or 3 (loopback playback)\n"
+"  * Resp: Overruns or underruns of the device | ERROR\n\n"
+
 "* get_message\n"
 "  * Do not specify profile\n"
 "  * No Argument\n"
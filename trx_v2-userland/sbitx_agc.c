@@ -0,0 +1,139 @@
+/* sBitx controller - rx automatic gain control
+ *
+ * Copyright (C) 2025 Rhizomatica
+ * Author: Rafael Diniz <rafael@riseup.net>
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ *
+ */
+
+#include <math.h>
+
+#include "sbitx_agc.h"
+#include "sbitx_core.h"
+
+// below any signal of the 24 bit codec, keeps the gain finite
+#define AGC_ENV_MIN 1e-7f
+
+// time constants of the presets, in seconds
+static const struct
+{
+    double attack;
+    double hang;
+    double decay;
+} agc_presets[] = {
+    [AGC_OFF]    = { 0.003, 0.25, 0.25 }, // the level meter, as MEDIUM
+    [AGC_SLOW]   = { 0.005, 1.0,  0.5  },
+    [AGC_MEDIUM] = { 0.003, 0.25, 0.25 },
+    [AGC_FAST]   = { 0.002, 0.05, 0.05 },
+};
+
+void agc_init(struct agc *a)
+{
+    double chunk_seconds = AGC_CHUNK / 96000.0;
+
+    for (uint32_t p = AGC_OFF; p <= AGC_FAST; p++)
+    {
+        a->attack[p] = (float) (1 - exp(-chunk_seconds / agc_presets[p].attack));
+        a->decay[p] = (float) (1 - exp(-chunk_seconds / agc_presets[p].decay));
+        a->hang[p] = (uint32_t) lrint(agc_presets[p].hang / chunk_seconds);
+    }
+
+    a->fresh = true;
+    a->env = AGC_ENV_MIN;
+    a->gain = 1;
+    a->hang_count = 0;
+}
+
+void agc_process(struct agc *a, dsp_real *samples, uint32_t n, uint16_t agc)
+{
+    if (agc > AGC_FAST)
+        agc = AGC_MEDIUM;
+
+    const float attack = a->attack[agc], decay = a->decay[agc];
+    float env = a->env, gain = a->gain;
+
+    for (uint32_t c = 0; c < n; c += AGC_CHUNK)
+    {
+        dsp_real *x = samples + c;
+
+        // both loops below are vectorized (-Ofast)
+        dsp_real peak = 0;
+        for (uint32_t i = 0; i < AGC_CHUNK; i++)
+        {
+            dsp_real v = fabs(x[i]);
+            peak = (v > peak) ? v : peak;
+        }
+
+        if (a->fresh)
+        {
+            env = (float) peak;
+            a->hang_count = a->hang[agc];
+        }
+        else if (peak > env)
+        {
+            env += attack * ((float) peak - env);
+            a->hang_count = a->hang[agc];
+        }
+        else if (a->hang_count > 0)
+            a->hang_count--;
+        else
+            env += decay * ((float) peak - env);
+
+        if (env < AGC_ENV_MIN)
+            env = AGC_ENV_MIN;
+
+        if (agc == AGC_OFF)
+        {
+            a->fresh = false;
+            continue;
+        }
+
+        float target = AGC_REFERENCE / env;
+        if (target > AGC_MAX_GAIN)
+            target = AGC_MAX_GAIN;
+        if (peak * target > AGC_CLIP)
+            target = AGC_CLIP / (float) peak;
+
+        if (target <= gain || a->fresh)
+        {
+            const dsp_real g = target;
+            for (uint32_t i = 0; i < AGC_CHUNK; i++)
+                x[i] *= g;
+        }
+        else
+        {
+            const dsp_real g = gain, step = (target - gain) / AGC_CHUNK;
+            for (uint32_t i = 0; i < AGC_CHUNK; i++)
+                x[i] *= g + step * (i + 1);
+        }
+        gain = target;
+        a->fresh = false;
+    }
+
+    a->env = env;
+    a->gain = (agc == AGC_OFF) ? 1 : gain;
+}
+
+float agc_level_db(const struct agc *a)
+{
+    return 20 * log10f(a->env);
+}
+
+float agc_gain_db(const struct agc *a)
+{
+    return 20 * log10f(a->gain);
+}
@@ -0,0 +1,70 @@
+/* sBitx controller - rx automatic gain control
+ *
+ * Copyright (C) 2025 Rhizomatica
+ * Author: Rafael Diniz <rafael@riseup.net>
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ *
+ */
+
+#ifndef SBITX_AGC_H_
+#define SBITX_AGC_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "sbitx_dsp.h"
+
+// Peak envelope AGC over the rx audio, in place, in chunks of AGC_CHUNK
+// samples: the envelope follows the peak of each chunk up with the attack
+// time constant, holds it for the hang time, and then follows it down with
+// the decay time constant (the SLOW, MEDIUM and FAST presets, see
+// sbitx_agc.c). The gain brings the envelope to AGC_REFERENCE, up to
+// AGC_MAX_GAIN, and never takes a chunk above AGC_CLIP. A lower gain applies
+// at once to the whole chunk, a higher one is a linear ramp over the chunk.
+// The envelope also runs with the AGC_OFF, it is the signal level meter.
+
+#define AGC_CHUNK 32 // 1/3 ms, the block sizes are multiples of it
+#define AGC_REFERENCE 0.2f
+#define AGC_MAX_GAIN 20.0f // 26 dB
+#define AGC_CLIP 0.9f
+
+struct agc
+{
+    // per chunk coefficients of each AGC_* preset
+    float attack[4];
+    float decay[4];
+    uint32_t hang[4];
+
+    bool fresh; // the next chunk starts the envelope
+    float env; // peak envelope, full scale is 1.0
+    float gain;
+    uint32_t hang_count; // chunks left of hang
+};
+
+// the first chunk processed sets the envelope, later on the state is kept
+// across the rx restarts (the gain is held during tx)
+void agc_init(struct agc *a);
+
+// n a multiple of AGC_CHUNK, agc: AGC_*, the samples are left untouched
+// with AGC_OFF
+void agc_process(struct agc *a, dsp_real *samples, uint32_t n, uint16_t agc);
+
+// envelope in dBFS (peak), and gain in dB, of the last chunk
+float agc_level_db(const struct agc *a);
+float agc_gain_db(const struct agc *a);
+
+#endif // SBITX_AGC_H_
@@ -19,16 +19,19 @@
  *
  */
 
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <alsa/asoundlib.h>
 #include <pthread.h>
 #include <time.h>
 #include <stdbool.h>
 #include <stdatomic.h>
+#include <semaphore.h>
 
 #include "sbitx_alsa.h"
 #include "sbitx_dsp.h"
 #include "sbitx_buffer.h"
+#include "sbitx_convert.h"
 
 char *radio_capture_dev = "hw:0,0";
 char *radio_playback_dev = "hw:0,0";
@@ -61,6 +64,208 @@ extern _Atomic bool shutdown_;
 // should we allow level control even in IO-ONLY mode?
 #define ALLOW_ALSA_LEVELS_IN_IO_ONLY 1
 
+struct audio_thread_stats audio_thread_stats[AUDIO_THREAD_COUNT] = {
+    [AUDIO_THREAD_RADIO_CAPTURE] = { .name = "radio_capture" },
+    [AUDIO_THREAD_RADIO_PLAYBACK] = { .name = "radio_playback" },
+    [AUDIO_THREAD_LOOP_CAPTURE] = { .name = "loop_capture" },
+    [AUDIO_THREAD_LOOP_PLAYBACK] = { .name = "loop_playback" },
+    [AUDIO_THREAD_DSP_RX] = { .name = "dsp_rx" },
+    [AUDIO_THREAD_DSP_TX] = { .name = "dsp_tx" },
+};
+
+static inline uint64_t clock_ns(clockid_t clock)
+{
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// called by the audio thread at each period (or dsp block), publishes the
+// cpu load of the thread once per second
+static void thread_stats_tick(struct audio_thread_stats *st)
+{
+    uint64_t now = clock_ns(CLOCK_MONOTONIC);
+
+    if (st->window_start_ns == 0)
+    {
+        st->window_start_ns = now;
+        st->window_cpu_ns = clock_ns(CLOCK_THREAD_CPUTIME_ID);
+        return;
+    }
+
+    uint64_t elapsed = now - st->window_start_ns;
+    if (elapsed < 1000000000ULL)
+        return;
+
+    uint64_t cpu = clock_ns(CLOCK_THREAD_CPUTIME_ID);
+    st->cpu_load = (uint32_t) ((cpu - st->window_cpu_ns) * 1000 / elapsed);
+    st->block_max_us = st->window_block_max_us;
+
+    st->window_start_ns = now;
+    st->window_cpu_ns = cpu;
+    st->window_block_max_us = 0;
+}
+
+static inline void thread_stats_block(struct audio_thread_stats *st, uint64_t start_ns)
+{
+    uint32_t us = (uint32_t) ((clock_ns(CLOCK_MONOTONIC) - start_ns) / 1000);
+    if (us > st->window_block_max_us)
+        st->window_block_max_us = us;
+}
+
+struct audio_xrun_stats audio_xrun_stats[AUDIO_DEVICE_COUNT];
+
+struct resampler loop_capture_resampler;
+struct resampler loop_playback_resampler;
+
+// A playback restarts after an underrun with this many periods of silence
+// ahead of the data: one, plus one for each underrun closer than
+// XRUN_BURST_MS to the previous one (up to the buffer minus one period), and
+// back to one after XRUN_CALM_MS without underruns.
+#define XRUN_BURST_MS 2000
+#define XRUN_CALM_MS 60000
+
+// a playback ring with more than RESYNC_BLOCKS dsp blocks queued (after a
+// stall, or a drifting loopback clock without loopback_resampler) is only
+// latency, it is dropped back to one block
+#define RESYNC_BLOCKS 4
+
+static uint64_t realtime_ms()
+{
+    return clock_ns(CLOCK_REALTIME) / 1000000;
+}
+
+// accounts a failed transfer of an alsa device, fill is the number of frames
+// in its ring. Returns the periods of silence to prefill (playback, when
+// max_prefill > 0)
+static uint32_t xrun_account(enum audio_thread_id dev, int e, unsigned long fill, uint32_t max_prefill)
+{
+    struct audio_xrun_stats *x = &audio_xrun_stats[dev];
+    uint32_t prefill = 1;
+
+    if (e != -EPIPE)
+    {
+        x->errors++;
+        return max_prefill ? prefill : 0;
+    }
+
+    uint64_t now = realtime_ms();
+    uint64_t since = now - x->last_xrun_ms;
+
+    if (x->xruns && since < XRUN_BURST_MS)
+        prefill = x->prefill + 1;
+    else if (x->xruns && since < XRUN_CALM_MS)
+        prefill = x->prefill;
+    if (prefill > max_prefill)
+        prefill = max_prefill;
+
+    x->xruns++;
+    x->last_xrun_ms = now;
+    x->last_xrun_fill = fill;
+    x->prefill = prefill;
+
+    return prefill;
+}
+
+// drops the backlog of a playback ring
+static void ring_resync(enum audio_thread_id dev, buffer *ring, unsigned long block_bytes)
+{
+    if (size_buffer(ring) > RESYNC_BLOCKS * block_bytes)
+    {
+        unsigned long dropped = drop_buffer(ring, block_bytes);
+        audio_xrun_stats[dev].resyncs++;
+        fprintf(stderr, "%s: %lu bytes of backlog dropped\n", audio_thread_stats[dev].name, dropped);
+    }
+}
+
+// starts an audio thread with its name, cpu (-1 for any) and SCHED_FIFO
+// priority (0 for SCHED_OTHER)
+static void audio_thread_create(pthread_t *tid, void *(*start_routine)(void *), void *arg,
+                                const char *name, int cpu, int priority)
+{
+    int e;
+
+    if ((e = pthread_create(tid, NULL, start_routine, arg)) != 0)
+    {
+        fprintf(stderr, "Can not create thread %s (%s)\n", name, strerror(e));
+        return;
+    }
+
+    pthread_setname_np(*tid, name);
+
+    if (cpu >= 0)
+    {
+        cpu_set_t mask;
+        CPU_ZERO(&mask);
+        CPU_SET(cpu, &mask);
+        if ((e = pthread_setaffinity_np(*tid, sizeof(mask), &mask)) != 0)
+            fprintf(stderr, "Can not pin thread %s to cpu %d (%s)\n", name, cpu, strerror(e));
+    }
+
+    if (priority > 0)
+    {
+        struct sched_param sch;
+        sch.sched_priority = priority;
+        if ((e = pthread_setschedparam(*tid, SCHED_FIFO, &sch)) != 0)
+            fprintf(stderr, "Can not set SCHED_FIFO priority %d of thread %s (%s)\n", priority, name, strerror(e));
+    }
+}
+
+// Moves one period between the ALSA mmap area of the radio device and the
+// two mono blocks, in place (no readi/writei bounce buffer). The area may
+// wrap, so it can take more than one mmap_begin/commit. Returns 0, or the
+// ALSA error for the caller to recover from.
+static int pcm_mmap_period(snd_pcm_t *handle, int32_t *left, int32_t *right, snd_pcm_uframes_t period, bool capture)
+{
+    snd_pcm_uframes_t done = 0;
+
+    while (done < period)
+    {
+        snd_pcm_sframes_t avail = snd_pcm_avail_update(handle);
+        if (avail < 0)
+            return avail;
+
+        if ((snd_pcm_uframes_t) avail < period - done)
+        {
+            // a playback stream not started yet never frees space
+            if (!capture && snd_pcm_state(handle) == SND_PCM_STATE_PREPARED)
+                return -EPIPE;
+            int e = snd_pcm_wait(handle, 1000);
+            if (e < 0)
+                return e;
+            if (shutdown_)
+                return -EINTR;
+            continue;
+        }
+
+        const snd_pcm_channel_area_t *areas;
+        snd_pcm_uframes_t offset, frames = period - done;
+        int e = snd_pcm_mmap_begin(handle, &areas, &offset, &frames);
+        if (e < 0)
+            return e;
+
+        // interleaved: the channel 0 address of a frame is the frame itself
+        int32_t *area = (int32_t *) ((uint8_t *) areas[0].addr + (areas[0].first + offset * areas[0].step) / 8);
+        if (capture)
+            deinterleave_s32(area, left + done, right + done, frames);
+        else
+            interleave_s32(left + done, right + done, area, frames);
+
+        snd_pcm_sframes_t committed = snd_pcm_mmap_commit(handle, offset, frames);
+        if (committed < 0)
+            return committed;
+        if ((snd_pcm_uframes_t) committed != frames)
+            return -EPIPE;
+        done += frames;
+    }
+
+    // mmap_commit() does not honor the start threshold as writei() did
+    if (!capture && snd_pcm_state(handle) == SND_PCM_STATE_PREPARED)
+        return snd_pcm_start(handle);
+
+    return 0;
+}
+
 void show_alsa(snd_pcm_t *handle, snd_pcm_hw_params_t *params)
 {
     unsigned int val, val2;
@@ -153,129 +358,190 @@ void show_alsa(snd_pcm_t *handle, snd_pcm_hw_params_t *params)
 
 }
 
-// this is the radio rx level
-void set_rx_level(uint32_t rx_level)
+// The mixer of the radio codec stays open, with its two elements looked up
+// once: "Capture" (left: rx level, right: mic level) and "Master" (left:
+// speaker level, right: tx level). The set_*_level() calls just post the
+// level in a slot of its own and wake the mixer thread, which applies the
+// latest level of each slot, so a knob turned fast (or a T/R switch) costs
+// the caller an atomic store, and the levels posted while the mixer thread
+// was busy become a single write.
+enum mixer_level
+{
+    MIXER_RX_LEVEL = 0,
+    MIXER_MIC_LEVEL,
+    MIXER_SPEAKER_LEVEL,
+    MIXER_TX_LEVEL,
+    MIXER_LEVEL_COUNT
+};
+
+#define MIXER_LEVEL_NONE -1
+
+static _Atomic int32_t mixer_pending[MIXER_LEVEL_COUNT] = { MIXER_LEVEL_NONE, MIXER_LEVEL_NONE, MIXER_LEVEL_NONE, MIXER_LEVEL_NONE };
+static sem_t mixer_wakeup;
+static pthread_t mixer_tid;
+static _Atomic bool mixer_running = false;
+
+// private to the mixer thread once it runs
+static snd_mixer_t *radio_mixer;
+static snd_mixer_elem_t *capture_elem, *master_elem;
+static long capture_max, master_max;
+
+static snd_mixer_t *mixer_open(const char *card)
 {
-#if ALLOW_ALSA_LEVELS_IN_IO_ONLY == 0
-    if (radio_h_snd->profiles[radio_h_snd->profile_active_idx].operating_mode == OPERATING_MODE_CONTROLS_ONLY)
-        return;
-#endif
-
-    long min, max;
     snd_mixer_t *handle;
-    snd_mixer_selem_id_t *sid;
-
-    // TODO: lets keep these handle open?
-    snd_mixer_open(&handle, 0);
-    snd_mixer_attach(handle, radio_ctl);
-    snd_mixer_selem_register(handle, NULL, NULL);
-    snd_mixer_load(handle);
-
-    snd_mixer_selem_id_alloca(&sid);
-    snd_mixer_selem_id_set_index(sid, 0);
-    snd_mixer_selem_id_set_name(sid, "Capture");
-    snd_mixer_elem_t *elem = snd_mixer_find_selem(handle, sid);
+    int e;
 
-    long volume = rx_level;
-    snd_mixer_selem_get_capture_volume_range(elem, &min, &max);
+    if ((e = snd_mixer_open(&handle, 0)) < 0)
+    {
+        fprintf(stderr, "Can not open mixer (%s)\n", snd_strerror(e));
+        return NULL;
+    }
 
-    // left channel of the audio codec
-    snd_mixer_selem_set_capture_volume(elem, SND_MIXER_SCHN_FRONT_LEFT,  volume * max / 100);
+    if ((e = snd_mixer_attach(handle, card)) < 0 || (e = snd_mixer_selem_register(handle, NULL, NULL)) < 0 ||
+        (e = snd_mixer_load(handle)) < 0)
+    {
+        fprintf(stderr, "Can not load mixer %s (%s)\n", card, snd_strerror(e));
+        snd_mixer_close(handle);
+        return NULL;
+    }
 
-    snd_mixer_close(handle);
+    return handle;
 }
 
-void set_mic_level(uint32_t mic_level)
+static snd_mixer_elem_t *mixer_find(snd_mixer_t *handle, const char *element)
 {
-#if ALLOW_ALSA_LEVELS_IN_IO_ONLY == 0
-    if (radio_h_snd->profiles[radio_h_snd->profile_active_idx].operating_mode == OPERATING_MODE_CONTROLS_ONLY)
-        return;
-#endif
-
-    long min, max;
-    snd_mixer_t *handle;
     snd_mixer_selem_id_t *sid;
 
-    // TODO: lets keep these handle open?
-    snd_mixer_open(&handle, 0);
-    snd_mixer_attach(handle, radio_ctl);
-    snd_mixer_selem_register(handle, NULL, NULL);
-    snd_mixer_load(handle);
-
     snd_mixer_selem_id_alloca(&sid);
     snd_mixer_selem_id_set_index(sid, 0);
-    snd_mixer_selem_id_set_name(sid, "Capture");
+    snd_mixer_selem_id_set_name(sid, element);
     snd_mixer_elem_t *elem = snd_mixer_find_selem(handle, sid);
 
-    long volume = mic_level;
-    snd_mixer_selem_get_capture_volume_range(elem, &min, &max);
+    if (!elem)
+        fprintf(stderr, "Mixer element %s not found\n", element);
 
-    // right channel of the audio codec
-    snd_mixer_selem_set_capture_volume(elem, SND_MIXER_SCHN_FRONT_RIGHT,  volume * max / 100);
+    return elem;
+}
 
-    snd_mixer_close(handle);
+static void mixer_apply(enum mixer_level level, long volume)
+{
+    switch (level)
+    {
+    case MIXER_RX_LEVEL: // left channel of the audio codec
+        if (capture_elem)
+            snd_mixer_selem_set_capture_volume(capture_elem, SND_MIXER_SCHN_FRONT_LEFT, volume * capture_max / 100);
+        break;
+    case MIXER_MIC_LEVEL: // right channel of the audio codec
+        if (capture_elem)
+            snd_mixer_selem_set_capture_volume(capture_elem, SND_MIXER_SCHN_FRONT_RIGHT, volume * capture_max / 100);
+        break;
+    case MIXER_SPEAKER_LEVEL: // left channel of the audio codec
+        if (master_elem)
+            snd_mixer_selem_set_playback_volume(master_elem, SND_MIXER_SCHN_FRONT_LEFT, volume * master_max / 100);
+        break;
+    case MIXER_TX_LEVEL: // right channel of the audio codec
+        if (master_elem)
+            snd_mixer_selem_set_playback_volume(master_elem, SND_MIXER_SCHN_FRONT_RIGHT, volume * master_max / 100);
+        break;
+    default:
+        break;
+    }
 }
 
-void set_speaker_level(uint32_t speaker_level)
+static void *mixer_thread(void *arg)
+{
+    while (true)
+    {
+        sem_wait(&mixer_wakeup);
+
+        // wakeups posted while the last round ran find nothing left
+        for (int i = 0; i < MIXER_LEVEL_COUNT; i++)
+        {
+            int32_t level = atomic_exchange(&mixer_pending[i], MIXER_LEVEL_NONE);
+            if (level != MIXER_LEVEL_NONE)
+                mixer_apply(i, level);
+        }
+
+        if (shutdown_)
+            break;
+    }
+
+    return NULL;
+}
+
+static void mixer_post(enum mixer_level level, uint32_t volume)
 {
 #if ALLOW_ALSA_LEVELS_IN_IO_ONLY == 0
     if (radio_h_snd->profiles[radio_h_snd->profile_active_idx].operating_mode == OPERATING_MODE_CONTROLS_ONLY)
         return;
 #endif
 
-    long min, max;
-    snd_mixer_t *handle;
-    snd_mixer_selem_id_t *sid;
+    mixer_pending[level] = (int32_t) volume;
 
-    // TODO: lets keep these handle open?
-    snd_mixer_open(&handle, 0);
-    snd_mixer_attach(handle, radio_ctl);
-    snd_mixer_selem_register(handle, NULL, NULL);
-    snd_mixer_load(handle);
+    // before setup_audio_codec() the level just waits in its slot
+    if (mixer_running)
+        sem_post(&mixer_wakeup);
+}
 
-    snd_mixer_selem_id_alloca(&sid);
-    snd_mixer_selem_id_set_index(sid, 0);
-    snd_mixer_selem_id_set_name(sid, "Master");
-    snd_mixer_elem_t *elem = snd_mixer_find_selem(handle, sid);
+// opens the mixer for the controller lifetime
+static void mixer_init()
+{
+    long min;
 
-    long volume = speaker_level;
-    snd_mixer_selem_get_playback_volume_range(elem, &min, &max);
+    radio_mixer = mixer_open(radio_ctl);
+    if (!radio_mixer)
+        return;
 
-    // left channel of the audio codec
-    snd_mixer_selem_set_playback_volume(elem, SND_MIXER_SCHN_FRONT_LEFT,  volume * max / 100);
+    capture_elem = mixer_find(radio_mixer, "Capture");
+    master_elem = mixer_find(radio_mixer, "Master");
+    if (capture_elem)
+        snd_mixer_selem_get_capture_volume_range(capture_elem, &min, &capture_max);
+    if (master_elem)
+        snd_mixer_selem_get_playback_volume_range(master_elem, &min, &master_max);
+}
 
-    snd_mixer_close(handle);
+// from here on the mixer handle belongs to the mixer thread
+static void mixer_start()
+{
+    sem_init(&mixer_wakeup, 0, 1); // applies what was posted so far
+    mixer_running = true;
+    audio_thread_create(&mixer_tid, mixer_thread, NULL, "mixer", -1, 0);
 }
 
-void set_tx_level(uint32_t tx_level)
+static void mixer_shutdown()
 {
-#if ALLOW_ALSA_LEVELS_IN_IO_ONLY == 0
-    if (radio_h_snd->profiles[radio_h_snd->profile_active_idx].operating_mode == OPERATING_MODE_CONTROLS_ONLY)
+    if (!mixer_running)
         return;
-#endif
 
-    long min, max;
-    snd_mixer_t *handle;
-    snd_mixer_selem_id_t *sid;
+    sem_post(&mixer_wakeup);
+    pthread_join(mixer_tid, NULL);
+    mixer_running = false;
 
-    // TODO: lets keep these handle open?
-    snd_mixer_open(&handle, 0);
-    snd_mixer_attach(handle, radio_ctl);
-    snd_mixer_selem_register(handle, NULL, NULL);
-    snd_mixer_load(handle);
+    if (radio_mixer)
+        snd_mixer_close(radio_mixer);
+    radio_mixer = NULL;
+    capture_elem = master_elem = NULL;
+}
 
-    snd_mixer_selem_id_alloca(&sid);
-    snd_mixer_selem_id_set_index(sid, 0);
-    snd_mixer_selem_id_set_name(sid, "Master");
-    snd_mixer_elem_t *elem = snd_mixer_find_selem(handle, sid);
+// this is the radio rx level
+void set_rx_level(uint32_t rx_level)
+{
+    mixer_post(MIXER_RX_LEVEL, rx_level);
+}
 
-    long volume = tx_level;
-    snd_mixer_selem_get_playback_volume_range(elem, &min, &max);
+void set_mic_level(uint32_t mic_level)
+{
+    mixer_post(MIXER_MIC_LEVEL, mic_level);
+}
 
-    // right channel of the audio codec
-    snd_mixer_selem_set_playback_volume(elem, SND_MIXER_SCHN_FRONT_RIGHT,  volume * max / 100);
+void set_speaker_level(uint32_t speaker_level)
+{
+    mixer_post(MIXER_SPEAKER_LEVEL, speaker_level);
+}
 
-    snd_mixer_close(handle);
+void set_tx_level(uint32_t tx_level)
+{
+    mixer_post(MIXER_TX_LEVEL, tx_level);
 }
 
 
@@ -286,7 +552,10 @@ void setup_audio_codec()
         return;
 #endif
 
+    mixer_init();
+
     //configure mixer controls
+
     sound_mixer(radio_ctl, "Line", 1);
     sound_mixer(radio_ctl, "Mic", 0);
     sound_mixer(radio_ctl, "Mic Boost", 0);
@@ -303,7 +572,7 @@ void setup_audio_codec()
 
     if (radio_h_snd->txrx_state == IN_TX)
     {
-        set_speaker_level(0);
+        set_speaker_level(radio_h_snd->tx_monitor_level ? radio_h_snd->profiles[radio_h_snd->profile_active_idx].speaker_level : 0);
         set_tx_level(radio_h_snd->profiles[radio_h_snd->profile_active_idx].tx_level);
     }
     else
@@ -313,8 +582,12 @@ void setup_audio_codec()
     }
     set_mic_level(radio_h_snd->profiles[radio_h_snd->profile_active_idx].mic_level);
     set_rx_level(radio_h_snd->profiles[radio_h_snd->profile_active_idx].rx_level);
+
+    mixer_start();
 }
 
+// sets a switch (or a volume, or an enum) of the card, on the open radio
+// mixer when it is the radio card. Not to be called once the mixer thread runs
 void sound_mixer(char *card_name, char *element, int make_on)
 {
     // alsa-less operation
@@ -322,20 +595,18 @@ void sound_mixer(char *card_name, char *element, int make_on)
         return;
 
     long min, max;
-    snd_mixer_t *handle;
-    snd_mixer_selem_id_t *sid;
-    char *card = card_name;
+    snd_mixer_t *handle = (radio_mixer && !strcmp(card_name, radio_ctl)) ? radio_mixer : mixer_open(card_name);
 
-    // TODO: lets keep these handle open?
-    snd_mixer_open(&handle, 0);
-    snd_mixer_attach(handle, card);
-    snd_mixer_selem_register(handle, NULL, NULL);
-    snd_mixer_load(handle);
+    if (!handle)
+        return;
 
-    snd_mixer_selem_id_alloca(&sid);
-    snd_mixer_selem_id_set_index(sid, 0);
-    snd_mixer_selem_id_set_name(sid, element);
-    snd_mixer_elem_t* elem = snd_mixer_find_selem(handle, sid);
+    snd_mixer_elem_t* elem = mixer_find(handle, element);
+    if (!elem)
+    {
+        if (handle != radio_mixer)
+            snd_mixer_close(handle);
+        return;
+    }
 
     //find out if the his element is capture side or plaback
     if(snd_mixer_selem_has_capture_switch(elem))
@@ -362,7 +633,9 @@ void sound_mixer(char *card_name, char *element, int make_on)
     {
         snd_mixer_selem_set_enum_item(elem, 0, make_on);
     }
-    snd_mixer_close(handle);
+
+    if (handle != radio_mixer)
+        snd_mixer_close(handle);
 }
 
 
@@ -449,52 +722,43 @@ void *radio_capture_thread(void *device_ptr)
     printf("==============================================================\n");
 #endif
 
-    int sample_size = snd_pcm_format_width(format) / 8;
+    int sample_size = snd_pcm_format_width(format) / 8; // S32_LE, as the deinterleave
     uint32_t buffer_size = hw_period_size * sample_size * channels;
 
-    uint8_t *buffer = malloc(buffer_size);
-    uint8_t *radio = (uint8_t *) malloc(buffer_size/2);
-    uint8_t *mic = (uint8_t *) malloc(buffer_size/2);
-
     snd_pcm_prepare(pcm_capture_handle);
     snd_pcm_drop(pcm_capture_handle);
     snd_pcm_prepare(pcm_capture_handle);
+    // no readi() to start the stream
+    snd_pcm_start(pcm_capture_handle);
 
     while (!shutdown_)
     {
+        thread_stats_tick(&audio_thread_stats[AUDIO_THREAD_RADIO_CAPTURE]);
+
+        // deinterleave from the dma area straight into the rings
+        int32_t *radio = (int32_t *) write_acquire(radio_to_dsp, buffer_size/2);
+        int32_t *mic = (int32_t *) write_acquire(mic_to_dsp, buffer_size/2);
 
-        if ((e = snd_pcm_mmap_readi(pcm_capture_handle, buffer, hw_period_size)) != hw_period_size)
+        if ((e = pcm_mmap_period(pcm_capture_handle, radio, mic, hw_period_size, true)) < 0)
         {
+            if (shutdown_)
+                break;
+            xrun_account(AUDIO_THREAD_RADIO_CAPTURE, e, size_buffer(radio_to_dsp) / sample_size, 0);
             fprintf (stderr, "read from audio interface %s failed (%s)\n", device, snd_strerror (e));
             if (e == -EPIPE)
             {
                 fprintf(stderr, "overrun\n");
             }
-            else if (e < 0)
-            {
-                fprintf(stderr, "error from readi: %s\n", snd_strerror(e));
-            } else if (e != hw_period_size)
-            {
-                fprintf(stderr, "short read, read %d frames\n", e);
-            }
             snd_pcm_prepare (pcm_capture_handle);
+            snd_pcm_start (pcm_capture_handle);
             continue;
         }
 
-        for (int j = 0; j < hw_period_size; j++)
-        {
-            memcpy(&radio[j*sample_size], &buffer[j * sample_size * channels], sample_size);
-            memcpy(&mic[j*sample_size], &buffer[j * sample_size * channels + sample_size], sample_size);
-        }
-
-        write_buffer(radio_to_dsp, radio, buffer_size/2);
-        write_buffer(mic_to_dsp, mic, buffer_size/2);
+        write_commit(radio_to_dsp, buffer_size/2);
+        write_commit(mic_to_dsp, buffer_size/2);
     }
 
     snd_pcm_hw_params_free(hwparams);
-    free(buffer);
-    free(radio);
-    free(mic);
 
     return NULL;
 }
@@ -585,12 +849,11 @@ void *radio_playback_thread(void *device_ptr)
     printf("==============================================================\n");
 #endif
 
-    int sample_size = snd_pcm_format_width(format) / 8;
+    int sample_size = snd_pcm_format_width(format) / 8; // S32_LE, as the interleave
     uint32_t buffer_size = hw_period_size * sample_size * channels;
+    uint32_t block_bytes = radio_h_snd->dsp_block_size * sample_size; // of each mono ring
 
-    uint8_t *buffer = malloc(buffer_size);
-    uint8_t *radio = (uint8_t *) malloc(buffer_size/2);
-    uint8_t *speaker = (uint8_t *) malloc(buffer_size/2);
+    int32_t *silence = calloc(hw_period_size, sample_size);
 
     snd_pcm_prepare(pcm_play_handle);
     snd_pcm_drop(pcm_play_handle);
@@ -598,38 +861,40 @@ void *radio_playback_thread(void *device_ptr)
 
     while (!shutdown_)
     {
+        thread_stats_tick(&audio_thread_stats[AUDIO_THREAD_RADIO_PLAYBACK]);
 
-        read_buffer(dsp_to_radio, radio, buffer_size/2);
-        read_buffer(dsp_to_speaker, speaker, buffer_size/2);
+        ring_resync(AUDIO_THREAD_RADIO_PLAYBACK, dsp_to_radio, block_bytes);
+        ring_resync(AUDIO_THREAD_RADIO_PLAYBACK, dsp_to_speaker, block_bytes);
 
-        for (int j = 0; j < hw_period_size; j++)
-        {
-            memcpy(&buffer[j*sample_size*channels], &speaker[j*sample_size], sample_size);
-            memcpy(&buffer[j*sample_size*channels + sample_size], &radio[j*sample_size], sample_size);
-        }
+        // interleave from the rings straight into the dma area
+        int32_t *radio = (int32_t *) read_acquire(dsp_to_radio, buffer_size/2);
+        int32_t *speaker = (int32_t *) read_acquire(dsp_to_speaker, buffer_size/2);
 
     try_again_radio_play:
-        if ((e = snd_pcm_mmap_writei(pcm_play_handle, buffer, hw_period_size)) != hw_period_size)
+        if ((e = pcm_mmap_period(pcm_play_handle, speaker, radio, hw_period_size, false)) < 0)
         {
+            if (shutdown_)
+                break;
+            uint32_t prefill = xrun_account(AUDIO_THREAD_RADIO_PLAYBACK, e, size_buffer(dsp_to_speaker) / sample_size, hw_n_periods - 1);
             fprintf (stderr, "write to audio interface %s failed (%s)\n", device, snd_strerror (e));
             if (e == -EPIPE)
             {
-                fprintf(stderr, "overrun\n");
-            }
-            else if (e < 0)
-            {
-                fprintf(stderr, "error from writei: %s\n", snd_strerror(e));
-            } else if (e != hw_period_size)
-            {
-                fprintf(stderr, "short write, wrote %d frames\n", e);
+                fprintf(stderr, "underrun, restarting with %u periods of silence\n", prefill);
             }
             snd_pcm_prepare (pcm_play_handle);
+            // some slack for the dsp, ahead of the data (the first one starts the stream)
+            for (uint32_t p = 0; p < prefill; p++)
+                if (pcm_mmap_period(pcm_play_handle, silence, silence, hw_period_size, false) < 0)
+                    break;
             goto try_again_radio_play;
         }
+
+        read_commit(dsp_to_radio, buffer_size/2);
+        read_commit(dsp_to_speaker, buffer_size/2);
     }
 
+    free(silence);
     snd_pcm_hw_params_free(hwparams);
-    free(buffer);
 
     return NULL;
 }
@@ -719,9 +984,18 @@ void *loop_capture_thread(void *device_ptr)
     // TODO: apply sw parameters... ?
 
     int sample_size = snd_pcm_format_width(format) / 8;
-    uint32_t buffer_size = loopback_period_size * sample_size * channels;
+    uint32_t frame_size = sample_size * channels;
+    uint32_t buffer_size = loopback_period_size * frame_size;
+    uint32_t block_frames = radio_h_snd->dsp_block_size / 2;
 
-    uint8_t *buffer = malloc(buffer_size);
+    // the dsp tx needs a whole block when it reads, a period more is margin
+    bool resample = radio_h_snd->loopback_resampler;
+    bool resampling = false;
+    uint32_t max_out = loopback_period_size + RESAMPLER_TAPS;
+    resampler_init(&loop_capture_resampler, channels, loopback_rate, block_frames, block_frames + loopback_period_size, true);
+    uint8_t *period = malloc(buffer_size);
+
+    uint8_t *buffer;
 
     snd_pcm_prepare(loopback_capture_handle);
     snd_pcm_drop(loopback_capture_handle);
@@ -729,10 +1003,24 @@ void *loop_capture_thread(void *device_ptr)
 
     while (!shutdown_)
     {
+        thread_stats_tick(&audio_thread_stats[AUDIO_THREAD_LOOP_CAPTURE]);
 
-        if ((e = snd_pcm_mmap_readi(loopback_capture_handle, buffer, loopback_period_size)) != loopback_period_size)
+        // the dsp tx only reads the ring in loopback mode, otherwise it
+        // clears it and there is no fill to follow
+        bool use_loopback = resample && radio_h_snd->profiles[radio_h_snd->profile_active_idx].operating_mode == OPERATING_MODE_FULL_LOOPBACK;
+        if (use_loopback != resampling)
         {
+            resampler_reset(&loop_capture_resampler);
+            resampling = use_loopback;
+        }
+
+        // read straight into the ring, committed only when the read succeeds,
+        // or through the resampler
+        buffer = resampling ? period : write_acquire(loopback_to_dsp, buffer_size);
 
+        if ((e = snd_pcm_mmap_readi(loopback_capture_handle, buffer, loopback_period_size)) != loopback_period_size)
+        {
+            xrun_account(AUDIO_THREAD_LOOP_CAPTURE, e, size_buffer(loopback_to_dsp) / (sample_size * channels), 0);
             fprintf (stderr, "read from audio interface %s failed (%s)\n", device, snd_strerror (e));
             if (e == -EPIPE)
             {
@@ -748,11 +1036,20 @@ void *loop_capture_thread(void *device_ptr)
             continue;
         }
 
-        write_buffer(loopback_to_dsp, buffer, buffer_size);
+        if (!resampling)
+        {
+            write_commit(loopback_to_dsp, buffer_size);
+            continue;
+        }
+
+        resampler_control(&loop_capture_resampler, size_buffer(loopback_to_dsp) / frame_size, clock_ns(CLOCK_MONOTONIC));
+        uint8_t *out = write_acquire(loopback_to_dsp, max_out * frame_size);
+        uint32_t frames = resampler_process(&loop_capture_resampler, (int32_t *) period, loopback_period_size, (int32_t *) out, max_out);
+        write_commit(loopback_to_dsp, frames * frame_size);
     }
 
+    free(period);
     snd_pcm_hw_params_free(hloop_params);
-    free(buffer);
 
     return NULL;
 }
@@ -844,9 +1141,19 @@ void *loop_playback_thread(void *device_ptr)
 #endif
 
     int sample_size = snd_pcm_format_width(format) / 8;
-    uint32_t buffer_size = loopback_period_size * sample_size * channels;
+    uint32_t frame_size = sample_size * channels;
+    uint32_t buffer_size = loopback_period_size * frame_size;
+    uint32_t block_bytes = radio_h_snd->dsp_block_size * sample_size; // 48 kHz stereo, the same bytes as 96 kHz mono
+    uint32_t block_frames = block_bytes / frame_size;
 
-    uint8_t *buffer = malloc(buffer_size);
+    // before the next block of the dsp rx there must be a period to read, and
+    // half a block of margin
+    bool resample = radio_h_snd->loopback_resampler;
+    resampler_init(&loop_playback_resampler, channels, loopback_rate, block_frames, block_frames / 2 + loopback_period_size, false);
+    uint8_t *resampled = malloc(buffer_size);
+
+    uint8_t *buffer;
+    uint8_t *silence = calloc(1, buffer_size);
 
     snd_pcm_prepare(loopback_play_handle);
     snd_pcm_drop(loopback_play_handle);
@@ -854,15 +1161,32 @@ void *loop_playback_thread(void *device_ptr)
 
     while (!shutdown_)
     {
-        read_buffer(dsp_to_loopback, buffer, buffer_size);
+        thread_stats_tick(&audio_thread_stats[AUDIO_THREAD_LOOP_PLAYBACK]);
+
+        ring_resync(AUDIO_THREAD_LOOP_PLAYBACK, dsp_to_loopback, block_bytes);
+
+        if (resample)
+        {
+            resampler_control(&loop_playback_resampler, size_buffer(dsp_to_loopback) / frame_size, clock_ns(CLOCK_MONOTONIC));
+            uint32_t in_bytes = resampler_needed(&loop_playback_resampler, loopback_period_size) * frame_size;
+            buffer = read_acquire(dsp_to_loopback, in_bytes);
+            resampler_process(&loop_playback_resampler, (int32_t *) buffer, in_bytes / frame_size, (int32_t *) resampled, loopback_period_size);
+            read_commit(dsp_to_loopback, in_bytes);
+            buffer = resampled;
+        }
+        else // written to alsa straight from the ring
+            buffer = read_acquire(dsp_to_loopback, buffer_size);
 
     try_again_loop_play:
         if ((e = snd_pcm_mmap_writei(loopback_play_handle, buffer, loopback_period_size)) != loopback_period_size)
         {
+            if (shutdown_)
+                break;
+            uint32_t prefill = xrun_account(AUDIO_THREAD_LOOP_PLAYBACK, e, size_buffer(dsp_to_loopback) / (sample_size * channels), loopback_n_periods - 1);
             fprintf (stderr, "write to audio interface %s failed (%s)\n", device, snd_strerror (e));
             if (e == -EPIPE)
             {
-                fprintf(stderr, "overrun\n");
+                fprintf(stderr, "underrun, restarting with %u periods of silence\n", prefill);
             }
             else if (e < 0)
             {
@@ -873,51 +1197,126 @@ void *loop_playback_thread(void *device_ptr)
             }
 
             snd_pcm_prepare (loopback_play_handle);
+            for (uint32_t p = 0; p < prefill; p++)
+                if (snd_pcm_mmap_writei(loopback_play_handle, silence, loopback_period_size) < 0)
+                    break;
             goto try_again_loop_play;
         }
+
+        if (!resample)
+            read_commit(dsp_to_loopback, buffer_size);
     }
 
+    free(resampled);
+    free(silence);
     snd_pcm_hw_params_free(hloop_params);
-    free(buffer);
 
     return NULL;
 }
 
-void *control_thread(void *device_ptr)
+// The rx and the tx dsp run in their own threads, each one the single
+// consumer of its input rings and the single producer of its output rings:
+// - dsp_rx: radio_to_dsp, tx_monitor -> dsp_to_speaker, dsp_to_loopback
+// - dsp_tx: mic_to_dsp, loopback_to_dsp -> dsp_to_radio, tx_monitor
+// Both run all the time, paced by the capture, and the one of the idle
+// direction just writes silence, so the playback rings stay in step. With
+// full_duplex the rx dsp keeps running (muted) during tx, so it needs no
+// restart when the tx ends. During tx the speaker plays the tx monitor,
+// one block behind the tx dsp.
+
+// we have 96 kHz in the radio soundcard, and 48 kHz in the loopback soundcard
+// the DSP block size (dsp_block_size in core.ini) is 256, 512 or 1024 samples,
+// smaller blocks use a partitioned filter with the same response
+void *dsp_rx_thread(void *arg)
 {
+    struct audio_thread_stats *st = &audio_thread_stats[AUDIO_THREAD_DSP_RX];
     int sample_size = snd_pcm_format_width(format) / 8;
+    uint32_t block_size = radio_h_snd->dsp_block_size;
+    uint32_t buffer_size = block_size * sample_size;
 
-    // TODO: DSP with 512 sample window?
-    // we have 96 kHz in the radio soundcard, and 48 kHz in the loopback soundcard
-    // we define our block transfer size as the minimum of both, in order to try to reduce latency a bit
-    // uint32_t block_size = hw_period_size;
-    // As Farhan's DSP code needs 1024 samples window to work (which we are currently using) we force 1024
-    uint32_t block_size = 1024;
+    // the DSP writes its outputs straight in the rings, the scratch buffer
+    // is only used when a ring is full
+    uint8_t *buffer_discard = malloc(buffer_size);
 
-    // as we are hardcoding block sizes... this gets false
-#if 0
-    if (hw_period_size != (loopback_period_size * 2))
+    while (!shutdown_)
     {
-        fprintf(stderr, "Hardware 96 kHz sound period size != (Loopback 48 kHz period size * 2)\n");
-        block_size = hw_period_size;
+        thread_stats_tick(st);
+
+        uint8_t *buffer_radio_to_dsp = read_acquire(radio_to_dsp, buffer_size); // mono
+        uint64_t start = clock_ns(CLOCK_MONOTONIC);
+
+        // a full output ring gets the block discarded (and the loopback one cleaned)
+        bool loopback_ok = free_size_buffer(dsp_to_loopback) >= buffer_size;
+        bool speaker_ok = free_size_buffer(dsp_to_speaker) >= buffer_size;
+
+        uint8_t *output_loopback = loopback_ok ? write_acquire(dsp_to_loopback, buffer_size) : buffer_discard; // stereo 48 kHz interleaved
+        uint8_t *output_speaker = speaker_ok ? write_acquire(dsp_to_speaker, buffer_size) : buffer_discard; // mono 96 kHz
+
+        bool tx_on = radio_h_snd->txrx_state == IN_TX;
+
+        if (!tx_on || radio_h_snd->full_duplex)
+        {
+            dsp_process_rx(buffer_radio_to_dsp, output_speaker, output_loopback, NULL, block_size);
+            thread_stats_block(st, start);
+        }
+        else
+        {
+            memset(output_loopback, 0, buffer_size);
+            memset(output_speaker, 0, buffer_size);
+        }
+
+        read_commit(radio_to_dsp, buffer_size);
+
+        // the speaker is muted during tx, it gets the tx monitor when there is one
+        if (tx_on && size_buffer(tx_monitor) >= buffer_size)
+        {
+            memcpy(output_speaker, read_acquire(tx_monitor, buffer_size), buffer_size);
+            read_commit(tx_monitor, buffer_size);
+        }
+        else if (!tx_on && size_buffer(tx_monitor) > 0)
+        {
+            clear_buffer(tx_monitor);
+        }
+
+        if (loopback_ok)
+        {
+            write_commit(dsp_to_loopback, buffer_size);
+            resampler_block(&loop_playback_resampler, clock_ns(CLOCK_MONOTONIC));
+        }
+        else
+        {
+            st->drops++;
+            printf("Buffer full dsp_to_loopback! Cleaning buffer\n");
+            clear_buffer(dsp_to_loopback);
+        }
+
+        if (speaker_ok)
+            write_commit(dsp_to_speaker, buffer_size);
+        else
+        {
+            st->drops++;
+            printf("Buffer full dsp_to_speaker!\n");
+        }
     }
-#endif
 
-    uint32_t buffer_size = block_size * sample_size;
+    free(buffer_discard);
 
-    uint8_t *buffer_radio_to_dsp = malloc(buffer_size);
-    uint8_t *buffer_mic_to_dsp = malloc(buffer_size);
-    uint8_t *buffer_loop_to_dsp = malloc(buffer_size);
+    return NULL;
+}
 
-    uint8_t *signal_to_tx;
-    uint8_t *output_speaker; uint8_t *output_loopback; uint8_t *output_tx;
+void *dsp_tx_thread(void *arg)
+{
+    struct audio_thread_stats *st = &audio_thread_stats[AUDIO_THREAD_DSP_TX];
+    int sample_size = snd_pcm_format_width(format) / 8;
+    uint32_t block_size = radio_h_snd->dsp_block_size;
+    uint32_t buffer_size = block_size * sample_size;
 
-    output_tx = malloc(buffer_size);
-    output_speaker = malloc(buffer_size);
-    output_loopback = malloc(buffer_size);
+    uint8_t *signal_to_tx;
+    uint32_t starved_run = 0; // blocks in a row without loopback input
 
     uint8_t *buffer_null = malloc(buffer_size);
     memset(buffer_null, 0, buffer_size);
+    uint8_t *buffer_discard = malloc(buffer_size);
 
     while (!shutdown_)
     {
@@ -925,22 +1324,30 @@ void *control_thread(void *device_ptr)
         // halt this loop on external DSP
         // check_external_dsp(radio_h_snd);
 
+        thread_stats_tick(st);
+
         _Atomic bool use_loopback = (radio_h_snd->profiles[radio_h_snd->profile_active_idx].operating_mode == OPERATING_MODE_FULL_LOOPBACK) ? true : false;
+        bool loop_acquired = false;
 
-        read_buffer(radio_to_dsp, buffer_radio_to_dsp, buffer_size); // mono
-        read_buffer(mic_to_dsp, buffer_mic_to_dsp, buffer_size); // mono
+        uint8_t *buffer_mic_to_dsp = read_acquire(mic_to_dsp, buffer_size); // mono
+        uint64_t start = clock_ns(CLOCK_MONOTONIC);
 
         if (use_loopback)
         {
             // in case the alsa loopback device is not started, it will block in the read()
             if (size_buffer(loopback_to_dsp) >= buffer_size)
             {
-                read_buffer(loopback_to_dsp, buffer_loop_to_dsp, buffer_size); // stereo interleaved
-                signal_to_tx = buffer_loop_to_dsp;
+                signal_to_tx = read_acquire(loopback_to_dsp, buffer_size); // stereo interleaved
+                loop_acquired = true;
+                if (starved_run)
+                    printf("Loopback capture back after %u blocks of silence.\n", starved_run);
+                starved_run = 0;
             }
             else
             {
-                printf("No data from loopback capture device. Skipping.\n");
+                if (starved_run++ == 0)
+                    printf("No data from loopback capture device. Skipping.\n");
+                st->starved++;
                 signal_to_tx = buffer_null;
             }
         }
@@ -950,38 +1357,44 @@ void *control_thread(void *device_ptr)
             signal_to_tx = buffer_mic_to_dsp;
         }
 
-        if (radio_h_snd->txrx_state == IN_RX)
+        bool radio_ok = free_size_buffer(dsp_to_radio) >= buffer_size;
+        uint8_t *output_tx = radio_ok ? write_acquire(dsp_to_radio, buffer_size) : buffer_discard; // mono 96 kHz
+
+        if (radio_h_snd->txrx_state == IN_TX)
         {
-            dsp_process_rx(buffer_radio_to_dsp, output_speaker, output_loopback, output_tx, block_size);
+            // the monitor is dropped when the rx dsp does not keep up with it
+            bool monitor_ok = radio_h_snd->tx_monitor_level && free_size_buffer(tx_monitor) >= buffer_size;
+            uint8_t *output_monitor = monitor_ok ? write_acquire(tx_monitor, buffer_size) : NULL; // mono 96 kHz
+
+            dsp_process_tx(signal_to_tx, output_monitor, NULL, output_tx, block_size, use_loopback);
+            thread_stats_block(st, start);
+
+            if (monitor_ok)
+                write_commit(tx_monitor, buffer_size);
         }
         else
         {
-            dsp_process_tx(signal_to_tx, output_speaker, output_loopback, output_tx, block_size, use_loopback);
+            memset(output_tx, 0, buffer_size);
         }
 
-        if (free_size_buffer(dsp_to_loopback) >= buffer_size)
-            write_buffer(dsp_to_loopback, output_loopback, buffer_size); // stereo 48 kHz interleaved
-        else
+        read_commit(mic_to_dsp, buffer_size);
+        if (loop_acquired)
         {
-            printf("Buffer full dsp_to_loopback! Cleaning buffer\n");
-            clear_buffer(dsp_to_loopback);
+            read_commit(loopback_to_dsp, buffer_size);
+            resampler_block(&loop_capture_resampler, clock_ns(CLOCK_MONOTONIC));
         }
 
-        if (free_size_buffer(dsp_to_radio) >= buffer_size)
-            write_buffer(dsp_to_radio, output_tx, buffer_size); // mono 96 kHz
+        if (radio_ok)
+            write_commit(dsp_to_radio, buffer_size);
         else
+        {
+            st->drops++;
             printf("Buffer full dsp_to_radio!\n");
-
-        if (free_size_buffer(dsp_to_speaker) >= buffer_size)
-            write_buffer(dsp_to_speaker, output_speaker, buffer_size); // mono 96 kHz
-        else
-            printf("Buffer full dsp_to_speaker!\n");
+        }
     }
 
     free(buffer_null);
-    free(output_tx);
-    free(output_speaker);
-    free(output_loopback);
+    free(buffer_discard);
 
     return NULL;
 }
@@ -995,10 +1408,36 @@ void clear_buffers()
     clear_buffer(dsp_to_speaker);
     clear_buffer(dsp_to_loopback);
     clear_buffer(loopback_to_dsp);
+    clear_buffer(tx_monitor);
+}
+
+// just the tx side, the rx audio queued before the ptt still gets played
+void clear_tx_buffers()
+{
+    clear_buffer(mic_to_dsp);
+    clear_buffer(loopback_to_dsp);
+    clear_buffer(dsp_to_radio);
+    clear_buffer(tx_monitor);
+}
+
+// estimated end to end latencies: the capture period, the DSP block and
+// filter delay, and the playback buffer
+static void print_latency_report()
+{
+    double ms = 1000.0 / hw_rate;
+    uint32_t playback_96k = hw_n_periods * hw_period_size;
+    uint32_t playback_48k = loopback_n_periods * loopback_period_size * 2; // in 96 kHz samples
+
+    printf("Estimated latency with %u samples DSP blocks (%lu/%lu frames periods):\n",
+           radio_h_snd->dsp_block_size, (unsigned long) hw_period_size, (unsigned long) loopback_period_size);
+    printf("  mic to RF:       %.1f ms\n", (hw_period_size + dsp_latency(true) + playback_96k) * ms);
+    printf("  loopback to RF:  %.1f ms\n", (loopback_period_size * 2 + dsp_latency(true) + playback_96k) * ms);
+    printf("  RF to speaker:   %.1f ms\n", (hw_period_size + dsp_latency(false) + playback_96k) * ms);
+    printf("  RF to loopback:  %.1f ms\n", (hw_period_size + dsp_latency(false) + playback_48k) * ms);
 }
 
 // initialize the ALSA sound system
-void sound_system_init(radio *radio_h, pthread_t *control_tid, pthread_t *radio_capture,
+void sound_system_init(radio *radio_h, pthread_t *dsp_rx_tid, pthread_t *dsp_tx_tid, pthread_t *radio_capture,
                        pthread_t *radio_playback, pthread_t *loop_capture, pthread_t *loop_playback)
 {
     radio_h_snd = radio_h;
@@ -1010,35 +1449,47 @@ void sound_system_init(radio *radio_h, pthread_t *control_tid, pthread_t *radio_
 
     initialize_buffers();
 
-    pthread_create(radio_playback, NULL, radio_playback_thread, (void*)radio_playback_dev);
-    pthread_create(loop_playback, NULL, loop_playback_thread, (void*)loop_playback_dev);
+    // periods longer than the DSP block would just add latency
+    if (radio_h->dsp_block_size < hw_period_size)
+    {
+        hw_period_size = radio_h->dsp_block_size;
+        loopback_period_size = radio_h->dsp_block_size / 2;
+    }
 
-    pthread_create(control_tid, NULL, control_thread, NULL);
+    print_latency_report();
 
-    pthread_create(radio_capture, NULL, radio_capture_thread, (void*)radio_capture_dev);
-    pthread_create(loop_capture, NULL, loop_capture_thread, (void*)loop_capture_dev);
+    printf("Audio threads: alsa on cpu %d (priority %d), dsp rx on cpu %d (priority %d), dsp tx on cpu %d (priority %d)\n",
+           radio_h->alsa_cpu, radio_h->alsa_priority, radio_h->dsp_rx_cpu, radio_h->dsp_rx_priority,
+           radio_h->dsp_tx_cpu, radio_h->dsp_tx_priority);
 
+    audio_thread_create(radio_playback, radio_playback_thread, (void*)radio_playback_dev,
+                        "radio_playback", radio_h->alsa_cpu, radio_h->alsa_priority);
+    audio_thread_create(loop_playback, loop_playback_thread, (void*)loop_playback_dev,
+                        "loop_playback", radio_h->alsa_cpu, radio_h->alsa_priority);
 
-    struct sched_param sch;
-    sch.sched_priority = sched_get_priority_max(SCHED_FIFO);
-    pthread_setschedparam(*radio_capture, SCHED_FIFO, &sch);
-    pthread_setschedparam(*radio_playback, SCHED_FIFO, &sch);
-    pthread_setschedparam(*loop_capture, SCHED_FIFO, &sch);
-    pthread_setschedparam(*loop_playback, SCHED_FIFO, &sch);
+    audio_thread_create(dsp_rx_tid, dsp_rx_thread, NULL, "dsp_rx", radio_h->dsp_rx_cpu, radio_h->dsp_rx_priority);
+    audio_thread_create(dsp_tx_tid, dsp_tx_thread, NULL, "dsp_tx", radio_h->dsp_tx_cpu, radio_h->dsp_tx_priority);
 
+    audio_thread_create(radio_capture, radio_capture_thread, (void*)radio_capture_dev,
+                        "radio_capture", radio_h->alsa_cpu, radio_h->alsa_priority);
+    audio_thread_create(loop_capture, loop_capture_thread, (void*)loop_capture_dev,
+                        "loop_capture", radio_h->alsa_cpu, radio_h->alsa_priority);
 }
 
 // shutdown the ALSA sound system
-void sound_system_shutdown(radio *radio_h, pthread_t *control_tid, pthread_t *radio_capture,
+void sound_system_shutdown(radio *radio_h, pthread_t *dsp_rx_tid, pthread_t *dsp_tx_tid, pthread_t *radio_capture,
                            pthread_t *radio_playback, pthread_t *loop_capture, pthread_t *loop_playback)
 {
+    mixer_shutdown();
+
     if (radio_h->profiles[radio_h->profile_active_idx].operating_mode == OPERATING_MODE_CONTROLS_ONLY)
         return;
 
     pthread_join(*radio_playback, NULL);
     pthread_join(*loop_playback, NULL);
 
-    pthread_join(*control_tid, NULL);
+    pthread_join(*dsp_rx_tid, NULL);
+    pthread_join(*dsp_tx_tid, NULL);
 
     pthread_join(*radio_capture, NULL);
     pthread_join(*loop_capture, NULL);
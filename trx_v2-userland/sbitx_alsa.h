@@ -23,13 +23,64 @@
 #define SBITX_ALSA_H_
 
 #include <alsa/asoundlib.h>
+#include <stdatomic.h>
 
 #include "sbitx_core.h"
+#include "sbitx_resampler.h"
 
-void sound_system_init(radio *radio_h, pthread_t *control_tid, pthread_t *radio_capture,
+// the audio threads, see audio_thread_stats. The alsa ones come first, one
+// per device, and also index audio_xrun_stats
+enum audio_thread_id
+{
+    AUDIO_THREAD_RADIO_CAPTURE = 0,
+    AUDIO_THREAD_RADIO_PLAYBACK,
+    AUDIO_THREAD_LOOP_CAPTURE,
+    AUDIO_THREAD_LOOP_PLAYBACK,
+    AUDIO_DEVICE_COUNT,
+    AUDIO_THREAD_DSP_RX = AUDIO_DEVICE_COUNT,
+    AUDIO_THREAD_DSP_TX,
+    AUDIO_THREAD_COUNT
+};
+
+// cpu accounting of each audio thread, updated by the thread itself about
+// once per second (CLOCK_THREAD_CPUTIME_ID over the elapsed time)
+struct audio_thread_stats
+{
+    const char *name;
+    _Atomic uint32_t cpu_load; // per mille of one core, in the last second
+    _Atomic uint32_t block_max_us; // longest dsp block in the last second (dsp threads only)
+    _Atomic uint32_t drops; // blocks discarded on a full output ring (dsp threads only)
+    _Atomic uint32_t starved; // blocks without loopback input, sent as silence (dsp tx only)
+
+    // window being measured, private to the thread
+    uint64_t window_start_ns;
+    uint64_t window_cpu_ns;
+    uint32_t window_block_max_us;
+};
+
+extern struct audio_thread_stats audio_thread_stats[AUDIO_THREAD_COUNT];
+
+// xrun accounting of each alsa device, written by its thread
+struct audio_xrun_stats
+{
+    _Atomic uint32_t xruns; // overruns (capture) or underruns (playback), -EPIPE
+    _Atomic uint32_t errors; // any other failed transfer (suspend, short read/write, ...)
+    _Atomic uint64_t last_xrun_ms; // CLOCK_REALTIME of the last xrun, in ms
+    _Atomic uint32_t last_xrun_fill; // frames in the ring of the device at the last xrun
+    _Atomic uint32_t prefill; // periods of silence written ahead of the data at the last restart (playback)
+    _Atomic uint32_t resyncs; // backlogs dropped from the ring (playback)
+};
+
+extern struct audio_xrun_stats audio_xrun_stats[AUDIO_DEVICE_COUNT];
+
+// loopback clock drift, the ppm and fill statistics are read by the websocket
+extern struct resampler loop_capture_resampler;
+extern struct resampler loop_playback_resampler;
+
+void sound_system_init(radio *radio_h, pthread_t *dsp_rx_tid, pthread_t *dsp_tx_tid, pthread_t *radio_capture,
                        pthread_t *radio_playback, pthread_t *loop_capture, pthread_t *loop_playback);
 
-void sound_system_shutdown(radio *radio_h, pthread_t *control_tid, pthread_t *radio_capture,
+void sound_system_shutdown(radio *radio_h, pthread_t *dsp_rx_tid, pthread_t *dsp_tx_tid, pthread_t *radio_capture,
                            pthread_t *radio_playback, pthread_t *loop_capture, pthread_t *loop_playback);
 
 
@@ -46,5 +97,6 @@ void set_tx_level(uint32_t tx_level);
 
 void sound_mixer(char *card_name, char *element, int make_on);
 void clear_buffers();
+void clear_tx_buffers();
 
 #endif
@@ -19,6 +19,12 @@
  *
 */
 
+#include <string.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
 #include "sbitx_buffer.h"
 
 buffer *radio_to_dsp;
@@ -30,90 +36,157 @@ buffer *dsp_to_speaker;
 buffer *dsp_to_loopback;
 buffer *loopback_to_dsp;
 
-inline unsigned long free_size_buffer(buffer *buffer)
+buffer *tx_monitor;
+
+static inline void futex_wait(_Atomic uint32_t *word, uint32_t val)
 {
-	unsigned long ret = 0;
+    syscall(SYS_futex, word, FUTEX_WAIT_PRIVATE, val, NULL, NULL, 0);
+}
 
-    pthread_mutex_lock(&buffer->mutex);
+static inline void futex_wake(_Atomic uint32_t *word)
+{
+    syscall(SYS_futex, word, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+}
 
-    ret = ring_buffer_count_free_bytes(&buffer->buf);
+// the read position, with a pending clear already applied
+static inline unsigned long effective_tail(buffer *buffer)
+{
+    unsigned long tail = buffer->tail;
 
-	pthread_mutex_unlock(&buffer->mutex);
+    if (buffer->clear_pending)
+    {
+        unsigned long to = buffer->clear_to;
+        if ((long) (to - tail) > 0)
+            tail = to;
+    }
 
-	return ret;
+    return tail;
 }
 
-
-inline unsigned long size_buffer(buffer *buffer)
+// consumer side: applies a pending clear
+static inline void apply_clear(buffer *buffer)
 {
-	unsigned long ret = 0;
-
-    pthread_mutex_lock(&buffer->mutex);
+    if (atomic_exchange(&buffer->clear_pending, false))
+    {
+        unsigned long to = buffer->clear_to;
+        if ((long) (to - buffer->tail) > 0)
+        {
+            buffer->tail = to;
+            buffer->read_seq++;
+            if (buffer->writer_waiting)
+                futex_wake(&buffer->read_seq);
+        }
+    }
+}
 
-	ret = ring_buffer_count_bytes(&buffer->buf);
+inline unsigned long free_size_buffer(buffer *buffer)
+{
+    return buffer->buf.count_bytes - (buffer->head - effective_tail(buffer));
+}
 
-	pthread_mutex_unlock(&buffer->mutex);
 
-	return ret;
+inline unsigned long size_buffer(buffer *buffer)
+{
+    return buffer->head - effective_tail(buffer);
 }
 
-inline void read_buffer(buffer *buf_in, uint8_t *buffer_out, int size) {
-    void *addr;
+// Zero copy access: *_acquire() waits for size bytes of data (or of free
+// space) and returns a pointer straight into the ring, contiguous thanks to
+// the second mapping, and *_commit() releases them to the other side.
+// Each side may hold just one acquired span at a time.
+uint8_t *read_acquire(buffer *buf_in, int size)
+{
+    apply_clear(buf_in);
 
-try_again_read:
-    pthread_mutex_lock( &buf_in->mutex );
-    if ( ring_buffer_count_bytes( &buf_in->buf ) >= size )
+    // announce the wait, then check again: either the writer sees the flag,
+    // or we see its data (and the futex returns at once if write_seq moved)
+    while (buf_in->head - buf_in->tail < (unsigned long) size)
     {
-        addr = ring_buffer_read_address( &buf_in->buf );
-        memcpy( buffer_out, addr, size );
-        ring_buffer_read_advance( &buf_in->buf, size );
-        pthread_cond_signal( &buf_in->cond );
-        pthread_mutex_unlock( &buf_in->mutex );
+        uint32_t seq = buf_in->write_seq;
+        buf_in->reader_waiting = true;
+        if (buf_in->head - buf_in->tail >= (unsigned long) size)
+            break;
+        futex_wait(&buf_in->write_seq, seq);
+        apply_clear(buf_in);
     }
-    else
+    buf_in->reader_waiting = false;
+
+    return (uint8_t *) buf_in->buf.address + (buf_in->tail & (buf_in->buf.count_bytes - 1));
+}
+
+void read_commit(buffer *buf_in, int size)
+{
+    buf_in->tail += size;
+    buf_in->read_seq++;
+    if (buf_in->writer_waiting)
+        futex_wake(&buf_in->read_seq);
+}
+
+uint8_t *write_acquire(buffer *buf_out, int size)
+{
+    while (buf_out->buf.count_bytes - (buf_out->head - buf_out->tail) < (unsigned long) size)
     {
-        pthread_cond_wait( &buf_in->cond, &buf_in->mutex );
-        pthread_mutex_unlock( &buf_in->mutex );
-        goto try_again_read;
+        uint32_t seq = buf_out->read_seq;
+        buf_out->writer_waiting = true;
+        if (buf_out->buf.count_bytes - (buf_out->head - buf_out->tail) >= (unsigned long) size)
+            break;
+        futex_wait(&buf_out->read_seq, seq);
     }
+    buf_out->writer_waiting = false;
 
+    return (uint8_t *) buf_out->buf.address + (buf_out->head & (buf_out->buf.count_bytes - 1));
+}
 
+void write_commit(buffer *buf_out, int size)
+{
+    buf_out->head += size;
+    buf_out->write_seq++;
+    if (buf_out->reader_waiting)
+        futex_wake(&buf_out->write_seq);
 }
 
-inline void write_buffer(buffer *buf_out, uint8_t *buffer_in, int size) {
-    void *addr;
+// consumer side: drops the oldest data, leaving at most keep bytes (a
+// multiple of the frame size). Returns the number of bytes dropped.
+unsigned long drop_buffer(buffer *buf_in, unsigned long keep)
+{
+    apply_clear(buf_in);
 
-try_again_write:
-    pthread_mutex_lock( &buf_out->mutex );
-    if ( ring_buffer_count_free_bytes ( &buf_out->buf ) >= size)
-    {
-        addr = ring_buffer_write_address( &buf_out->buf );
-        memcpy( addr, buffer_in, size );
-        ring_buffer_write_advance ( &buf_out->buf, size );
-        pthread_cond_signal( &buf_out->cond );
-        pthread_mutex_unlock( &buf_out->mutex );
-    }
-    else
-    {
-        pthread_cond_wait( &buf_out->cond, &buf_out->mutex );
-        pthread_mutex_unlock( &buf_out->mutex );
-        goto try_again_write;
-    }
+    unsigned long size = buf_in->head - buf_in->tail;
+    if (size <= keep)
+        return 0;
+
+    read_commit(buf_in, size - keep);
+    return size - keep;
+}
+
+inline void read_buffer(buffer *buf_in, uint8_t *buffer_out, int size) {
+    memcpy(buffer_out, read_acquire(buf_in, size), size);
+    read_commit(buf_in, size);
+}
+
+inline void write_buffer(buffer *buf_out, uint8_t *buffer_in, int size) {
+    memcpy(write_acquire(buf_out, size), buffer_in, size);
+    write_commit(buf_out, size);
 }
 
 void initialize_buffer(buffer *buf, int mag) // size is 2^mag
 {
-    pthread_mutex_init( &buf->mutex, NULL );
-    pthread_cond_init( &buf->cond, NULL );
     ring_buffer_create( &buf->buf, mag );
+    buf->head = 0;
+    buf->tail = 0;
+    buf->write_seq = 0;
+    buf->read_seq = 0;
+    buf->reader_waiting = false;
+    buf->writer_waiting = false;
+    buf->clear_to = 0;
+    buf->clear_pending = false;
 }
 
+// drops everything written so far, from either side of the ring
 void clear_buffer (buffer *buffer)
 {
-    pthread_mutex_lock( &buffer->mutex );
-    ring_buffer_clear(&buffer->buf);
-    pthread_mutex_unlock( &buffer->mutex );
-
+    buffer->clear_to = buffer->head;
+    buffer->clear_pending = true;
 }
 
 void initialize_buffers()
@@ -133,6 +206,9 @@ void initialize_buffers()
     static buffer loopback_to_dsp_int;
     loopback_to_dsp = &loopback_to_dsp_int;
 
+    static buffer tx_monitor_int;
+    tx_monitor = &tx_monitor_int;
+
     initialize_buffer(radio_to_dsp, 18);
     initialize_buffer(dsp_to_radio, 18);
 
@@ -141,4 +217,6 @@ void initialize_buffers()
 
     initialize_buffer(dsp_to_loopback, 18);
     initialize_buffer(loopback_to_dsp, 18);
+
+    initialize_buffer(tx_monitor, 18);
 }
@@ -20,6 +20,7 @@
 #define HAVE_BUFFER_H__
 
 #include <stdint.h>
+#include <stdbool.h>
 #include <pthread.h>
 
 #include "ring_buffer.h"
@@ -28,20 +29,42 @@
 extern "C" {
 #endif
 
+// Lock-free single producer / single consumer ring over the double mapped
+// memory of ring_buffer.c. head and tail run freely (the offset in the ring
+// is pos & (size - 1)), and each one is written by just one side. A side
+// only sleeps (futex) when the ring is empty (reader) or full (writer).
 typedef struct
 {
-    pthread_mutex_t    mutex;
-    pthread_cond_t     cond;
-    struct ring_buffer buf;
+    struct ring_buffer buf; // double mapped memory, buf.count_bytes is the size
+
+    _Alignas(64) _Atomic unsigned long head; // bytes written, producer only
+    _Atomic uint32_t write_seq; // futex word, bumped at each write
+    _Atomic bool reader_waiting;
+
+    _Alignas(64) _Atomic unsigned long tail; // bytes read, consumer only
+    _Atomic uint32_t read_seq; // futex word, bumped at each read
+    _Atomic bool writer_waiting;
+
+    // clear_buffer() may be called by either side, the consumer drops the
+    // data up to clear_to at its next read
+    _Alignas(64) _Atomic unsigned long clear_to;
+    _Atomic bool clear_pending;
 } buffer;
 
 extern unsigned long free_size_buffer(buffer *buffer);
 extern unsigned long size_buffer(buffer *buffer);
 extern void read_buffer(buffer *buf_in, uint8_t *buffer_out, int size);
 extern void write_buffer(buffer *buf_out, uint8_t *buffer_in, int size);
+
+// zero copy, see sbitx_buffer.c
+uint8_t *read_acquire(buffer *buf_in, int size);
+void read_commit(buffer *buf_in, int size);
+uint8_t *write_acquire(buffer *buf_out, int size);
+void write_commit(buffer *buf_out, int size);
 void initialize_buffer(buffer *buf, int mag);
 void initialize_buffers();
 void clear_buffer (buffer *buffer);
+unsigned long drop_buffer(buffer *buf_in, unsigned long keep);
 
 
 extern buffer *radio_to_dsp;
@@ -53,6 +76,8 @@ extern buffer *dsp_to_speaker;
 extern buffer *dsp_to_loopback;
 extern buffer *loopback_to_dsp;
 
+extern buffer *tx_monitor; // from the tx dsp to the rx dsp, mixed on the speaker
+
 #ifdef __cplusplus
 };
 #endif
@@ -226,6 +226,15 @@ int main(int argc, char *argv[])
         memcpy(srv_cmd, &bytes, 4);
 
         srv_cmd[4] = CMD_SET_BYTES_TX;
+    }
+    else if (!strcmp(command, "get_xruns"))
+    {
+        if (argument_set == false)
+            goto manual;
+
+        srv_cmd[0] = (uint8_t) atoi(command_argument);
+
+        srv_cmd[4] = CMD_GET_XRUNS;
     }
 	else if (!strcmp(command, "get_txrx_status"))
     {
@@ -307,6 +316,52 @@ int main(int argc, char *argv[])
 
         srv_cmd[4] = CMD_SET_DIGITAL_VOICE | (profile << 6);
     }
+    else if (!strcmp(command, "get_agc"))
+    {
+        srv_cmd[4] = CMD_GET_AGC | (profile << 6);
+    }
+    else if (!strcmp(command, "set_agc"))
+    {
+        if (argument_set == false)
+            goto manual;
+
+        srv_cmd[0] = 0xff;
+
+        if (!strcmp(command_argument, "off") || !strcmp(command_argument, "OFF"))
+            srv_cmd[0] = AGC_OFF;
+
+        if (!strcmp(command_argument, "slow") || !strcmp(command_argument, "SLOW"))
+            srv_cmd[0] = AGC_SLOW;
+
+        if (!strcmp(command_argument, "medium") || !strcmp(command_argument, "MEDIUM"))
+            srv_cmd[0] = AGC_MEDIUM;
+
+        if (!strcmp(command_argument, "fast") || !strcmp(command_argument, "FAST"))
+            srv_cmd[0] = AGC_FAST;
+
+        srv_cmd[4] = CMD_SET_AGC | (profile << 6);
+    }
+    else if (!strcmp(command, "get_compressor"))
+    {
+        srv_cmd[4] = CMD_GET_COMPRESSOR | (profile << 6);
+    }
+    else if (!strcmp(command, "set_compressor"))
+    {
+        if (argument_set == false)
+            goto manual;
+
+        if (!strcmp(command_argument, "1") || !strcmp(command_argument, "true") || !strcmp(command_argument, "on") || !strcmp(command_argument, "ON"))
+            srv_cmd[0] = 0x01;
+
+        if (!strcmp(command_argument, "0") || !strcmp(command_argument, "false") || !strcmp(command_argument, "off") || !strcmp(command_argument, "OFF"))
+            srv_cmd[0] = 0x00;
+
+        srv_cmd[4] = CMD_SET_COMPRESSOR | (profile << 6);
+    }
+    else if (!strcmp(command, "get_signal_level"))
+    {
+        srv_cmd[4] = CMD_GET_SIGNAL_LEVEL;
+    }
     else if (!strcmp(command, "get_serial"))
     {
         srv_cmd[4] = CMD_GET_SERIAL;
@@ -466,6 +521,7 @@ int main(int argc, char *argv[])
         uint32_t status, freq, freqstep, serial, power;
         int32_t timeout, snr;
         uint16_t measure;
+        int16_t level, gain;
         uint8_t tone, profile;
 
 
@@ -576,6 +632,28 @@ int main(int argc, char *argv[])
             memcpy (&status, response+1, 4);
             printf("%u\n", status);
             break;
+        case CMD_RESP_GET_AGC:
+            if (response[1] == AGC_SLOW)
+                printf("SLOW\n");
+            else if (response[1] == AGC_MEDIUM)
+                printf("MEDIUM\n");
+            else if (response[1] == AGC_FAST)
+                printf("FAST\n");
+            else
+                printf("OFF\n");
+            break;
+        case CMD_RESP_GET_COMPRESSOR:
+            printf("%s\n", response[1] ? "ON" : "OFF");
+            break;
+        case CMD_RESP_GET_SIGNAL_LEVEL:
+            memcpy (&level, response+1, 2);
+            memcpy (&gain, response+3, 2);
+            printf("%.1f dBFS %.1f dB\n", level / 10.0, gain / 10.0);
+            break;
+        case CMD_RESP_GET_XRUNS:
+            memcpy (&status, response+1, 4);
+            printf("%u\n", status);
+            break;
         case CMD_RESP_GET_TIMEOUT_ACK:
             memcpy(&timeout, response+1, 4);
             printf("%d\n", timeout);
@@ -0,0 +1,102 @@
+/* sBitx controller - tx speech compressor and clipper
+ *
+ * Copyright (C) 2025 Rhizomatica
+ * Author: Rafael Diniz <rafael@riseup.net>
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ *
+ */
+
+#include <math.h>
+
+#include "sbitx_compressor.h"
+
+// level detector time constants, in seconds: fast enough to catch a
+// syllable, slow enough not to follow the pitch
+#define COMPRESSOR_ATTACK 0.01
+#define COMPRESSOR_RELEASE 0.08
+
+void compressor_init(struct compressor *c, double sample_rate)
+{
+    double chunk_seconds = COMPRESSOR_CHUNK / sample_rate;
+
+    c->attack = (float) (1 - exp(-chunk_seconds / COMPRESSOR_ATTACK));
+    c->release = (float) (1 - exp(-chunk_seconds / COMPRESSOR_RELEASE));
+
+    compressor_reset(c);
+}
+
+void compressor_reset(struct compressor *c)
+{
+    c->fresh = true;
+    c->power = 0;
+    c->gain = 1;
+}
+
+void compressor_process(struct compressor *c, dsp_real *samples, uint32_t n)
+{
+    // the gain computer in the power domain: g = makeup * (P / P_threshold) ^ -slope
+    const float threshold = (float) (COMPRESSOR_CLIP * COMPRESSOR_CLIP * pow(10.0, COMPRESSOR_THRESHOLD_DB / 10.0));
+    const float makeup = (float) pow(10.0, COMPRESSOR_MAKEUP_DB / 20.0);
+    const float slope = (float) ((1 - 1 / COMPRESSOR_RATIO) / 2);
+
+    // soft clipper: linear up to knee, a parabola from knee to 2 * clip - knee
+    // (where it reaches the clip level with a zero slope), flat above it
+    const dsp_real clip = COMPRESSOR_CLIP;
+    const dsp_real knee = COMPRESSOR_KNEE * COMPRESSOR_CLIP;
+    const dsp_real top = 2 * clip - knee;
+    const dsp_real curve = 1 / (4 * (clip - knee));
+
+    float power = c->power, gain = c->gain;
+
+    for (uint32_t k = 0; k < n; k += COMPRESSOR_CHUNK)
+    {
+        dsp_real *x = samples + k;
+
+        // both loops below are vectorized (-Ofast)
+        dsp_real sum = 0;
+        for (uint32_t i = 0; i < COMPRESSOR_CHUNK; i++)
+            sum += x[i] * x[i];
+        float p = (float) (sum / COMPRESSOR_CHUNK);
+
+        if (c->fresh)
+            power = p;
+        else
+            power += ((p > power) ? c->attack : c->release) * (p - power);
+
+        float target = makeup;
+        if (power > threshold)
+            target *= powf(power / threshold, -slope);
+
+        if (c->fresh)
+            gain = target;
+
+        const dsp_real g = gain, step = (target - gain) / COMPRESSOR_CHUNK;
+        for (uint32_t i = 0; i < COMPRESSOR_CHUNK; i++)
+        {
+            dsp_real y = x[i] * (g + step * (i + 1));
+            dsp_real a = fabs(y);
+            a = (a < top) ? a : top;
+            dsp_real over = (a > knee) ? a - knee : 0;
+            x[i] = copysign(a - over * over * curve, y);
+        }
+        gain = target;
+        c->fresh = false;
+    }
+
+    c->power = power;
+    c->gain = gain;
+}
@@ -0,0 +1,67 @@
+/* sBitx controller - tx speech compressor and clipper
+ *
+ * Copyright (C) 2025 Rhizomatica
+ * Author: Rafael Diniz <rafael@riseup.net>
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ *
+ */
+
+#ifndef SBITX_COMPRESSOR_H_
+#define SBITX_COMPRESSOR_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "sbitx_dsp.h"
+
+// TX audio processor, in place over the tx input samples, before the tx
+// filter: an RMS compressor in chunks of COMPRESSOR_CHUNK samples (above the
+// threshold the output level grows COMPRESSOR_RATIO times slower than the
+// input, with the makeup gain below it) followed by a soft clipper, linear up
+// to COMPRESSOR_KNEE of the clip level and flat at the clip level. The clipper
+// harmonics and intermodulation outside the passband are removed by the tx
+// filter right after it, which brings the clipped peaks about 1 dB back up:
+// the clip level is 1 dB below the peak of the tx tone (tone_generation), so
+// the compressed speech peaks at the power the band calibration was done with.
+
+#define COMPRESSOR_CHUNK 32
+#define COMPRESSOR_CLIP (0.891 * 1073741824.0 / 4800000000.0) // the tone of dsp_process_tx(), -1 dB
+#define COMPRESSOR_KNEE 0.5
+#define COMPRESSOR_THRESHOLD_DB -40.0 // input RMS, dB from the clip level
+#define COMPRESSOR_RATIO 5.0
+#define COMPRESSOR_MAKEUP_DB 27.0 // -9 dB of RMS out for -20 dB in
+
+struct compressor
+{
+    // per chunk coefficients, from the sample rate
+    float attack;
+    float release;
+
+    bool fresh; // the next chunk starts the level estimate
+    float power; // smoothed mean square of the input
+    float gain;
+};
+
+void compressor_init(struct compressor *c, double sample_rate);
+
+// the next chunk starts the level estimate from scratch
+void compressor_reset(struct compressor *c);
+
+// n a multiple of COMPRESSOR_CHUNK
+void compressor_process(struct compressor *c, dsp_real *samples, uint32_t n);
+
+#endif // SBITX_COMPRESSOR_H_
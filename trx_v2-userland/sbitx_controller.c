@@ -34,6 +34,7 @@
 #include "sbitx_core.h"
 #include "sbitx_websocket.h"
 #include "sbitx_dsp.h"
+#include "sbitx_spectrum.h"
 #include "cfg_utils.h"
 
 _Atomic bool shutdown_ = false;
@@ -55,15 +56,17 @@ int main(int argc, char* argv[])
     pthread_t hw_tids[2]; // 2 hw thread ids user for IO
     pthread_t web_tid; // websocket thread id
     pthread_t shm_tid; // shared memory interface thread id
-    pthread_t control_tid, radio_capture, radio_playback, loop_capture, loop_playback; // audio threads
+    pthread_t spectrum_tid; // rx spectrum thread id
+    pthread_t dsp_rx_tid, dsp_tx_tid, radio_capture, radio_playback, loop_capture, loop_playback; // audio threads
 
    if (argc > 3)
     {
     manual:
-        fprintf(stderr, "Usage modes: \n%s\n%s -c [cpu_nr]\n", argv[0], argv[0]);
+        fprintf(stderr, "Usage modes: \n%s\n%s -c [cpu_nr]\n%s -w\n", argv[0], argv[0], argv[0]);
         fprintf(stderr, "%s -h\n", argv[0]);
         fprintf(stderr, "\nOptions:\n");
         fprintf(stderr, " -c [cpu_nr]                Run on CPU [cpu_br]. Defaults to CPU 3. Use -1 to disable CPU selection\n");
+        fprintf(stderr, " -w                         Generates the FFTW wisdom of this CPU in %s and exits (make install runs it)\n", CFG_WISDOM_DIR);
         fprintf(stderr, " -h                         Prints this help.\n");
         return EXIT_FAILURE;
     }
@@ -71,7 +74,7 @@ int main(int argc, char* argv[])
    // hermes defaults is 3
    int cpu_nr = 3;
    int opt;
-   while ((opt = getopt(argc, argv, "hc:")) != -1)
+   while ((opt = getopt(argc, argv, "hc:w")) != -1)
    {
        switch (opt)
        {
@@ -79,6 +82,8 @@ int main(int argc, char* argv[])
            if(optarg)
                cpu_nr = atoi(optarg);
            break;
+       case 'w':
+           return dsp_wisdom_generate() ? EXIT_SUCCESS : EXIT_FAILURE;
        case 'h':
        default:
            goto manual;
@@ -108,14 +113,22 @@ int main(int argc, char* argv[])
 
    hw_init(&radio_h, hw_tids);
 
+   // before the websocket, which reads the spectrum page
+   spectrum_init(&radio_h, &spectrum_tid);
+
    if (radio_h.enable_websocket)
        websocket_init(&radio_h, CFG_WEBSOCKET_PATH, &web_tid);
 
    if (radio_h.enable_shm_control)
        shm_controller_init(&radio_h, &shm_tid);
 
+   // with the wisdom the plans are ready in milliseconds, without it they are
+   // measured (as before) and the wisdom saved for the next start
+   bool wisdom = dsp_wisdom_load();
    dsp_init(&radio_h);
-   sound_system_init(&radio_h, &control_tid, &radio_capture, &radio_playback, &loop_capture, &loop_playback);
+   if (!wisdom && radio_h.profiles[radio_h.profile_active_idx].operating_mode != OPERATING_MODE_CONTROLS_ONLY)
+       dsp_wisdom_save();
+   sound_system_init(&radio_h, &dsp_rx_tid, &dsp_tx_tid, &radio_capture, &radio_playback, &loop_capture, &loop_playback);
 
    // the next call calls pthread_join(), so it blocks until shutdown == true
    hw_shutdown(&radio_h, hw_tids);
@@ -127,7 +140,8 @@ int main(int argc, char* argv[])
    if (radio_h.enable_shm_control)
        shm_controller_shutdown(&shm_tid);
 
-   sound_system_shutdown(&radio_h, &control_tid, &radio_capture, &radio_playback, &loop_capture, &loop_playback);
+   sound_system_shutdown(&radio_h, &dsp_rx_tid, &dsp_tx_tid, &radio_capture, &radio_playback, &loop_capture, &loop_playback);
+   spectrum_shutdown(&spectrum_tid);
    dsp_free(&radio_h);
 
    return EXIT_SUCCESS;
@@ -0,0 +1,300 @@
+/* sBitx controller - sample format conversion
+ *
+ * Copyright (C) 2025 Rhizomatica
+ * Author: Rafael Diniz <rafael@riseup.net>
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ *
+ */
+
+// Each kernel runs its vector loop first and finishes the last samples with
+// the scalar loop, which is also the whole kernel on other architectures.
+// float -> int is truncation toward zero in all paths, as the C cast.
+
+#include <stdint.h>
+
+#if defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#define CONVERT_NEON
+#elif defined(__SSE4_2__)
+#include <immintrin.h>
+#define CONVERT_SSE
+#endif
+
+#include "sbitx_convert.h"
+
+void deinterleave_s32(const int32_t *in, int32_t *left, int32_t *right, uint32_t frames)
+{
+    uint32_t j = 0;
+#if defined(CONVERT_NEON)
+    for (; j + 4 <= frames; j += 4)
+    {
+        int32x4x2_t v = vld2q_s32(in + 2 * j);
+        vst1q_s32(left + j, v.val[0]);
+        vst1q_s32(right + j, v.val[1]);
+    }
+#elif defined(CONVERT_SSE)
+    for (; j + 4 <= frames; j += 4)
+    {
+        __m128 a = _mm_castsi128_ps(_mm_loadu_si128((const __m128i *) (in + 2 * j))); // l0 r0 l1 r1
+        __m128 b = _mm_castsi128_ps(_mm_loadu_si128((const __m128i *) (in + 2 * j + 4))); // l2 r2 l3 r3
+        _mm_storeu_si128((__m128i *) (left + j), _mm_castps_si128(_mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0))));
+        _mm_storeu_si128((__m128i *) (right + j), _mm_castps_si128(_mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1))));
+    }
+#endif
+    for (; j < frames; j++)
+    {
+        left[j] = in[2 * j];
+        right[j] = in[2 * j + 1];
+    }
+}
+
+void interleave_s32(const int32_t *left, const int32_t *right, int32_t *out, uint32_t frames)
+{
+    uint32_t j = 0;
+#if defined(CONVERT_NEON)
+    for (; j + 4 <= frames; j += 4)
+    {
+        int32x4x2_t v = { { vld1q_s32(left + j), vld1q_s32(right + j) } };
+        vst2q_s32(out + 2 * j, v);
+    }
+#elif defined(CONVERT_SSE)
+    for (; j + 4 <= frames; j += 4)
+    {
+        __m128i l = _mm_loadu_si128((const __m128i *) (left + j));
+        __m128i r = _mm_loadu_si128((const __m128i *) (right + j));
+        _mm_storeu_si128((__m128i *) (out + 2 * j), _mm_unpacklo_epi32(l, r));
+        _mm_storeu_si128((__m128i *) (out + 2 * j + 4), _mm_unpackhi_epi32(l, r));
+    }
+#endif
+    for (; j < frames; j++)
+    {
+        out[2 * j] = left[j];
+        out[2 * j + 1] = right[j];
+    }
+}
+
+#if defined(CONVERT_SSE)
+// 4 samples, mono or the left channel of 8 stereo ones, shifted to 24 bits
+static inline __m128i load_s32x4(const int32_t *in, uint32_t stride)
+{
+    __m128i v;
+    if (stride == 1)
+        v = _mm_loadu_si128((const __m128i *) in);
+    else
+    {
+        __m128 a = _mm_castsi128_ps(_mm_loadu_si128((const __m128i *) in));
+        __m128 b = _mm_castsi128_ps(_mm_loadu_si128((const __m128i *) (in + 4)));
+        v = _mm_castps_si128(_mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)));
+    }
+    return _mm_srai_epi32(v, 8);
+}
+
+// 4 samples, every stride-th one, truncated to int32
+static inline __m128i load_realx4_s32(const dsp_real *in, uint32_t stride, dsp_real scale)
+{
+#ifdef DSP_FLOAT
+    __m128 v;
+    if (stride == 1)
+        v = _mm_loadu_ps(in);
+    else
+        v = _mm_shuffle_ps(_mm_loadu_ps(in), _mm_loadu_ps(in + 4), _MM_SHUFFLE(2, 0, 2, 0));
+    return _mm_cvttps_epi32(_mm_mul_ps(v, _mm_set1_ps(scale)));
+#else
+    __m128d lo, hi;
+    if (stride == 1)
+    {
+        lo = _mm_loadu_pd(in);
+        hi = _mm_loadu_pd(in + 2);
+    }
+    else
+    {
+        lo = _mm_unpacklo_pd(_mm_loadu_pd(in), _mm_loadu_pd(in + 2));
+        hi = _mm_unpacklo_pd(_mm_loadu_pd(in + 4), _mm_loadu_pd(in + 6));
+    }
+    __m128d s = _mm_set1_pd(scale);
+    return _mm_unpacklo_epi64(_mm_cvttpd_epi32(_mm_mul_pd(lo, s)), _mm_cvttpd_epi32(_mm_mul_pd(hi, s)));
+#endif
+}
+#endif
+
+#if defined(CONVERT_NEON)
+static inline int32x4_t load_realx4_s32(const dsp_real *in, uint32_t stride, dsp_real scale)
+{
+#ifdef DSP_FLOAT
+    float32x4_t v = (stride == 1) ? vld1q_f32(in) : vld2q_f32(in).val[0];
+    return vcvtq_s32_f32(vmulq_n_f32(v, scale));
+#else
+    float64x2_t lo, hi;
+    if (stride == 1)
+    {
+        lo = vld1q_f64(in);
+        hi = vld1q_f64(in + 2);
+    }
+    else
+    {
+        lo = vld2q_f64(in).val[0];
+        hi = vld2q_f64(in + 4).val[0];
+    }
+    int32x2_t l = vmovn_s64(vcvtq_s64_f64(vmulq_n_f64(lo, scale)));
+    int32x2_t h = vmovn_s64(vcvtq_s64_f64(vmulq_n_f64(hi, scale)));
+    return vcombine_s32(l, h);
+#endif
+}
+#endif
+
+void convert_s32_to_real(const int32_t *in, uint32_t stride, dsp_real *out, uint32_t n, dsp_real scale)
+{
+    uint32_t i = 0;
+#if defined(CONVERT_NEON)
+    for (; i + 4 <= n; i += 4)
+    {
+        int32x4_t v = (stride == 1) ? vld1q_s32(in + i) : vld2q_s32(in + 2 * i).val[0];
+        v = vshrq_n_s32(v, 8);
+#ifdef DSP_FLOAT
+        vst1q_f32(out + i, vmulq_n_f32(vcvtq_f32_s32(v), scale));
+#else
+        vst1q_f64(out + i, vmulq_n_f64(vcvtq_f64_s64(vmovl_s32(vget_low_s32(v))), scale));
+        vst1q_f64(out + i + 2, vmulq_n_f64(vcvtq_f64_s64(vmovl_s32(vget_high_s32(v))), scale));
+#endif
+    }
+#elif defined(CONVERT_SSE) && defined(__AVX2__)
+    for (; i + 8 <= n; i += 8)
+    {
+        __m256i v;
+        if (stride == 1)
+            v = _mm256_loadu_si256((const __m256i *) (in + i));
+        else
+        {
+            // evens of each lane, then the 64 bit pairs in order
+            __m256i a = _mm256_loadu_si256((const __m256i *) (in + 2 * i));
+            __m256i b = _mm256_loadu_si256((const __m256i *) (in + 2 * i + 8));
+            __m256 e = _mm256_shuffle_ps(_mm256_castsi256_ps(a), _mm256_castsi256_ps(b), _MM_SHUFFLE(2, 0, 2, 0));
+            v = _mm256_permute4x64_epi64(_mm256_castps_si256(e), _MM_SHUFFLE(3, 1, 2, 0));
+        }
+        v = _mm256_srai_epi32(v, 8);
+#ifdef DSP_FLOAT
+        _mm256_storeu_ps(out + i, _mm256_mul_ps(_mm256_cvtepi32_ps(v), _mm256_set1_ps(scale)));
+#else
+        __m256d s = _mm256_set1_pd(scale);
+        _mm256_storeu_pd(out + i, _mm256_mul_pd(_mm256_cvtepi32_pd(_mm256_castsi256_si128(v)), s));
+        _mm256_storeu_pd(out + i + 4, _mm256_mul_pd(_mm256_cvtepi32_pd(_mm256_extracti128_si256(v, 1)), s));
+#endif
+    }
+#elif defined(CONVERT_SSE)
+    for (; i + 4 <= n; i += 4)
+    {
+        __m128i v = load_s32x4(in + i * stride, stride);
+#ifdef DSP_FLOAT
+        _mm_storeu_ps(out + i, _mm_mul_ps(_mm_cvtepi32_ps(v), _mm_set1_ps(scale)));
+#else
+        __m128d s = _mm_set1_pd(scale);
+        _mm_storeu_pd(out + i, _mm_mul_pd(_mm_cvtepi32_pd(v), s));
+        _mm_storeu_pd(out + i + 2, _mm_mul_pd(_mm_cvtepi32_pd(_mm_unpackhi_epi64(v, v)), s));
+#endif
+    }
+#endif
+    for (; i < n; i++)
+        out[i] = (dsp_real) (in[i * stride] >> 8) * scale;
+}
+
+void convert_real_to_s32(const dsp_real *in, uint32_t stride, int32_t *out, uint32_t n, dsp_real scale, int shift)
+{
+    uint32_t i = 0;
+#if defined(CONVERT_NEON)
+    int32x4_t sh = vdupq_n_s32(shift);
+    for (; i + 4 <= n; i += 4)
+        vst1q_s32(out + i, vshlq_s32(load_realx4_s32(in + i * stride, stride, scale), sh));
+#elif defined(CONVERT_SSE)
+    __m128i sh = _mm_cvtsi32_si128(shift);
+    for (; i + 4 <= n; i += 4)
+        _mm_storeu_si128((__m128i *) (out + i), _mm_sll_epi32(load_realx4_s32(in + i * stride, stride, scale), sh));
+#endif
+    for (; i < n; i++)
+        out[i] = (int32_t) (in[i * stride] * scale) << shift;
+}
+
+void convert_real_to_s32_rx(const dsp_real *in, int32_t *speaker, int32_t *loopback, uint32_t n, dsp_real scale)
+{
+    uint32_t i = 0;
+#if defined(CONVERT_NEON)
+    for (; i + 4 <= n; i += 4)
+    {
+        int32x4_t v = load_realx4_s32(in + i, 1, scale);
+        vst1q_s32(speaker + i, vshlq_n_s32(v, 8));
+        // x0 x0 x2 x2: L = R at 48 kHz
+        vst1q_s32(loopback + i, vshlq_n_s32(vtrn1q_s32(v, v), 4));
+    }
+#elif defined(CONVERT_SSE)
+    for (; i + 4 <= n; i += 4)
+    {
+        __m128i v = load_realx4_s32(in + i, 1, scale);
+        _mm_storeu_si128((__m128i *) (speaker + i), _mm_slli_epi32(v, 8));
+        _mm_storeu_si128((__m128i *) (loopback + i), _mm_slli_epi32(_mm_shuffle_epi32(v, _MM_SHUFFLE(2, 2, 0, 0)), 4));
+    }
+#endif
+    for (; i < n; i++)
+    {
+        int32_t s = (int32_t) (in[i] * scale);
+        if ((i % 2) == 0)
+        {
+            loopback[i] = s << 4;
+            if (i + 1 < n)
+                loopback[i + 1] = loopback[i];
+        }
+        speaker[i] = s << 8;
+    }
+}
+
+void convert_real_to_float(const dsp_real *in, float *out, uint32_t n)
+{
+    uint32_t i = 0;
+#ifndef DSP_FLOAT
+#if defined(CONVERT_NEON)
+    for (; i + 4 <= n; i += 4)
+        vst1q_f32(out + i, vcombine_f32(vcvt_f32_f64(vld1q_f64(in + i)), vcvt_f32_f64(vld1q_f64(in + i + 2))));
+#elif defined(CONVERT_SSE)
+    for (; i + 4 <= n; i += 4)
+        _mm_storeu_ps(out + i, _mm_movelh_ps(_mm_cvtpd_ps(_mm_loadu_pd(in + i)), _mm_cvtpd_ps(_mm_loadu_pd(in + i + 2))));
+#endif
+#endif
+    for (; i < n; i++)
+        out[i] = (float) in[i];
+}
+
+void convert_float_to_real(const float *in, dsp_real *out, uint32_t n)
+{
+    uint32_t i = 0;
+#ifndef DSP_FLOAT
+#if defined(CONVERT_NEON)
+    for (; i + 4 <= n; i += 4)
+    {
+        float32x4_t v = vld1q_f32(in + i);
+        vst1q_f64(out + i, vcvt_f64_f32(vget_low_f32(v)));
+        vst1q_f64(out + i + 2, vcvt_high_f64_f32(v));
+    }
+#elif defined(CONVERT_SSE)
+    for (; i + 4 <= n; i += 4)
+    {
+        __m128 v = _mm_loadu_ps(in + i);
+        _mm_storeu_pd(out + i, _mm_cvtps_pd(v));
+        _mm_storeu_pd(out + i + 2, _mm_cvtps_pd(_mm_movehl_ps(v, v)));
+    }
+#endif
+#endif
+    for (; i < n; i++)
+        out[i] = (dsp_real) in[i];
+}
@@ -0,0 +1,54 @@
+/* sBitx controller - sample format conversion
+ *
+ * Copyright (C) 2025 Rhizomatica
+ * Author: Rafael Diniz <rafael@riseup.net>
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ *
+ */
+
+#ifndef SBITX_CONVERT_H_
+#define SBITX_CONVERT_H_
+
+#include <stdint.h>
+
+#include "sbitx_dsp.h"
+
+// Kernels for the samples crossing the S32_LE <-> dsp_real boundary. The
+// wm8731 packs 24 bit samples in the MSB of the 32 bit word. NEON on aarch64,
+// SSE4.2 (x86-64-v2) or AVX2 (x86-64-v3) on x86, scalar elsewhere. Unaligned
+// pointers are fine, any n is fine.
+
+// stereo frames <-> two mono blocks
+void deinterleave_s32(const int32_t *in, int32_t *left, int32_t *right, uint32_t frames);
+void interleave_s32(const int32_t *left, const int32_t *right, int32_t *out, uint32_t frames);
+
+// out[i] = (in[i * stride] >> 8) * scale, stride 1 (mono) or 2 (left of stereo)
+void convert_s32_to_real(const int32_t *in, uint32_t stride, dsp_real *out, uint32_t n, dsp_real scale);
+
+// out[i] = (int32_t) (in[i * stride] * scale) << shift, stride 1, or 2 for
+// the real parts of a complex block
+void convert_real_to_s32(const dsp_real *in, uint32_t stride, int32_t *out, uint32_t n, dsp_real scale, int shift);
+
+// rx output: 96 kHz mono speaker (<< 8), and the 48 kHz stereo loopback
+// (<< 4, every other sample on both channels), n speaker samples
+void convert_real_to_s32_rx(const dsp_real *in, int32_t *speaker, int32_t *loopback, uint32_t n, dsp_real scale);
+
+// double <-> float, for the float only csdr functions
+void convert_real_to_float(const dsp_real *in, float *out, uint32_t n);
+void convert_float_to_real(const float *in, dsp_real *out, uint32_t n);
+
+#endif // SBITX_CONVERT_H_
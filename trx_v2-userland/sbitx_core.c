@@ -37,6 +37,7 @@
 #include "sbitx_si5351.h"
 #include "sbitx_alsa.h"
 #include "sbitx_dsp.h"
+#include "sbitx_cw.h"
 
 extern _Atomic bool shutdown_;
 extern _Atomic bool tx_starting;
@@ -230,6 +231,70 @@ void set_digital_voice(radio *radio_h, bool digital_voice, uint32_t profile)
     radio_h->cfg_user_dirty = true;
 }
 
+const char *agc_names[] = { "OFF", "SLOW", "MEDIUM", "FAST" };
+
+void set_agc(radio *radio_h, uint16_t agc, uint32_t profile)
+{
+    if (profile >= radio_h->profiles_count)
+    {
+        printf("Error: Profile index out of bounds\n");
+        return;
+    }
+
+    if (agc > AGC_FAST)
+    {
+        printf("Error: Invalid AGC %u\n", agc);
+        return;
+    }
+
+    if (radio_h->profiles[profile].agc == agc)
+        return;
+
+    radio_h->profiles[profile].agc = agc;
+
+    char tmp1[64];
+    sprintf(tmp1, "profile%u:agc", profile);
+    int rc = cfg_set(radio_h, radio_h->cfg_user, tmp1, agc_names[agc]);
+    if (rc != 0)
+        printf("Error modifying config file\n");
+
+    radio_h->cfg_user_dirty = true;
+}
+
+void set_compressor(radio *radio_h, uint16_t compressor, uint32_t profile)
+{
+    if (profile >= radio_h->profiles_count)
+    {
+        printf("Error: Profile index out of bounds\n");
+        return;
+    }
+
+    if (compressor != COMPRESSOR_OFF && compressor != COMPRESSOR_ON)
+    {
+        printf("Error: Invalid compressor %u\n", compressor);
+        return;
+    }
+
+    if (radio_h->profiles[profile].compressor == compressor)
+        return;
+
+    radio_h->profiles[profile].compressor = compressor;
+
+    char tmp1[64];
+    sprintf(tmp1, "profile%u:compressor", profile);
+    int rc = cfg_set(radio_h, radio_h->cfg_user, tmp1, (compressor == COMPRESSOR_ON) ? "ON" : "OFF");
+    if (rc != 0)
+        printf("Error modifying config file\n");
+
+    radio_h->cfg_user_dirty = true;
+}
+
+// during tx the speaker is muted, unless the tx monitor is on
+static uint32_t tx_speaker_level(radio *radio_h, uint32_t profile)
+{
+    return radio_h->tx_monitor_level ? radio_h->profiles[profile].speaker_level : 0;
+}
+
 void set_profile(radio *radio_h, uint32_t profile)
 {
     if (radio_h->profile_active_idx == profile)
@@ -247,7 +312,7 @@ void set_profile(radio *radio_h, uint32_t profile)
     // and now the alsa levels
     if (radio_h->txrx_state == IN_TX)
     {
-        set_speaker_level(0);
+        set_speaker_level(tx_speaker_level(radio_h, profile));
         set_tx_level(radio_h->profiles[profile].tx_level);
     }
     else
@@ -277,7 +342,7 @@ void set_speaker_volume(radio *radio_h, uint32_t speaker_level, uint32_t profile
 
     radio_h->profiles[profile].speaker_level = speaker_level;
 
-    if (profile == radio_h->profile_active_idx)
+    if (profile == radio_h->profile_active_idx && (radio_h->txrx_state == IN_RX || radio_h->tx_monitor_level))
     {
         set_speaker_level(speaker_level);
     }
@@ -468,7 +533,7 @@ void tr_switch(radio *radio_h, bool txrx_state)
         tx_starting = true;
         radio_h->txrx_state = IN_TX;
 
-        set_speaker_level(0);
+        set_speaker_level(tx_speaker_level(radio_h, radio_h->profile_active_idx));
         set_tx_level(radio_h->profiles[radio_h->profile_active_idx].tx_level);
 
         lpf_off(radio_h);
@@ -504,6 +569,8 @@ void io_tick(radio *radio_h)
 {
     static uint64_t ticks = 0;
     static bool last_key_state = false;
+    static bool cw_break_in = false;
+    static uint32_t cw_hang = 0; // io ticks to the end of the break-in
     _Atomic uint32_t freq = radio_h->profiles[radio_h->profile_active_idx].freq;
     _Atomic uint32_t volume = radio_h->profiles[radio_h->profile_active_idx].speaker_level;
     _Atomic uint32_t tuning_step = radio_h->step_size;
@@ -526,6 +593,27 @@ void io_tick(radio *radio_h)
         last_key_state = radio_h->key_down;
     }
 
+    // cw break-in: the key (DASH) switches to tx, and back to rx
+    // CW_BREAK_IN_HANG_MS after the last key up. The ptt takes over from it.
+    radio_profile *profile = &radio_h->profiles[radio_h->profile_active_idx];
+    bool cw_keying = profile->mode == MODE_CW && profile->enable_ptt && !radio_h->key_down;
+    if (cw_keying && radio_h->dash_down)
+    {
+        if (!cw_break_in && radio_h->txrx_state == IN_RX)
+        {
+            tr_switch(radio_h, IN_TX);
+            cw_break_in = true;
+        }
+        cw_hang = CW_BREAK_IN_HANG_MS / 10;
+        timer_reset = true; // reset the profile timer
+    }
+    else if (cw_break_in && (!cw_keying || --cw_hang == 0))
+    {
+        if (!radio_h->key_down)
+            tr_switch(radio_h, IN_RX);
+        cw_break_in = false;
+    }
+
     // a speed up if one tunes the knob fast
     if(radio_h->tuning_ticks)
     {
@@ -28,6 +28,10 @@
 #define CFG_WEBSOCKET_PATH "/etc/sbitx/web"
 #define CFG_SSL_CERT "/etc/ssl/certs/hermes.radio.crt"
 #define CFG_SSL_KEY "/etc/ssl/private/hermes.radio.key"
+#ifndef CFG_WISDOM_DIR
+#define CFG_WISDOM_DIR "/var/lib/sbitx" // fftw wisdom, written by sbitx_controller -w (make install)
+#endif
+#define CFG_WISDOM_DIR_RO "/etc/sbitx" // or shipped read only with the image
 
 #include <stdbool.h>
 #include <stdint.h>
@@ -74,9 +78,17 @@
 #define AGC_MEDIUM 2
 #define AGC_FAST 3
 
+// the AGC_* names of the config file and the status
+extern const char *agc_names[];
+
 #define COMPRESSOR_OFF 0
 #define COMPRESSOR_ON 1
 
+/* tx test tones */
+#define TONE_OFF 0
+#define TONE_SINGLE 1 // 1 kHz, tuning and power calibration
+#define TONE_TWO 2 // 700 and 1900 Hz, IMD test
+
 /* tx/rx states */
 #define IN_RX 0
 #define IN_TX 1
@@ -115,7 +127,7 @@ typedef struct {
     // In OPERATING_MODE_CONTROLS_ONLY, most of these will just be ignored...
     _Atomic uint16_t mode; // MODE_*
     _Atomic uint16_t agc; // AGC_*
-    _Atomic uint16_t compressor; // COMPRESSOR_*
+    _Atomic uint16_t compressor; // COMPRESSOR_*, see sbitx_compressor.h
 
     // Alsa levels
     _Atomic uint32_t mic_level; // 0 - 100
@@ -135,6 +147,9 @@ typedef struct {
 
     // digital voice mode
     _Atomic bool digital_voice;
+
+    // rx noise reduction, see sbitx_denoise.h
+    _Atomic bool denoise;
 } radio_profile;
 
 
@@ -153,7 +168,8 @@ typedef struct
     _Atomic bool txrx_state; // IN_RX or IN_TX
     _Atomic uint32_t reflected_threshold; // vswr * 10
     _Atomic bool swr_protection_enabled;
-    _Atomic bool tone_generation;
+    _Atomic uint8_t tone_generation; // TONE_*
+    _Atomic uint32_t tx_monitor_level; // tx audio on the speaker during tx, 0 (off) to 100
 
     // front panel controls and status
     encoder enc_a;
@@ -188,6 +204,21 @@ typedef struct
     // read just at load, no need for atomic
     power_settings band_power[MAX_CAL_BANDS];
     uint32_t band_power_count;
+    uint32_t rx_decimation; // 1 (off), 2 (default), 4 or 8
+    uint32_t dsp_block_size; // 256, 512 or 1024 (default) samples
+    int32_t alsa_cpu, dsp_rx_cpu, dsp_tx_cpu; // core of the audio threads, -1 for not pinned
+    int32_t alsa_priority, dsp_rx_priority, dsp_tx_priority; // SCHED_FIFO priority, 0 for SCHED_OTHER
+    bool full_duplex; // rx dsp keeps running (muted) during tx, no restart at the end of tx
+    bool loopback_resampler; // the loopback threads follow the snd-aloop clock drift, see sbitx_resampler.h
+    uint32_t spectrum_fps; // rx spectrum frames per second, 0 for off, see sbitx_spectrum.h
+    uint32_t spectrum_bins; // bins of a spectrum frame, a power of two up to SPECTRUM_MAX_BINS
+    uint32_t cw_pitch; // Hz, the cw tone on tx and the rx filter center, see sbitx_cw.h
+    uint32_t cw_bandwidth; // Hz, of the cw rx and tx filters
+
+    // rx audio level before the agc and the agc gain, written by the rx dsp,
+    // sent to ui (see sbitx_agc.h)
+    _Atomic int32_t signal_level; // dBFS * 10
+    _Atomic int32_t agc_gain; // dB * 10
 
     // information written by modem, sent to ui
     _Atomic uint32_t bitrate;
@@ -232,6 +263,8 @@ void set_serial(radio *radio_h, uint32_t serial); // set internal serial number
 void set_profile_timeout(radio *radio_h, int32_t timeout);
 void set_power_knob(radio *radio_h, uint16_t power_level, uint32_t profile);
 void set_digital_voice(radio *radio_h, bool digital_voice, uint32_t profile);
+void set_agc(radio *radio_h, uint16_t agc, uint32_t profile);
+void set_compressor(radio *radio_h, uint16_t compressor, uint32_t profile);
 
 // TX/RX switch
 void tr_switch(radio *radio_h, bool txrx_state);
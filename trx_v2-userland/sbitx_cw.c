@@ -0,0 +1,369 @@
+/* sBitx controller - cw keyer and decoder
+ *
+ * Copyright (C) 2025 Rhizomatica
+ * Author: Rafael Diniz <rafael@riseup.net>
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ *
+ */
+
+#include <string.h>
+#include <math.h>
+#include <stdatomic.h>
+
+#include "sbitx_cw.h"
+
+#define NS_PER_SAMPLE (1e9 / 96000)
+
+// key edges, gpio thread -> tx dsp
+struct cw_event
+{
+    uint64_t t_ns;
+    bool down;
+};
+static struct cw_event events[CW_EVENTS];
+static _Atomic uint32_t events_head, events_tail;
+
+// decoded text, rx dsp -> websocket
+static char text[CW_TEXT_SIZE];
+static _Atomic uint32_t text_head, text_tail;
+
+_Atomic uint32_t cw_rx_wpm;
+
+// raised cosine, 0 to 1 over CW_RISE_SAMPLES
+static float ramp_table[CW_RISE_SAMPLES + 1];
+
+void cw_key_event(bool down, uint64_t t_ns)
+{
+    uint32_t head = atomic_load_explicit(&events_head, memory_order_relaxed);
+
+    // full, the tx dsp is not reading them
+    if (head - atomic_load_explicit(&events_tail, memory_order_acquire) == CW_EVENTS)
+        return;
+
+    events[head % CW_EVENTS].t_ns = t_ns;
+    events[head % CW_EVENTS].down = down;
+    atomic_store_explicit(&events_head, head + 1, memory_order_release);
+}
+
+static bool event_peek(struct cw_event *e)
+{
+    uint32_t tail = atomic_load_explicit(&events_tail, memory_order_relaxed);
+
+    if (tail == atomic_load_explicit(&events_head, memory_order_acquire))
+        return false;
+
+    *e = events[tail % CW_EVENTS];
+    return true;
+}
+
+static void event_pop()
+{
+    atomic_fetch_add_explicit(&events_tail, 1, memory_order_release);
+}
+
+void cw_tx_init(struct cw_tx *k, uint32_t pitch)
+{
+    for (uint32_t i = 0; i <= CW_RISE_SAMPLES; i++)
+        ramp_table[i] = (float) (0.5 - 0.5 * cos(M_PI * i / CW_RISE_SAMPLES));
+
+    k->pitch = pitch;
+    nco_init(&k->osc, 96000);
+    nco_tone(&k->osc, 0, pitch, CW_LEVEL);
+    k->late = 0;
+
+    cw_tx_reset(k);
+}
+
+void cw_tx_reset(struct cw_tx *k)
+{
+    k->fresh = true;
+    k->key = false;
+    k->ramp = 0;
+    nco_reset(&k->osc);
+}
+
+// the envelope over n samples of the tone
+static void cw_tx_render(struct cw_tx *k, dsp_real *out, uint32_t n)
+{
+    uint32_t ramp = k->ramp;
+    uint32_t i = 0;
+
+    // the ramp, then the steady key on or off
+    for (; i < n && (k->key ? ramp < CW_RISE_SAMPLES : ramp > 0); i++)
+    {
+        ramp += k->key ? 1 : -1;
+        out[i] *= ramp_table[ramp];
+    }
+    if (!k->key)
+        memset(out + i, 0, (n - i) * sizeof(dsp_real));
+
+    k->ramp = ramp;
+}
+
+void cw_tx_process(struct cw_tx *k, dsp_real *out, uint32_t n, uint64_t now_ns)
+{
+    const uint64_t lag = (uint64_t) (n * NS_PER_SAMPLE) + CW_MARGIN_NS;
+    struct cw_event e;
+
+    if (k->fresh)
+    {
+        // the timeline starts at the edge which switched to tx, if any
+        while (event_peek(&e) && e.t_ns + CW_STALE_NS < now_ns)
+            event_pop();
+
+        uint64_t origin = event_peek(&e) ? e.t_ns : now_ns;
+        if (origin + lag > now_ns)
+            origin = now_ns - lag;
+
+        k->origin_ns = origin;
+        k->samples = 0;
+        k->fresh = false;
+    }
+
+    double start_ns = k->origin_ns + k->samples * NS_PER_SAMPLE;
+    nco_fill(&k->osc, out, n);
+    uint32_t i = 0;
+
+    while (i < n)
+    {
+        uint32_t end = n;
+        bool edge = event_peek(&e);
+
+        if (edge)
+        {
+            double pos = round((e.t_ns - start_ns) / NS_PER_SAMPLE);
+            if (pos < i)
+            {
+                end = i;
+                k->late++;
+            }
+            else if (pos < n)
+                end = (uint32_t) pos;
+            else
+                edge = false;
+        }
+
+        cw_tx_render(k, out + i, end - i);
+        i = end;
+
+        if (edge)
+        {
+            k->key = e.down;
+            event_pop();
+        }
+    }
+
+    k->samples += n;
+}
+
+// decoder
+
+// frames (4 ms) of a dit, from 60 to 5 wpm, and the first guess (20 wpm)
+#define CW_DIT_MIN 5.0f
+#define CW_DIT_MAX 60.0f
+#define CW_DIT_START 15.0f
+
+// mark above the middle between the mark and the noise levels, and at least
+// CW_SNR_ON above the noise (space below CW_SNR_OFF), for CW_DEBOUNCE frames
+#define CW_SNR_ON 3.0f
+#define CW_SNR_OFF 2.0f
+#define CW_DEBOUNCE 2
+
+// frames averaged for the first noise level, before any decision
+#define CW_NOISE_FRAMES 25
+
+static const struct
+{
+    const char *code;
+    char c;
+} morse[] = {
+    { ".-", 'A' }, { "-...", 'B' }, { "-.-.", 'C' }, { "-..", 'D' }, { ".", 'E' }, { "..-.", 'F' },
+    { "--.", 'G' }, { "....", 'H' }, { "..", 'I' }, { ".---", 'J' }, { "-.-", 'K' }, { ".-..", 'L' },
+    { "--", 'M' }, { "-.", 'N' }, { "---", 'O' }, { ".--.", 'P' }, { "--.-", 'Q' }, { ".-.", 'R' },
+    { "...", 'S' }, { "-", 'T' }, { "..-", 'U' }, { "...-", 'V' }, { ".--", 'W' }, { "-..-", 'X' },
+    { "-.--", 'Y' }, { "--..", 'Z' },
+    { "-----", '0' }, { ".----", '1' }, { "..---", '2' }, { "...--", '3' }, { "....-", '4' },
+    { ".....", '5' }, { "-....", '6' }, { "--...", '7' }, { "---..", '8' }, { "----.", '9' },
+    { ".-.-.-", '.' }, { "--..--", ',' }, { "..--..", '?' }, { "-..-.", '/' }, { "-...-", '=' },
+    { "-....-", '-' }, { ".-.-.", '+' }, { "-.--.", '(' }, { "-.--.-", ')' }, { "---...", ':' },
+    { ".--.-.", '@' },
+};
+
+static void text_put(char c)
+{
+    uint32_t head = atomic_load_explicit(&text_head, memory_order_relaxed);
+
+    if (head - atomic_load_explicit(&text_tail, memory_order_acquire) == CW_TEXT_SIZE)
+        return;
+
+    text[head % CW_TEXT_SIZE] = c;
+    atomic_store_explicit(&text_head, head + 1, memory_order_release);
+}
+
+uint32_t cw_text_read(char *buf, uint32_t size)
+{
+    uint32_t tail = atomic_load_explicit(&text_tail, memory_order_relaxed);
+    uint32_t head = atomic_load_explicit(&text_head, memory_order_acquire);
+    uint32_t n = 0;
+
+    while (tail != head && n < size - 1)
+        buf[n++] = text[tail++ % CW_TEXT_SIZE];
+    buf[n] = 0;
+
+    atomic_store_explicit(&text_tail, tail, memory_order_release);
+    return n;
+}
+
+void cw_rx_init(struct cw_rx *d, uint32_t pitch)
+{
+    d->coeff = 2 * cos(2 * M_PI * pitch / 96000.0);
+    cw_rx_reset(d);
+}
+
+void cw_rx_reset(struct cw_rx *d)
+{
+    d->s1 = d->s2 = 0;
+    d->count = 0;
+    d->peak = d->noise = 0;
+    d->frames = 0;
+    d->mark = false;
+    d->run = 0;
+    d->pending = 0;
+    d->dit = CW_DIT_START;
+    d->n_elements = 0;
+    d->in_char = d->in_word = false;
+    cw_rx_wpm = (uint32_t) lrintf(300 / d->dit);
+}
+
+static void cw_rx_char(struct cw_rx *d)
+{
+    char c = '*';
+
+    d->pattern[d->n_elements] = 0;
+    for (uint32_t i = 0; i < sizeof(morse) / sizeof(morse[0]); i++)
+    {
+        if (!strcmp(morse[i].code, d->pattern))
+        {
+            c = morse[i].c;
+            break;
+        }
+    }
+
+    text_put(c);
+    d->n_elements = 0;
+}
+
+static void cw_rx_frame(struct cw_rx *d, float mag)
+{
+    if (d->frames < CW_NOISE_FRAMES)
+    {
+        d->noise += (mag - d->noise) / ++d->frames;
+        d->peak = d->noise;
+        return;
+    }
+
+    float hi = d->noise + 0.5f * (d->peak - d->noise);
+    float lo = d->noise + 0.35f * (d->peak - d->noise);
+    if (hi < CW_SNR_ON * d->noise)
+        hi = CW_SNR_ON * d->noise;
+    if (lo < CW_SNR_OFF * d->noise)
+        lo = CW_SNR_OFF * d->noise;
+
+    // levels: the mark one follows the marks and sinks to the noise in the
+    // spaces, the noise one follows the spaces (and creeps up in the marks,
+    // out of a floor below a noise taken for a mark)
+    if (d->mark)
+    {
+        d->peak += 0.3f * (mag - d->peak);
+        d->noise += 0.0005f * (mag - d->noise);
+    }
+    else
+    {
+        d->peak += 0.002f * (d->noise - d->peak);
+        if (mag < hi)
+            d->noise += 0.02f * (mag - d->noise);
+    }
+
+    bool want = d->mark ? (mag > lo) : (mag > hi);
+
+    // a state lasts at least CW_DEBOUNCE frames, both edges are delayed alike
+    if (want == d->mark)
+    {
+        d->run++;
+        d->pending = 0;
+    }
+    else if (++d->pending < CW_DEBOUNCE)
+        d->run++;
+    else
+    {
+        uint32_t len = d->run + 1 - d->pending;
+
+        if (d->mark)
+        {
+            bool dah = len >= 2 * d->dit;
+            if (d->n_elements < sizeof(d->pattern) - 1)
+                d->pattern[d->n_elements++] = dah ? '-' : '.';
+
+            d->dit += 0.25f * ((dah ? len / 3.0f : len) - d->dit);
+            d->dit = (d->dit < CW_DIT_MIN) ? CW_DIT_MIN : (d->dit > CW_DIT_MAX) ? CW_DIT_MAX : d->dit;
+            cw_rx_wpm = (uint32_t) lrintf(300 / d->dit);
+            d->in_char = true;
+        }
+
+        d->mark = want;
+        d->run = d->pending;
+        d->pending = 0;
+    }
+
+    // the gaps: 3 dits between characters, 7 between words
+    if (!d->mark && d->in_char && d->run >= 2 * d->dit)
+    {
+        cw_rx_char(d);
+        d->in_char = false;
+        d->in_word = true;
+    }
+    if (!d->mark && d->in_word && d->run >= 5 * d->dit)
+    {
+        text_put(' ');
+        d->in_word = false;
+    }
+}
+
+void cw_rx_process(struct cw_rx *d, const dsp_real *in, uint32_t n)
+{
+    double s1 = d->s1, s2 = d->s2;
+    const double coeff = d->coeff;
+
+    for (uint32_t i = 0; i < n; i++)
+    {
+        double s0 = in[i] + coeff * s1 - s2;
+        s2 = s1;
+        s1 = s0;
+
+        if (++d->count < CW_FRAME)
+            continue;
+
+        // the amplitude of the tone at the pitch
+        double power = s1 * s1 + s2 * s2 - coeff * s1 * s2;
+        cw_rx_frame(d, (float) (2 * sqrt(power > 0 ? power : 0) / CW_FRAME));
+        s1 = s2 = 0;
+        d->count = 0;
+    }
+
+    d->s1 = s1;
+    d->s2 = s2;
+}
@@ -0,0 +1,116 @@
+/* sBitx controller - cw keyer and decoder
+ *
+ * Copyright (C) 2025 Rhizomatica
+ * Author: Rafael Diniz <rafael@riseup.net>
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ *
+ */
+
+#ifndef SBITX_CW_H_
+#define SBITX_CW_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+
+#include "sbitx_dsp.h"
+#include "sbitx_nco.h"
+
+// Keyer: the gpio thread timestamps each edge of the DASH line (a straight
+// key) and queues it, lock free. The tx dsp renders the edges on a timeline
+// which runs at the sample clock, at least one block plus CW_MARGIN_NS behind
+// the wall clock, so every edge is known before its block is rendered and
+// lands on its own sample: the keying has a constant latency (the t/r switch
+// at the first edge, then the timeline lag) and the jitter of the gpio poll,
+// instead of the jitter of the block boundaries. Each edge starts a
+// CW_RISE_MS raised cosine ramp of a tone at the cw pitch.
+//
+// Decoder: a Goertzel filter at the cw pitch over CW_FRAME samples frames of
+// the rx audio, a mark / space decision against the tracked signal and noise
+// levels (with hysteresis), and the morse timing from an adaptive dit
+// length. The decoded characters are queued for the websocket.
+
+#define CW_RISE_MS 5
+#define CW_RISE_SAMPLES (96 * CW_RISE_MS)
+#define CW_MARGIN_NS 2000000
+#define CW_STALE_NS 200000000 // older edges are dropped at the tx start
+#define CW_EVENTS 64
+#define CW_GPIO_POLL_US 250 // DASH line poll period, in cw mode
+#define CW_BREAK_IN_HANG_MS 300 // back to rx after the last key up
+
+// the tx tone, the power of the band calibration
+#define CW_LEVEL NCO_TONE_LEVEL
+
+#define CW_FRAME 384 // 4 ms
+#define CW_TEXT_SIZE 256
+
+struct cw_tx
+{
+    uint32_t pitch;
+    bool fresh; // the next block starts the timeline
+    uint64_t origin_ns; // timeline time of the sample 0
+    uint64_t samples; // samples rendered since origin_ns
+    bool key;
+    uint32_t ramp; // 0 (off) to CW_RISE_SAMPLES (on)
+    struct nco osc; // the tone, the ramps are applied over it
+    uint32_t late; // edges rendered after their time
+};
+
+struct cw_rx
+{
+    double coeff; // Goertzel, 2 cos(w)
+    double s1, s2;
+    uint32_t count; // samples of the current frame
+    float peak, noise; // tracked magnitude of the marks and of the spaces
+    uint32_t frames; // averaged into the first noise level
+    bool mark;
+    uint32_t run; // frames of the current mark or space
+    uint32_t pending; // frames of the other state, not yet CW_DEBOUNCE
+    float dit; // frames
+    char pattern[8]; // dots and dashes of the current character
+    uint32_t n_elements;
+    bool in_char, in_word;
+};
+
+// words per minute of the decoder
+extern _Atomic uint32_t cw_rx_wpm;
+
+static inline uint64_t cw_now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// gpio thread, a key edge at t_ns (CLOCK_MONOTONIC)
+void cw_key_event(bool down, uint64_t t_ns);
+
+void cw_tx_init(struct cw_tx *k, uint32_t pitch);
+void cw_tx_reset(struct cw_tx *k);
+// tx dsp, the keyed tone of the next n samples (96 kHz), now_ns the time of the call
+void cw_tx_process(struct cw_tx *k, dsp_real *out, uint32_t n, uint64_t now_ns);
+
+void cw_rx_init(struct cw_rx *d, uint32_t pitch);
+void cw_rx_reset(struct cw_rx *d);
+// rx dsp, over the 96 kHz rx audio
+void cw_rx_process(struct cw_rx *d, const dsp_real *in, uint32_t n);
+
+// the decoded text since the last call (at most size - 1 characters, NUL
+// terminated), returns its length
+uint32_t cw_text_read(char *buf, uint32_t size);
+
+#endif // SBITX_CW_H_
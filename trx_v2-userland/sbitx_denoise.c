@@ -0,0 +1,168 @@
+/* sBitx controller - rx spectral noise reduction
+ *
+ * Copyright (C) 2025 Rhizomatica
+ * Author: Rafael Diniz <rafael@riseup.net>
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ *
+ */
+
+#include <string.h>
+#include <math.h>
+#include <float.h>
+
+#include "sbitx_denoise.h"
+
+// power smoothing time constant
+#define POWER_TAU 0.03
+
+// The minimum of the smoothed power of a noise bin sits below its mean, by a
+// factor which depends on the smoothing and the blocks in the window: found
+// at init on simulated noise, times BIAS_CORRELATION for the overlap-save
+// blocks, which are not independent (measured with dsp_bench -e)
+#define BIAS_BLOCKS 100000
+#define BIAS_CORRELATION 1.2
+
+// time constant of the decision directed estimate (0.98 at 10 ms blocks)
+#define DD_TAU 0.5
+
+// the noise estimate of denoise_process() on unit power complex gaussian
+// noise (exponential bin power), deterministic
+static double noise_bias(double smooth, uint32_t sub_blocks)
+{
+    double sub_min[DENOISE_SUBWINDOWS], cur_min = DBL_MAX, noise = DBL_MAX;
+    double s = 1, sum = 0;
+    uint32_t seed = 1, sub_count = 0, sub_idx = 0, n = 0;
+
+    for (uint32_t w = 0; w < DENOISE_SUBWINDOWS; w++)
+        sub_min[w] = DBL_MAX;
+
+    for (uint32_t i = 0; i < BIAS_BLOCKS; i++)
+    {
+        seed = seed * 1664525 + 1013904223;
+        double p = -log(((seed >> 8) + 0.5) / 16777216.0);
+        s = smooth * s + (1 - smooth) * p;
+        if (s < cur_min)
+            cur_min = s;
+
+        // past the first whole window
+        if (i > 2 * DENOISE_SUBWINDOWS * sub_blocks)
+        {
+            sum += (cur_min < noise) ? cur_min : noise;
+            n++;
+        }
+
+        if (++sub_count < sub_blocks)
+            continue;
+        sub_count = 0;
+        sub_min[sub_idx] = cur_min;
+        sub_idx = (sub_idx + 1) % DENOISE_SUBWINDOWS;
+        cur_min = DBL_MAX;
+        noise = sub_min[0];
+        for (uint32_t w = 1; w < DENOISE_SUBWINDOWS; w++)
+            if (sub_min[w] < noise)
+                noise = sub_min[w];
+    }
+
+    return n / sum;
+}
+
+void denoise_reset(struct denoise *d)
+{
+    d->fresh = true;
+}
+
+void denoise_init(struct denoise *d, uint32_t n_bins, double block_seconds)
+{
+    if (n_bins > DENOISE_MAX_BINS)
+        n_bins = DENOISE_MAX_BINS;
+
+    d->n_bins = n_bins;
+    d->smooth = (float) exp(-block_seconds / POWER_TAU);
+    d->dd = (float) exp(-block_seconds / DD_TAU);
+    d->sub_blocks = (uint32_t) ceil(DENOISE_WINDOW / DENOISE_SUBWINDOWS / block_seconds);
+    d->bias = (float) (noise_bias(d->smooth, d->sub_blocks) * BIAS_CORRELATION);
+
+    denoise_reset(d);
+}
+
+void denoise_process(struct denoise *d, dsp_complex *bins)
+{
+    const uint32_t n = d->n_bins;
+    const float smooth = d->smooth, dd = d->dd, bias = d->bias;
+    const float gain_min = (float) pow(10.0, DENOISE_GAIN_MIN_DB / 20.0);
+
+    if (d->fresh)
+    {
+        for (uint32_t k = 0; k < n; k++)
+        {
+            float p = (float) (__real__ bins[k] * __real__ bins[k] + __imag__ bins[k] * __imag__ bins[k]);
+            d->power[k] = p;
+            d->cur_min[k] = FLT_MAX;
+            d->noise[k] = FLT_MAX;
+            d->clean[k] = 0;
+        }
+        for (uint32_t w = 0; w < DENOISE_SUBWINDOWS; w++)
+            for (uint32_t k = 0; k < n; k++)
+                d->sub_min[w][k] = FLT_MAX;
+        d->sub_count = 0;
+        d->sub_idx = 0;
+        d->fresh = false;
+    }
+
+    // noise floor and wiener gain of each bin. A gain smoothed over the
+    // adjacent bins spreads the noise gain onto the signal bins (7 dB worse
+    // with the 256 samples blocks), the decision directed estimate already
+    // keeps it smooth in time
+    for (uint32_t k = 0; k < n; k++)
+    {
+        float p = (float) (__real__ bins[k] * __real__ bins[k] + __imag__ bins[k] * __imag__ bins[k]);
+        float s = smooth * d->power[k] + (1 - smooth) * p;
+        d->power[k] = s;
+        if (s < d->cur_min[k])
+            d->cur_min[k] = s;
+        float noise = (d->cur_min[k] < d->noise[k]) ? d->cur_min[k] : d->noise[k];
+
+        float inv_noise = 1.0f / (noise * bias + 1e-30f);
+        float post = p * inv_noise - 1;
+        float prio = dd * d->clean[k] * inv_noise + (1 - dd) * ((post > 0) ? post : 0);
+        float g = prio / (1 + prio);
+        if (g < gain_min)
+            g = gain_min;
+
+        bins[k] *= g;
+        d->clean[k] = g * g * p;
+    }
+
+    // the current sub window replaces the oldest one
+    if (++d->sub_count < d->sub_blocks)
+        return;
+    d->sub_count = 0;
+
+    float *oldest = d->sub_min[d->sub_idx];
+    memcpy(oldest, d->cur_min, n * sizeof(float));
+    d->sub_idx = (d->sub_idx + 1) % DENOISE_SUBWINDOWS;
+
+    for (uint32_t k = 0; k < n; k++)
+    {
+        float m = d->sub_min[0][k];
+        for (uint32_t w = 1; w < DENOISE_SUBWINDOWS; w++)
+            if (d->sub_min[w][k] < m)
+                m = d->sub_min[w][k];
+        d->noise[k] = m;
+        d->cur_min[k] = FLT_MAX;
+    }
+}
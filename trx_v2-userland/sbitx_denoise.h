@@ -0,0 +1,72 @@
+/* sBitx controller - rx spectral noise reduction
+ *
+ * Copyright (C) 2025 Rhizomatica
+ * Author: Rafael Diniz <rafael@riseup.net>
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ *
+ */
+
+#ifndef SBITX_DENOISE_H_
+#define SBITX_DENOISE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "sbitx_dsp.h"
+
+// Wiener filter on the filtered rx spectrum (the inverse fft input), once per
+// block: the noise power of each bin is the minimum of its smoothed power over
+// the last DENOISE_WINDOW seconds (minimum statistics, kept per sub window),
+// and the gain of the bin follows the a priori SNR, decision directed
+// (Ephraim-Malah), limited to DENOISE_GAIN_MIN_DB.
+
+#define DENOISE_MAX_BINS 2048
+#define DENOISE_GAIN_MIN_DB -15.0
+#define DENOISE_WINDOW 1.5 // longer than the speech, shorter than the band noise changes
+#define DENOISE_SUBWINDOWS 4
+
+struct denoise
+{
+    uint32_t n_bins;
+    bool fresh; // the next block starts the noise estimate
+
+    // per block coefficients, from the block duration
+    float smooth; // power smoothing
+    float dd; // decision directed weight of the previous block
+    float bias; // mean over minimum of the smoothed power of noise
+
+    uint32_t sub_blocks; // blocks per sub window
+    uint32_t sub_count; // blocks of the current sub window
+    uint32_t sub_idx; // the oldest sub window
+
+    float power[DENOISE_MAX_BINS]; // smoothed |X|^2
+    float sub_min[DENOISE_SUBWINDOWS][DENOISE_MAX_BINS]; // minimum of each past sub window
+    float cur_min[DENOISE_MAX_BINS]; // minimum of the current sub window
+    float noise[DENOISE_MAX_BINS]; // minimum of the past sub windows, before the bias
+    float clean[DENOISE_MAX_BINS]; // |G X|^2 of the previous block
+};
+
+// n_bins: size of the spectrum, block_seconds: time between two spectra
+void denoise_init(struct denoise *d, uint32_t n_bins, double block_seconds);
+
+// forget the noise estimate, at the next block it starts from scratch
+void denoise_reset(struct denoise *d);
+
+// in place, over the n_bins bins of the spectrum
+void denoise_process(struct denoise *d, dsp_complex *bins);
+
+#endif // SBITX_DENOISE_H_
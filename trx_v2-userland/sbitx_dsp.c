@@ -28,6 +28,11 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include <stdlib.h>
+#include <ctype.h>
+#include <time.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <pthread.h>
 #include <alsa/asoundlib.h>
 #include <complex.h>
 #include <fftw3.h>
@@ -44,6 +49,13 @@
 #include "sbitx_dsp.h"
 #include "sbitx_core.h"
 #include "sbitx_alsa.h"
+#include "sbitx_convert.h"
+#include "sbitx_spectrum.h"
+#include "sbitx_denoise.h"
+#include "sbitx_agc.h"
+#include "sbitx_compressor.h"
+#include "sbitx_cw.h"
+#include "sbitx_nco.h"
 
 // set 0 for production
 #ifndef DEBUG_DSP_
@@ -58,275 +70,510 @@ extern _Atomic bool shutdown_;
 static radio *radio_h_dsp;
 
 
-#define MAX_BINS 2048
-#define TUNED_BINS 512
+#define MAX_BINS 2048 // fft size of the largest (1024 samples) block
+#define MAX_PARTITIONS 4 // filter partitions of the smallest (256 samples) block
 
 #define MAX_SAMPLE_VALUE 8388607.0 // (2 ^ 23) - 1,  signed(?) 24 bits packed in a SIGNED 32 LE
 
 
-fftw_complex *fft_freq;
-fftw_complex *fft_time;
-fftw_complex *fft_out;		// holds the incoming samples in freq domain (for rx as well as tx)
-fftw_complex *fft_in;			// holds the incoming samples in time domain (for rx as well as tx)
-fftw_complex *fft_m;			// holds previous samples for overlap and discard convolution
+// Partitioned overlap-save: the block size (dsp_block_size in core.ini) is 256,
+// 512 or 1024 samples, the fft is twice the block size, and the 1025 taps
+// filters are split in 1024 / block_size partitions, each one applied to the
+// spectrum of the input block as many blocks ago.
+static uint32_t block_len = MAX_BINS / 2;
+static int n_fft = MAX_BINS;
+static int n_partitions = 1;
+static int hist_stride; // n_fft/2 + 2, keeps every spectrum simd aligned
+
+// The overlap-save state of one direction. RX and TX run in their own
+// threads (see sound_system_init()), so each one has its own buffers, plans
+// and filter in use.
+struct dsp_chain
+{
+    dsp_real *fft_in;       // the previous and the new block, in time domain
+    dsp_real *fft_m;        // holds the previous block for the overlap and discard convolution
+    dsp_complex *fft_hist;  // the r2c spectra (bins 0 to n_fft/2) of the last n_partitions blocks
+    dsp_complex *fft_out;   // the newest of them
+    int hist_idx;
+    dsp_complex *spectra[MAX_PARTITIONS];
+    dsp_complex *fft_freq;  // the filtered spectrum, input of the inverse fft
+    dsp_complex *fft_time;
+    DSP_FFTW(plan) plan_fwd, plan_rev;
+    struct filter_bank_entry * _Atomic filter_in_use;
+};
+
+static struct dsp_chain rx_chain, tx_chain;
+DSP_FFTW(plan) plan_rev_dec;	// smaller inverse fft for the decimated rx mode
+
+// tx from the 48 kHz loopback, same time window as the 96 kHz fft
+dsp_complex *fft_out_48k;
+dsp_real *fft_in_48k;
+dsp_real *fft_m_48k;
+DSP_FFTW(plan) plan_fwd_48k;
+static dsp_real tx_monitor_last; // for the linear interpolation of the 48 kHz tx monitor
+
+// rx decimation mode: 1 (off), or 2, 4 or 8 to run the rx inverse fft at
+// 48, 24 or 12 kHz over the bins of the tuned passband only
+static uint32_t rx_decimation = 2;
+static dsp_real rx_last_sample; // for the linear interpolation back to 96 kHz
+
+// filter design is always in double precision, see window_filter()
 fftw_complex *buffer_filter;  // holds filter fft
-fftw_plan plan_fwd, plan_tx, plan_rev;
 fftw_plan fwd_filter_plan, rev_filter_plan;
 
-struct filter *rx_filter;	// rx convolution filter
-struct filter *tx_filter;	// tx convolution filter
-
-struct vfo tone; // vfo
+// rx noise reduction (the denoise of the profile), over the inverse fft input
+static struct denoise rx_denoise;
+static bool rx_denoise_on;
+
+// rx agc and signal level meter, over rx_output
+static struct agc rx_agc;
+
+// tx compressor (the compressor of the profile), over the mic (96 kHz) or
+// the loopback (48 kHz) input
+static struct compressor tx_comp_96k, tx_comp_48k;
+static bool tx_comp_on;
+
+// tx input of the last block: the 48 kHz loopback (fft_m_48k history) or the
+// 96 kHz mic, test tone or cw (tx_chain.fft_m history)
+static bool tx_path_48k;
+
+// cw keyer (the tx tone, from the DASH line edges) and decoder (over rx_output)
+static struct cw_tx tx_cw;
+static struct cw_rx rx_cw;
+static bool rx_cw_on, tx_cw_on;
+
+// tx test tones (tone_generation): the tuning tone, and the two tones of the
+// IMD test at half the peak each, so both have the same peak power
+#define TONE_HZ 1000
+#define TWO_TONE_LOW_HZ 700
+#define TWO_TONE_HIGH_HZ 1900
+static struct nco tx_tone, tx_two_tone;
+
+// rx audio output (imaginary part of the last n_fft/2 time samples), the agc works in place here
+static dsp_real rx_output[MAX_BINS / 2];
+
+// Filter bank: the bins of every (mode, bpf_low, bpf_high) in use, designed at
+// init for all the profiles (or at the first use of a new one), so a profile
+// or mode switch just publishes another entry.
+// The control threads (shm, websocket, io) publish the entry of the current
+// mode in filter_next, under filter_bank_mutex. Each dsp thread (rx and tx)
+// takes it, lock free, at the start of each block and marks it in the
+// filter_in_use of its chain, so a block always runs with one filter and the
+// bank never rewrites an entry in use.
+#define FILTER_BANK_SIZE (MAX_RADIO_PROFILES + 4)
+static struct filter_bank_entry filter_bank[FILTER_BANK_SIZE];
+static int filter_bank_next; // round robin replacement when the bank is full
+static pthread_mutex_t filter_bank_mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct filter_bank_entry * _Atomic filter_next;
+
+struct filter *design_filter;	// convolution filter design, the same response for rx and tx
 
 _Atomic bool tx_starting = false;
 _Atomic bool rx_starting = false;
 
+// the filter for the next block, called by the dsp thread of the chain at the block boundary
+static inline struct filter_bank_entry *filter_acquire(struct dsp_chain *c)
+{
+    struct filter_bank_entry *e = filter_next;
+
+    // mark it in use, then check it was not replaced meanwhile (after this
+    // check the control threads see the mark and leave the entry alone)
+    while (e != c->filter_in_use)
+    {
+        c->filter_in_use = e;
+        e = filter_next;
+    }
+
+    return e;
+}
+
+// moves fft_out to the oldest spectrum of the partitioned overlap-save history
+static inline void fft_hist_next(struct dsp_chain *c)
+{
+    c->hist_idx = (c->hist_idx + 1) % n_partitions;
+    c->fft_out = c->fft_hist + c->hist_idx * hist_stride;
+}
+
+// the spectra of the current block and of the n_partitions - 1 previous ones
+static inline dsp_complex * const *fft_hist_spectra(struct dsp_chain *c)
+{
+    for (int p = 0; p < n_partitions; p++)
+        c->spectra[p] = c->fft_hist + ((c->hist_idx - p + n_partitions) % n_partitions) * hist_stride;
+
+    return c->spectra;
+}
+
+static void dsp_chain_alloc(struct dsp_chain *c)
+{
+    c->fft_m = DSP_FFTW(alloc_real)(block_len);
+    c->fft_in = DSP_FFTW(alloc_real)(n_fft);
+    c->fft_hist = DSP_FFTW(alloc_complex)(hist_stride * n_partitions);
+    c->fft_out = c->fft_hist;
+    c->hist_idx = 0;
+
+    //create fft complex arrays to convert the frequency back to time
+    c->fft_time = DSP_FFTW(alloc_complex)(n_fft);
+    c->fft_freq = DSP_FFTW(alloc_complex)(n_fft);
+
+    c->filter_in_use = NULL;
+}
+
+static void dsp_chain_plan(struct dsp_chain *c)
+{
+    c->plan_rev = DSP_FFTW(plan_dft_1d)(n_fft, c->fft_freq, c->fft_time, FFTW_BACKWARD, FFTW_MEASURE);
+    // the input is real, r2c does half of the work of a complex fft
+    c->plan_fwd = DSP_FFTW(plan_dft_r2c_1d)(n_fft, c->fft_in, c->fft_out, FFTW_MEASURE);
+}
+
+static void dsp_chain_reset(struct dsp_chain *c)
+{
+    memset(c->fft_in, 0, sizeof(dsp_real) * n_fft);
+    memset(c->fft_hist, 0, sizeof(dsp_complex) * hist_stride * n_partitions);
+    memset(c->fft_m, 0, sizeof(dsp_real) * block_len);
+    memset(c->fft_time, 0, sizeof(dsp_complex) * n_fft);
+    memset(c->fft_freq, 0, sizeof(dsp_complex) * n_fft);
+}
+
+static void dsp_chain_free(struct dsp_chain *c)
+{
+    DSP_FFTW(destroy_plan)(c->plan_rev);
+    DSP_FFTW(destroy_plan)(c->plan_fwd);
+    DSP_FFTW(free)(c->fft_m);
+    DSP_FFTW(free)(c->fft_in);
+    DSP_FFTW(free)(c->fft_hist);
+    DSP_FFTW(free)(c->fft_time);
+    DSP_FFTW(free)(c->fft_freq);
+}
+
+// the rx and the tx states, each one reset by its own dsp thread
+static void dsp_reset_rx()
+{
+    dsp_chain_reset(&rx_chain);
+    rx_last_sample = 0;
+    denoise_reset(&rx_denoise);
+    cw_rx_reset(&rx_cw);
+}
+
+static void dsp_reset_tx()
+{
+    dsp_chain_reset(&tx_chain);
+    memset(fft_in_48k, 0, sizeof(dsp_real) * block_len);
+    memset(fft_out_48k, 0, sizeof(dsp_complex) * (n_fft / 4 + 1));
+    memset(fft_m_48k, 0, sizeof(dsp_real) * block_len / 2);
+    tx_monitor_last = 0;
+    compressor_reset(&tx_comp_96k);
+    compressor_reset(&tx_comp_48k);
+    cw_tx_reset(&tx_cw);
+    nco_reset(&tx_tone);
+    nco_reset(&tx_two_tone);
+}
+
 // - signal_input: 96 kHz mono from radio, get the "slice" between 24 kHz and 27 kHz (USB) or 21 kHz to 24 kHz (LSB), and bring this slice to 0 and 3 kHz
-// - out output_speaker: 96 kHz mono output for speaker
-// - out output_loopback: 48 kHz stereo for loopback input
-// - out output_tx: NULL buffer
+// - out output_speaker: 96 kHz mono output for speaker (zeroed during tx)
+// - out output_loopback: 48 kHz stereo for loopback input (zeroed during tx)
+// - out output_tx: zeroed, or NULL when the tx thread owns it
 // - block_size: number of samples
+// During tx (full_duplex) the chain keeps running, muted and with the agc
+// gain held, so the overlap-save history is warm when the rx is back.
 void dsp_process_rx(uint8_t *signal_input, uint8_t *output_speaker, uint8_t *output_loopback, uint8_t *output_tx, uint32_t block_size)
 {
-    double i_sample;
-
+    struct dsp_chain *c = &rx_chain;
     int32_t *input_rx = (int32_t *) signal_input;
+    bool tx_on = radio_h_dsp->txrx_state == IN_TX;
 
-    //fix the burst at the start of transmission
+    //fix the burst at the start of transmission, when the chain was stopped during tx
     if (rx_starting)
     {
-        fft_reset_m_bins();
-        clear_buffers();
+        if (!radio_h_dsp->full_duplex)
+        {
+            dsp_reset_rx();
+            clear_buffers();
+        }
         rx_starting = false;
     }
 
     //STEP 1: first add the previous M samples to
-    memcpy(fft_in, fft_m, MAX_BINS/2 * sizeof(fftw_complex));
+    memcpy(c->fft_in, c->fft_m, block_len * sizeof(dsp_real));
 
     //STEP 2: then add the new set of samples
-    // m is the index into incoming samples, starting at zero
-    // i is the index into the time samples, picking from
-    // the samples added in the previous step
-    int i, j = 0;
+    // 24 bit audio samples are packed in MSB in the 32 bit word
+    int i, j;
+    convert_s32_to_real(input_rx, 1, c->fft_in + block_len, block_len, (dsp_real) (1.0 / MAX_SAMPLE_VALUE));
+    memcpy(c->fft_m, c->fft_in + block_len, block_len * sizeof(dsp_real));
 
 #if DEBUG_DSP_ == 1
     static double max_i_sample = -100000000;
     static double min_i_sample = 100000000;
-#endif
-    //gather the samples into a time domain array
-    for (i = MAX_BINS / 2; i < MAX_BINS; i++, j++)
+    for (j = 0; j < block_len; j++)
     {
-        // 24 bit audio samples are packed in MSB in the 32 bit word
-        i_sample = (1.0  * (input_rx[j] >> 8)) / MAX_SAMPLE_VALUE;
-
-#if DEBUG_DSP_ == 1
-        if (max_i_sample < i_sample)
+        if (max_i_sample < c->fft_m[j])
         {
-            max_i_sample = i_sample;
+            max_i_sample = c->fft_m[j];
             printf("input_rx %d\n", input_rx[j]);
             printf("max_i_sample %f\n\n", max_i_sample);
         }
-        if (min_i_sample > i_sample)
+        if (min_i_sample > c->fft_m[j])
         {
-            min_i_sample = i_sample;
+            min_i_sample = c->fft_m[j];
             printf("input_rx %d\n", input_rx[j]);
             printf("min_i_sample %f\n\n", min_i_sample);
         }
+    }
 #endif
 
-        __real__ fft_m[j] = i_sample;
-        __imag__ fft_m[j] = 0;
+	// STEP 3: convert the time domain samples to  frequency domain
+    fft_hist_next(c);
+	DSP_FFTW(execute_dft_r2c)(c->plan_fwd, c->fft_in, c->fft_out);
 
-        __real__ fft_in[i]  = i_sample;
-        __imag__ fft_in[i]  = 0;
-    }
+    // the waterfall, power only, the rest is for the spectrum thread
+    if (!tx_on)
+        spectrum_tap(c->fft_out, n_fft);
 
-	// STEP 3: convert the time domain samples to  frequency domain
-	fftw_execute(plan_fwd);
+	// STEP 4: we rotate the bins around by r-tuned_bin,
+	// STEP 5: zero out the other sideband and
+	// STEP 6: apply the filter to the signal,
+	// all in one pass over the surviving bins, see filter_bins_build()
+    int n_ifft = n_fft / rx_decimation;
+    filter_bins_apply(&filter_acquire(c)->rx, fft_hist_spectra(c), c->fft_freq);
+
+    //STEP 6b: noise reduction, its noise floor is not fed with the tx leakage
+    bool denoise_on = radio_h_dsp->profiles[radio_h_dsp->profile_active_idx].denoise;
+    if (denoise_on && !rx_denoise_on)
+        denoise_reset(&rx_denoise);
+    rx_denoise_on = denoise_on;
+    if (denoise_on && !tx_on)
+        denoise_process(&rx_denoise, c->fft_freq);
 
-	//STEP 4: we rotate the bins around by r-tuned_bin
-    for (i = 0; i < MAX_BINS; i++)
+    //STEP 7: convert back to time domain
+    if (rx_decimation == 1)
     {
-        int b =  i + TUNED_BINS;
-        if (b >= MAX_BINS)
-            b = b - MAX_BINS;
-        if (b < 0)
-            b = b + MAX_BINS;
-        fft_freq[i] = fft_out[b];
-    }
+        DSP_FFTW(execute)(c->plan_rev);
 
-	// STEP 5:zero out the other sideband
-	if (radio_h_dsp->profiles[radio_h_dsp->profile_active_idx].mode == MODE_LSB)
-        memset(fft_freq, 0, sizeof(fftw_complex) * (MAX_BINS/2));
-	else
-        memset((void *) fft_freq + (MAX_BINS/2 * sizeof(fftw_complex)), 0, sizeof(fftw_complex) * (MAX_BINS/2));
+        for (i = 0; i < block_len; i++)
+            rx_output[i] = __imag__ c->fft_time[i + block_len];
+    }
+    else
+    {
+        DSP_FFTW(execute)(plan_rev_dec);
 
-	// STEP 6: apply the filter to the signal,
-	// in frequency domain we just multiply the filter
-	// coefficients with the frequency domain samples
-    for (i = 0; i < MAX_BINS; i++)
-        fft_freq[i] *= rx_filter->fir_coeff[i];
+        // the small fft gives every rx_decimation-th sample of the full one,
+        // linear interpolation back to 96 kHz (one decimated sample of delay)
+        for (i = 0; i < block_len / rx_decimation; i++)
+        {
+            dsp_real y = __imag__ c->fft_time[i + n_ifft / 2];
+            for (j = 0; j < rx_decimation; j++)
+                rx_output[i * rx_decimation + j] = rx_last_sample + (y - rx_last_sample) * j / (dsp_real) rx_decimation;
+            rx_last_sample = y;
+        }
+    }
 
-    //STEP 7: convert back to time domain
-    fftw_execute(plan_rev);
+    //STEP 7b: cw decoder, before the agc pumps the noise up between the marks
+    bool cw_on = radio_h_dsp->profiles[radio_h_dsp->profile_active_idx].mode == MODE_CW;
+    if (cw_on && !rx_cw_on)
+        cw_rx_reset(&rx_cw);
+    rx_cw_on = cw_on;
+    if (cw_on && !tx_on)
+        cw_rx_process(&rx_cw, rx_output, block_len);
 
-    //STEP 8 : AGC
-    if (radio_h_dsp->profiles[radio_h_dsp->profile_active_idx].agc != AGC_OFF)
-        dsp_process_agc();
+    //STEP 8 : AGC (and the level meter with AGC_OFF), not fed with the tx leakage
+    if (!tx_on)
+        dsp_process_agc(rx_output, block_len);
 
 	//STEP 9: send the output back to where it needs to go
-    int32_t *output_speaker_int = (int32_t *)output_speaker;
-    int32_t *output_loopback_int = (int32_t *) output_loopback;
-    for (i = 0; i < block_size; i++)
+    // speaker: shifted 8 bit left to revert to wm8731 32-bit sample format (only 24-bit MSB valid)
+    // loopback: 96 kHz mono to 48 kHz stereo decimation, L=R (with rx_decimation 2 these are
+    // the samples of the half size inverse fft), shifted just 4 bits, a small gain for the loopback
+    if (tx_on)
     {
-        output_speaker_int[i] = (int32_t) (cimag(fft_time[i+(MAX_BINS/2)]) * MAX_SAMPLE_VALUE);
-        if ((i % 2) == 0)
-        {
-            output_loopback_int[i] = output_speaker_int[i] << 4; // we give a small gain here for the loopback
-            output_loopback_int[i + 1] = output_loopback_int[i];     // 96 kHz mono to 48 kHz stereo decimation, L=R        }
-        }
-        // we shift 8 bit right to revert to wm8731 32-bit sample format (only 24-bit MSB valid)
-        output_speaker_int[i] <<= 8;
+        memset(output_speaker, 0, block_size * (snd_pcm_format_width(format) / 8));
+        memset(output_loopback, 0, block_size * (snd_pcm_format_width(format) / 8));
     }
+    else
+        convert_real_to_s32_rx(rx_output, (int32_t *) output_speaker, (int32_t *) output_loopback, block_size, (dsp_real) MAX_SAMPLE_VALUE);
 
-    memset(output_tx, 0, block_size * (snd_pcm_format_width(format) / 8));
+    if (output_tx)
+        memset(output_tx, 0, block_size * (snd_pcm_format_width(format) / 8));
 }
 
 // - signal_input: 96 kHz mono input from mic or 48 kHz stereo input from loopback
-// - output_speaker: NULL buffer
-// - output_loopback: NULL buffer
+// - output_speaker: tx monitor (tx_monitor_level) or zeroed, or NULL when not wanted
+// - output_loopback: zeroed, or NULL when the rx thread owns it
 // - output_tx: output to tx with the input baseband (eg. 0 to 3 kHz) upconverted to passband in LSB or USB
 // - block_size: number of samples, hardcoded to 1024 for now
 // - input_is_48k_stereo: if true, input is 48 kHz stereo (loopback), otherwise, 96 kHz mono (mic)
 void dsp_process_tx(uint8_t *signal_input, uint8_t *output_speaker, uint8_t *output_loopback, uint8_t *output_tx, uint32_t block_size, bool input_is_48k_stereo)
 {
-    static double loopback_in[512]; // n_samples / 2
-    static double signal_input_f[1024]; // n_samples
+    static dsp_real signal_input_f[MAX_BINS / 2]; // n_samples
 
+    struct dsp_chain *c = &tx_chain;
     int32_t *signal_input_int = (int32_t *) signal_input;
     int32_t *signal_output_int = (int32_t *) output_tx;
 
-    if (block_size != 1024)
+    if (block_size != block_len)
     {
-        fprintf(stderr, "This code uses 1024 samples for the fft\n");
+        fprintf(stderr, "The DSP was initialized with %u samples blocks, got %u\n", block_len, block_size);
         shutdown_ = true;
         return;
     }
 
-    //fix the burst at the start of transmission
+    //fix the burst at the start of transmission. In full duplex the rx
+    //rings keep the audio captured before the ptt (e.g. the tail of the
+    //peer's frame), only the tx ones are dropped
     if (tx_starting)
     {
-        fft_reset_m_bins();
-        clear_buffers();
+        dsp_reset_tx();
+        if (radio_h_dsp->full_duplex)
+            clear_tx_buffers();
+        else
+            clear_buffers();
         tx_starting = false;
     }
 
-    //first add the previous M samples
-    memcpy(fft_in, fft_m, MAX_BINS/2 * sizeof(fftw_complex));
+    int i, j;
+    uint32_t monitor_level = radio_h_dsp->tx_monitor_level;
 
-    double i_sample;
-    int i, j = 0;
-    // prepare data from loopback... 48kHz stereo to 96 kHz mono
-    if (radio_h_dsp->tone_generation)
+    bool comp_on = radio_h_dsp->profiles[radio_h_dsp->profile_active_idx].compressor == COMPRESSOR_ON;
+    if (comp_on && !tx_comp_on)
     {
-        for (i = 0; i < block_size; i++)
-        {
-            signal_input_f[i] = (1.0 * vfo_read(&tone)) / 4800000000.0;
-        }
+        compressor_reset(&tx_comp_96k);
+        compressor_reset(&tx_comp_48k);
     }
-    else if (input_is_48k_stereo)
+    tx_comp_on = comp_on;
+
+    bool cw_on = radio_h_dsp->profiles[radio_h_dsp->profile_active_idx].mode == MODE_CW;
+    if (cw_on && !tx_cw_on)
+        cw_tx_reset(&tx_cw);
+    tx_cw_on = cw_on;
+
+    // a tone or mode change while keyed switches the input path: the history
+    // of the path being entered is from its last block, many blocks ago, so
+    // it starts from silence as at the start of the tx
+    uint8_t tone = radio_h_dsp->tone_generation;
+    bool path_48k = input_is_48k_stereo && !tone && !cw_on;
+    if (path_48k != tx_path_48k)
     {
-        for (i = 0; i < block_size; i = i + 2)
+        if (path_48k)
         {
-            // just left channel
-            loopback_in[i/2] = (1.0 * (signal_input_int[i] >> 8)) / MAX_SAMPLE_VALUE;
+            memset(fft_m_48k, 0, sizeof(dsp_real) * block_len / 2);
+            tx_monitor_last = 0;
         }
-        rational_resampler(loopback_in, block_size / 2, signal_input_f, 2, INTERPOLATION);
+        else
+            memset(c->fft_m, 0, sizeof(dsp_real) * block_len);
+        tx_path_48k = path_48k;
     }
-    else // mic input from wm8731
+
+    if (path_48k)
     {
-        for (i = 0; i < block_size; i++)
+        // loopback input, 48 kHz stereo: the fft runs at 48 kHz over the same
+        // time window, and the 96 kHz spectrum is the 48 kHz one zero padded
+        memcpy(fft_in_48k, fft_m_48k, block_len / 2 * sizeof(dsp_real));
+
+        // just left channel
+        convert_s32_to_real(signal_input_int, 2, fft_in_48k + block_len / 2, block_len / 2, (dsp_real) (1.0 / MAX_SAMPLE_VALUE));
+        if (comp_on)
+            compressor_process(&tx_comp_48k, fft_in_48k + block_len / 2, block_len / 2);
+        memcpy(fft_m_48k, fft_in_48k + block_len / 2, block_len / 2 * sizeof(dsp_real));
+
+        // the monitor at 96 kHz, linear interpolation
+        if (output_speaker && monitor_level)
         {
-            signal_input_f[i] = (1.0 * (signal_input_int[i] >> 8)) / MAX_SAMPLE_VALUE;
+            for (i = 0; i < block_len / 2; i++)
+            {
+                dsp_real y = fft_m_48k[i];
+                signal_input_f[2 * i] = (tx_monitor_last + y) * (dsp_real) 0.5;
+                signal_input_f[2 * i + 1] = y;
+                tx_monitor_last = y;
+            }
         }
-    }
 
-#if DEBUG_DSP_ == 1
-    static double max_i_sample = -100000000;
-    static double min_i_sample = 100000000;
-#endif
+        DSP_FFTW(execute)(plan_fwd_48k);
 
-    //gather the samples into a time domain array
-    for (i = MAX_BINS/2; i < MAX_BINS; i++, j++)
+        // same bin spacing, half of the samples in the sum: twice the gain.
+        // The nyquist bin is split between +24 and -24 kHz, above it is zero
+        fft_hist_next(c);
+        for (i = 0; i < n_fft / 4; i++)
+            c->fft_out[i] = fft_out_48k[i] * (dsp_real) 2.0;
+        c->fft_out[n_fft / 4] = fft_out_48k[n_fft / 4];
+        memset(c->fft_out + n_fft / 4 + 1, 0, sizeof(dsp_complex) * (n_fft / 4));
+    }
+    else
     {
-        i_sample = signal_input_f[j];
+        //first add the previous M samples
+        memcpy(c->fft_in, c->fft_m, block_len * sizeof(dsp_real));
 
-#if DEBUG_DSP_ == 1
-        if (max_i_sample < i_sample)
+        if (tone)
+        {
+            nco_fill((tone == TONE_TWO) ? &tx_two_tone : &tx_tone, signal_input_f, block_size);
+        }
+        else if (cw_on) // the keyed tone, the edges are timestamped against the call time
         {
-            max_i_sample = i_sample;
-            printf("input_tx %d\n", signal_input_int[j]);
-            printf("max_tx_sample %f\n\n", max_i_sample);
+            cw_tx_process(&tx_cw, signal_input_f, block_size, cw_now_ns());
         }
-        if (min_i_sample > i_sample)
+        else // mic input from wm8731
         {
-            min_i_sample = i_sample;
-            printf("input_tx %d\n", signal_input_int[j]);
-            printf("min_tx_sample %f\n\n", min_i_sample);
+            convert_s32_to_real(signal_input_int, 1, signal_input_f, block_size, (dsp_real) (1.0 / MAX_SAMPLE_VALUE));
+            if (comp_on)
+                compressor_process(&tx_comp_96k, signal_input_f, block_size);
         }
+
+#if DEBUG_DSP_ == 1
+        static double max_i_sample = -100000000;
+        static double min_i_sample = 100000000;
 #endif
 
-        __real__ fft_m[j] = i_sample;
-        __imag__ fft_m[j] = 0;
+        //gather the samples into a time domain array
+        for (i = block_len, j = 0; i < n_fft; i++, j++)
+        {
+            dsp_real i_sample = signal_input_f[j];
 
-        __real__ fft_in[i]  = i_sample;
-        __imag__ fft_in[i]  = 0;
-    }
+#if DEBUG_DSP_ == 1
+            if (max_i_sample < i_sample)
+            {
+                max_i_sample = i_sample;
+                printf("input_tx %d\n", signal_input_int[j]);
+                printf("max_tx_sample %f\n\n", max_i_sample);
+            }
+            if (min_i_sample > i_sample)
+            {
+                min_i_sample = i_sample;
+                printf("input_tx %d\n", signal_input_int[j]);
+                printf("min_tx_sample %f\n\n", min_i_sample);
+            }
+#endif
+
+            c->fft_m[j] = i_sample;
+            c->fft_in[i]  = i_sample;
+        }
 
-    //convert to frequency
-    fftw_execute(plan_fwd);
+        //convert to frequency
+        fft_hist_next(c);
+        DSP_FFTW(execute_dft_r2c)(c->plan_fwd, c->fft_in, c->fft_out);
+    }
 
     // NOTE: fft_out holds the fft output (in freq domain) of the
     // incoming mic samples
     // the naming is unfortunate
 
-    // apply the filter
-    for (i = 0; i < MAX_BINS; i++)
-        fft_out[i] *= tx_filter->fir_coeff[i];
-
-    // the usb extends from 0 to MAX_BINS/2 - 1,
-    // the lsb extends from MAX_BINS - 1 to MAX_BINS/2 (reverse direction)
-    // zero out the other sideband
-
-    // TBD: Something strange is going on, this should have been the otherway
-    if (radio_h_dsp->profiles[radio_h_dsp->profile_active_idx].mode == MODE_LSB)
-        memset(fft_out, 0, sizeof(fftw_complex) * (MAX_BINS/2));
-    else
-        memset((void *) fft_out + (MAX_BINS/2 * sizeof(fftw_complex)), 0, sizeof(fftw_complex) * (MAX_BINS/2));
-
-    //now rotate to the tx_bin
-    for (i = 0; i < MAX_BINS; i++)
-    {
-        int b = i + TUNED_BINS;
-        if (b >= MAX_BINS)
-            b = b - MAX_BINS;
-        if (b < 0)
-            b = b + MAX_BINS;
-        fft_freq[b] = fft_out[i];
-    }
+    // apply the filter, zero out the other sideband and rotate to the
+    // tx_bin (it also takes the compressor clipping products off the
+    // channel), all in one pass over the surviving bins, see filter_bins_build()
+    filter_bins_apply(&filter_acquire(c)->tx, fft_hist_spectra(c), c->fft_freq);
 
     //convert back to time domain
-    fftw_execute(plan_rev);
+    DSP_FFTW(execute)(c->plan_rev);
 
-    double multiplier = get_band_multiplier() * (double) radio_h_dsp->profiles[radio_h_dsp->profile_active_idx].power_level_percentage / 100.0;
-    for (i = 0; i < MAX_BINS / 2; i++)
-    {
-        signal_output_int[i] = (int32_t) (creal(fft_time[i+(MAX_BINS/2)]) * 4000.0 * multiplier); // we just chose an appropriate level...
-        signal_output_int[i] <<= 8;
-    }
+    dsp_real multiplier = 4000.0 * get_band_multiplier() * (double) radio_h_dsp->profiles[radio_h_dsp->profile_active_idx].power_level_percentage / 100.0;
+    // we just chose an appropriate level...
+    convert_real_to_s32((dsp_real *) (c->fft_time + block_len), 2, signal_output_int, block_len, multiplier, 8);
 
-    memset(output_loopback, 0, block_size * (snd_pcm_format_width(format) / 8));
-    memset(output_speaker, 0, block_size * (snd_pcm_format_width(format) / 8));
+    if (output_loopback)
+        memset(output_loopback, 0, block_size * (snd_pcm_format_width(format) / 8));
+
+    // tx monitor: the tx audio as it enters the tx filter (signal_input_f)
+    if (output_speaker && monitor_level)
+        convert_real_to_s32(signal_input_f, 1, (int32_t *) output_speaker, block_len, (dsp_real) (MAX_SAMPLE_VALUE * monitor_level / 100.0), 8);
+    else if (output_speaker)
+        memset(output_speaker, 0, block_size * (snd_pcm_format_width(format) / 8));
 }
 
 double get_band_multiplier()
@@ -357,15 +604,23 @@ double get_band_multiplier()
     return multiplier;
 }
 
-//zero up the previous 'M' bins
+//zero up the previous 'M' bins, of both chains
 void fft_reset_m_bins()
 {
+    dsp_reset_rx();
+    dsp_reset_tx();
+}
+
+// one block to fill the fft input, the group delay of the (linear phase)
+// filter and, on rx with decimation, the lag of the linear interpolation
+uint32_t dsp_latency(bool tx)
+{
+    uint32_t latency = block_len + (design_filter->M - 1) / 2;
 
-    memset(fft_in, 0, sizeof(fftw_complex) * MAX_BINS);
-    memset(fft_out, 0, sizeof(fftw_complex) * MAX_BINS);
-    memset(fft_m, 0, sizeof(fftw_complex) * MAX_BINS/2);
-    memset(fft_time, 0, sizeof(fftw_complex) * MAX_BINS);
-    memset(fft_freq, 0, sizeof(fftw_complex) * MAX_BINS);
+    if (!tx && rx_decimation > 1)
+        latency += rx_decimation;
+
+    return latency;
 }
 
 void dsp_init(radio *radio_h)
@@ -375,31 +630,213 @@ void dsp_init(radio *radio_h)
     if (radio_h->profiles[radio_h->profile_active_idx].operating_mode == OPERATING_MODE_CONTROLS_ONLY)
         return;
 
-    fft_m = (fftw_complex*) fftw_malloc(sizeof(fftw_complex) * MAX_BINS/2);
-    fft_in = (fftw_complex*) fftw_malloc(sizeof(fftw_complex) * MAX_BINS);
-    fft_out = (fftw_complex*) fftw_malloc(sizeof(fftw_complex) * MAX_BINS);
+    block_len = radio_h->dsp_block_size;
+    if (block_len != 256 && block_len != 512 && block_len != 1024)
+    {
+        fprintf(stderr, "Invalid dsp_block_size %u, using 1024\n", block_len);
+        block_len = 1024;
+    }
+    radio_h->dsp_block_size = block_len; // the sound system uses the same block size
+    n_fft = 2 * block_len;
+    n_partitions = (MAX_BINS / 2) / block_len;
+    hist_stride = n_fft / 2 + 2;
+
+    dsp_chain_alloc(&rx_chain);
+    dsp_chain_alloc(&tx_chain);
 
-    //create fft complex arrays to convert the frequency back to time
-    fft_time = (fftw_complex*) fftw_malloc(sizeof(fftw_complex) * MAX_BINS);
-    fft_freq = (fftw_complex*) fftw_malloc(sizeof(fftw_complex) * MAX_BINS);
+    fft_m_48k = DSP_FFTW(alloc_real)(block_len / 2);
+    fft_in_48k = DSP_FFTW(alloc_real)(block_len);
+    fft_out_48k = DSP_FFTW(alloc_complex)(n_fft / 4 + 1);
 
     fft_reset_m_bins();
 
+    struct timespec plan_start, plan_end;
+    clock_gettime(CLOCK_MONOTONIC, &plan_start);
+
+#ifdef DSP_FLOAT
+    printf("Creating signal FFT plans (single precision)\n");
+#else
     printf("Creating signal FFT plans\n");
-    plan_rev = fftw_plan_dft_1d(MAX_BINS, fft_freq, fft_time, FFTW_BACKWARD, FFTW_MEASURE);
-    plan_fwd = fftw_plan_dft_1d(MAX_BINS, fft_in, fft_out, FFTW_FORWARD, FFTW_MEASURE);
+#endif
+    printf("DSP block size %u samples, %d points FFT, %d filter partitions\n", block_len, n_fft, n_partitions);
+    dsp_chain_plan(&rx_chain);
+    dsp_chain_plan(&tx_chain);
+    plan_fwd_48k = DSP_FFTW(plan_dft_r2c_1d)(n_fft / 2, fft_in_48k, fft_out_48k, FFTW_MEASURE);
+
+    rx_decimation = radio_h->rx_decimation;
+    if (rx_decimation != 1 && rx_decimation != 2 && rx_decimation != 4 && rx_decimation != 8)
+    {
+        fprintf(stderr, "Invalid rx_decimation %u, using 1 (off)\n", rx_decimation);
+        rx_decimation = 1;
+    }
+    if (rx_decimation > 1)
+    {
+        printf("RX decimation by %u, inverse FFT at %u Hz\n", rx_decimation, 96000 / rx_decimation);
+        plan_rev_dec = DSP_FFTW(plan_dft_1d)(n_fft / rx_decimation, rx_chain.fft_freq, rx_chain.fft_time, FFTW_BACKWARD, FFTW_MEASURE);
+    }
+    denoise_init(&rx_denoise, n_fft / rx_decimation, block_len / 96000.0);
+    agc_init(&rx_agc);
+    compressor_init(&tx_comp_96k, 96000);
+    compressor_init(&tx_comp_48k, 48000);
+    cw_tx_init(&tx_cw, radio_h->cw_pitch);
+    cw_rx_init(&rx_cw, radio_h->cw_pitch);
+    nco_init(&tx_tone, 96000);
+    nco_tone(&tx_tone, 0, TONE_HZ, NCO_TONE_LEVEL);
+    nco_init(&tx_two_tone, 96000);
+    nco_tone(&tx_two_tone, 0, TWO_TONE_LOW_HZ, NCO_TONE_LEVEL / 2);
+    nco_tone(&tx_two_tone, 1, TWO_TONE_HIGH_HZ, NCO_TONE_LEVEL / 2);
 
     fft_reset_m_bins();
 
-    rx_filter = filter_new(1024, 1025);
-    tx_filter = filter_new(1024, 1025);
+    design_filter = filter_new(1024, 1025);
+    filter_partition(design_filter, block_len);
+    for (int k = 0; k < FILTER_BANK_SIZE; k++)
+    {
+        filter_bank[k].valid = false;
+        filter_bank[k].rx.coeff = DSP_FFTW(alloc_complex)(MAX_BINS);
+        filter_bank[k].tx.coeff = DSP_FFTW(alloc_complex)(MAX_BINS);
+    }
+    filter_bank_next = 0;
+    filter_next = NULL;
 
     printf("Creating filters FFT plans\n");
+    pthread_mutex_lock(&filter_bank_mutex);
+    for (int k = 0; k < radio_h->profiles_count; k++)
+        filter_bank_get(radio_h->profiles[k].mode, radio_h->profiles[k].bpf_low, radio_h->profiles[k].bpf_high);
+    pthread_mutex_unlock(&filter_bank_mutex);
     dsp_set_filters();
 
-    // init vfo for tone generation
-    vfo_init_phase_table();
-    vfo_start(&tone, 1000, 0);
+    clock_gettime(CLOCK_MONOTONIC, &plan_end);
+    printf("FFT plans and filters ready in %.1f ms\n",
+           (plan_end.tv_sec - plan_start.tv_sec) * 1e3 + (plan_end.tv_nsec - plan_start.tv_nsec) / 1e6);
+}
+
+// FFTW wisdom, one file per CPU model (the measured plans of a Pi 4 are not
+// the best ones for a Pi 5), in CFG_WISDOM_DIR or CFG_WISDOM_DIR_RO.
+// The key is made of the "model name" (x86), "Model" (Pi board) and "CPU part"
+// (arm core) fields of /proc/cpuinfo.
+static void wisdom_cpu_key(char *key, size_t len)
+{
+    const char *fields[] = { "model name", "Model", "CPU part" };
+    bool found[3] = { false, false, false };
+    size_t pos = 0;
+    char line[256];
+
+    FILE *f = fopen("/proc/cpuinfo", "r");
+    while (f && fgets(line, sizeof(line), f))
+    {
+        for (int i = 0; i < 3; i++)
+        {
+            size_t n = strlen(fields[i]);
+            char *v = strchr(line, ':');
+            if (found[i] || v == NULL || strncmp(line, fields[i], n) || (line[n] != ' ' && line[n] != '\t' && line[n] != ':'))
+                continue;
+            found[i] = true;
+
+            for (v++; *v == ' '; v++);
+            if (pos > 0 && pos < len - 1)
+                key[pos++] = '-';
+            for (; *v && *v != '\n' && pos < len - 1; v++)
+                key[pos++] = (isalnum((unsigned char) *v) || *v == '.') ? *v : '_';
+        }
+    }
+    if (f)
+        fclose(f);
+
+    key[pos] = 0;
+    if (pos == 0)
+        snprintf(key, len, "unknown");
+}
+
+static void wisdom_path(char *path, size_t len, const char *dir, const char *lib)
+{
+    char key[128];
+    wisdom_cpu_key(key, sizeof(key));
+    snprintf(path, len, "%s/%s-%s.wisdom", dir, lib, key);
+}
+
+// the filters are designed in double precision, so there is always a fftw
+// wisdom, and a fftwf one for the single precision pipeline
+static bool wisdom_import(const char *dir)
+{
+    char path[512];
+    bool ok;
+
+    wisdom_path(path, sizeof(path), dir, "fftw");
+    ok = fftw_import_wisdom_from_filename(path);
+#ifdef DSP_FLOAT
+    wisdom_path(path, sizeof(path), dir, "fftwf");
+    ok = ok && fftwf_import_wisdom_from_filename(path);
+#endif
+
+    if (ok)
+        printf("FFTW wisdom loaded from %s\n", dir);
+    return ok;
+}
+
+bool dsp_wisdom_load()
+{
+    return wisdom_import(CFG_WISDOM_DIR) || wisdom_import(CFG_WISDOM_DIR_RO);
+}
+
+bool dsp_wisdom_save()
+{
+    char path[512];
+    bool ok;
+
+    if (mkdir(CFG_WISDOM_DIR, 0755) && errno != EEXIST)
+    {
+        fprintf(stderr, "Can not create %s: %s\n", CFG_WISDOM_DIR, strerror(errno));
+        return false;
+    }
+
+    wisdom_path(path, sizeof(path), CFG_WISDOM_DIR, "fftw");
+    ok = fftw_export_wisdom_to_filename(path);
+#ifdef DSP_FLOAT
+    wisdom_path(path, sizeof(path), CFG_WISDOM_DIR, "fftwf");
+    ok = ok && fftwf_export_wisdom_to_filename(path);
+#endif
+
+    if (ok)
+        printf("FFTW wisdom saved to %s\n", CFG_WISDOM_DIR);
+    else
+        fprintf(stderr, "Can not write the FFTW wisdom to %s\n", CFG_WISDOM_DIR);
+    return ok;
+}
+
+// Plans every fft the dsp may use (all the block sizes and rx decimations, and
+// the filter design) with FFTW_PATIENT, with the same array layout as
+// dsp_init() and window_filter(), and saves the wisdom. Slow: run it once, at
+// install time, on the radio itself.
+bool dsp_wisdom_generate()
+{
+    dsp_wisdom_load();
+
+    printf("Generating FFTW wisdom with FFTW_PATIENT, this takes a while...\n");
+    for (int block = 256; block <= MAX_BINS / 2; block *= 2)
+    {
+        int n = 2 * block;
+        dsp_real *in = DSP_FFTW(alloc_real)(n);
+        dsp_complex *freq = DSP_FFTW(alloc_complex)(n);
+        dsp_complex *time = DSP_FFTW(alloc_complex)(n);
+
+        DSP_FFTW(destroy_plan)(DSP_FFTW(plan_dft_r2c_1d)(n, in, freq, FFTW_PATIENT));
+        DSP_FFTW(destroy_plan)(DSP_FFTW(plan_dft_r2c_1d)(n / 2, in, freq, FFTW_PATIENT));
+        for (int decimation = 1; decimation <= 8; decimation *= 2)
+            DSP_FFTW(destroy_plan)(DSP_FFTW(plan_dft_1d)(n / decimation, freq, time, FFTW_BACKWARD, FFTW_PATIENT));
+
+        DSP_FFTW(free)(in);
+        DSP_FFTW(free)(freq);
+        DSP_FFTW(free)(time);
+        printf("  %d samples blocks done\n", block);
+    }
+
+    fftw_complex *buf = fftw_alloc_complex(MAX_BINS);
+    fftw_destroy_plan(fftw_plan_dft_1d(MAX_BINS, buf, buf, FFTW_FORWARD, FFTW_PATIENT));
+    fftw_destroy_plan(fftw_plan_dft_1d(MAX_BINS, buf, buf, FFTW_BACKWARD, FFTW_PATIENT));
+    fftw_free(buf);
+
+    return dsp_wisdom_save();
 }
 
 void dsp_free(radio *radio_h)
@@ -407,18 +844,24 @@ void dsp_free(radio *radio_h)
     if (radio_h->profiles[radio_h->profile_active_idx].operating_mode == OPERATING_MODE_CONTROLS_ONLY)
         return;
 
-    fftw_destroy_plan(plan_rev);
-    fftw_destroy_plan(plan_fwd);
+    dsp_chain_free(&rx_chain);
+    dsp_chain_free(&tx_chain);
+    DSP_FFTW(destroy_plan)(plan_fwd_48k);
+    if (rx_decimation > 1)
+        DSP_FFTW(destroy_plan)(plan_rev_dec);
     fftw_destroy_plan(rev_filter_plan);
     fftw_destroy_plan(fwd_filter_plan);
-    fftw_free(fft_m);
-    fftw_free(fft_in);
-    fftw_free(fft_out);
-    fftw_free(fft_time);
-    fftw_free(fft_freq);
+    DSP_FFTW(free)(fft_m_48k);
+    DSP_FFTW(free)(fft_in_48k);
+    DSP_FFTW(free)(fft_out_48k);
     fftw_free(buffer_filter);
-    free(rx_filter);
-    free(tx_filter);
+    DSP_FFTW(free)(design_filter->fir_coeff);
+    free(design_filter);
+    for (int k = 0; k < FILTER_BANK_SIZE; k++)
+    {
+        DSP_FFTW(free)(filter_bank[k].rx.coeff);
+        DSP_FFTW(free)(filter_bank[k].tx.coeff);
+    }
 }
 
 void dsp_set_filters()
@@ -426,18 +869,213 @@ void dsp_set_filters()
     if (radio_h_dsp->profiles[radio_h_dsp->profile_active_idx].operating_mode == OPERATING_MODE_CONTROLS_ONLY)
         return;
 
-    double bpf_low = (double) radio_h_dsp->profiles[radio_h_dsp->profile_active_idx].bpf_low;
-    double bpf_high = (double) radio_h_dsp->profiles[radio_h_dsp->profile_active_idx].bpf_high;
+    radio_profile *profile = &radio_h_dsp->profiles[radio_h_dsp->profile_active_idx];
+
+    pthread_mutex_lock(&filter_bank_mutex);
+    filter_next = filter_bank_get(profile->mode, profile->bpf_low, profile->bpf_high);
+    pthread_mutex_unlock(&filter_bank_mutex);
+}
+
+// returns the bank entry of (mode, bpf_low, bpf_high), designing it if needed,
+// called with filter_bank_mutex held
+struct filter_bank_entry *filter_bank_get(uint16_t mode, uint32_t bpf_low, uint32_t bpf_high)
+{
+    struct filter_bank_entry *e = NULL;
 
-    if(radio_h_dsp->profiles[radio_h_dsp->profile_active_idx].mode == MODE_LSB)
+    // cw: the upper sideband around the pitch, cached by these bounds
+    if (mode == MODE_CW)
     {
-        filter_tune(tx_filter, (1.0 * -bpf_high) / 96000.0, (1.0 * -bpf_low) / 96000.0, 5);
-        filter_tune(rx_filter, (1.0 * -bpf_high) / 96000.0, (1.0 * -bpf_low) / 96000.0, 5);
+        bpf_low = radio_h_dsp->cw_pitch - radio_h_dsp->cw_bandwidth / 2;
+        bpf_high = radio_h_dsp->cw_pitch + radio_h_dsp->cw_bandwidth / 2;
     }
+
+    for (int k = 0; k < FILTER_BANK_SIZE; k++)
+    {
+        e = &filter_bank[k];
+        if (e->valid && e->mode == mode && e->bpf_low == bpf_low && e->bpf_high == bpf_high)
+            return e;
+    }
+
+    // a free entry, or the next one neither in use nor about to be used by the dsp
+    for (int k = 0; k < FILTER_BANK_SIZE; k++)
+    {
+        e = &filter_bank[(filter_bank_next + k) % FILTER_BANK_SIZE];
+        if (!e->valid)
+            break;
+    }
+    if (e->valid)
+    {
+        do
+        {
+            e = &filter_bank[filter_bank_next];
+            filter_bank_next = (filter_bank_next + 1) % FILTER_BANK_SIZE;
+        } while (e == rx_chain.filter_in_use || e == tx_chain.filter_in_use || e == filter_next);
+    }
+
+    if (bpf_high >= 48000 / rx_decimation)
+        fprintf(stderr, "bpf_high %u Hz does not fit the rx decimated bandwidth of %u Hz\n", bpf_high, 48000 / rx_decimation);
+
+    bool lsb = mode == MODE_LSB;
+
+    if(lsb)
+        filter_tune(design_filter, -(double) bpf_high / 96000.0, -(double) bpf_low / 96000.0, 5);
     else
+        filter_tune(design_filter, (double) bpf_low / 96000.0, (double) bpf_high / 96000.0, 5);
+
+    filter_bins_build(&e->rx, design_filter, false, lsb, rx_decimation);
+    filter_bins_build(&e->tx, design_filter, true, lsb, 1);
+
+    e->mode = mode;
+    e->bpf_low = bpf_low;
+    e->bpf_high = bpf_high;
+    e->valid = true;
+
+    return e;
+}
+
+static void filter_bins_add(struct filter_bins *fb, int dst, int src, dsp_complex coeff)
+{
+    bool mirror = src > fb->n_fft / 2;
+    struct bin_span *s = fb->n_spans ? &fb->spans[fb->n_spans - 1] : NULL;
+
+    if (s == NULL || s->mirror != mirror || dst != s->dst + s->count || src != s->src + s->count)
+    {
+        assert(fb->n_spans < MAX_BIN_SPANS);
+        s = &fb->spans[fb->n_spans++];
+        s->dst = dst;
+        s->src = src;
+        s->count = 0;
+        s->mirror = mirror;
+        s->coeff = fb->coeff + fb->n_coeff;
+    }
+
+    s->coeff[s->count++] = coeff;
+    fb->n_coeff++;
+}
+
+// Pre-rotates and pre-masks the filter, so the per block work is a single
+// complex multiply for each surviving bin (and filter partition), over (at
+// most 3) contiguous spans.
+// rx: the bins of the kept sideband are rotated down by n_fft/4 (24 kHz), then
+//     filtered. USB keeps the lower half of the rotated spectrum and LSB the
+//     upper one. The output is the (decimated) inverse fft input, so only the
+//     n_fft / decimation / 2 bins closest to the tuned frequency survive.
+// tx: the bins of the kept sideband are filtered, then rotated up to the
+//     tx_bin in the full size output.
+// A partitioned filter is not band limited piece by piece, so there all the
+// bins are kept (the filter itself rejects the other sideband), and the rx
+// spectrum is folded for the decimated inverse fft.
+void filter_bins_build(struct filter_bins *fb, struct filter *f, bool tx, bool lsb, int decimation)
+{
+    static bool written[MAX_BINS];
+
+    int n_fft = f->n_fft;
+    bool all_bins = f->partitions > 1;
+    int n_out = tx ? n_fft : n_fft / decimation;
+    int n_kept = all_bins ? n_fft : n_out / 2;
+
+    fb->n_fft = n_fft;
+    fb->n_out = n_out;
+    fb->fold = all_bins && n_out < n_fft;
+    fb->partitions = f->partitions;
+    fb->n_spans = 0;
+    fb->n_coeff = 0;
+    memset(written, 0, sizeof(written));
+
+    for (int p = 0; p < f->partitions; p++)
+    {
+        for (int i = 0; i < n_kept; i++)
+        {
+            int n, dst, src;
+            if (tx)
+            {
+                n = (lsb && !all_bins ? n_fft / 2 : 0) + i;
+                src = n;
+                dst = (n + n_fft / 4) % n_fft;
+            }
+            else
+            {
+                n = all_bins ? i : (lsb ? n_fft - n_kept : 0) + i;
+                src = (n + n_fft / 4) % n_fft;
+                dst = all_bins ? n : (lsb ? n_kept : 0) + i;
+            }
+
+            // the spans are the same for all partitions, just the coefficients change
+            if (p == 0)
+            {
+                filter_bins_add(fb, dst, src, f->fir_coeff[n]);
+                written[dst] = true;
+            }
+            else
+                fb->coeff[p * n_kept + i] = f->fir_coeff[p * n_fft + n];
+        }
+    }
+
+    // and the runs of bins to zero
+    fb->n_zero = 0;
+    for (int d = 0; d < (all_bins ? n_fft : n_out); d++)
     {
-        filter_tune(tx_filter, (1.0 * bpf_low) / 96000.0, (1.0 * bpf_high) / 96000.0, 5);
-        filter_tune(rx_filter, (1.0 * bpf_low) / 96000.0, (1.0 * bpf_high) / 96000.0, 5);
+        if (written[d])
+            continue;
+        if (d == 0 || written[d - 1])
+        {
+            assert(fb->n_zero < 2);
+            fb->zero[fb->n_zero].dst = d;
+            fb->zero[fb->n_zero].count = 0;
+            fb->n_zero++;
+        }
+        fb->zero[fb->n_zero - 1].count++;
+    }
+}
+
+// in: the r2c outputs (bins 0 to n_fft/2) of the current block and of the
+// previous partitions - 1 ones, out: the inverse fft input
+void filter_bins_apply(const struct filter_bins *fb, dsp_complex * const *in, dsp_complex *out)
+{
+    for (int z = 0; z < fb->n_zero; z++)
+        memset(out + fb->zero[z].dst, 0, sizeof(dsp_complex) * fb->zero[z].count);
+
+    for (int p = 0; p < fb->partitions; p++)
+    {
+        for (int s = 0; s < fb->n_spans; s++)
+        {
+            const struct bin_span *sp = &fb->spans[s];
+            const dsp_complex *coeff = sp->coeff + p * fb->n_coeff;
+            dsp_complex *dst = out + sp->dst;
+
+            if (sp->mirror)
+            {
+                // bin b of a real signal is the conjugate of bin n_fft - b
+                const dsp_complex *src = in[p] + (fb->n_fft - sp->src);
+                for (int k = 0; k < sp->count; k++)
+                {
+                    dsp_complex c = src[-k];
+                    __imag__ c = -__imag__ c;
+                    if (p == 0)
+                        dst[k] = c * coeff[k];
+                    else
+                        dst[k] += c * coeff[k];
+                }
+            }
+            else
+            {
+                const dsp_complex *src = in[p] + sp->src;
+                if (p == 0)
+                    for (int k = 0; k < sp->count; k++)
+                        dst[k] = src[k] * coeff[k];
+                else
+                    for (int k = 0; k < sp->count; k++)
+                        dst[k] += src[k] * coeff[k];
+            }
+        }
+    }
+
+    // bin k of the decimated fft is the sum of the bins k + r * n_out
+    if (fb->fold)
+    {
+        for (int r = 1; r < fb->n_fft / fb->n_out; r++)
+            for (int k = 0; k < fb->n_out; k++)
+                out[k] += out[r * fb->n_out + k];
     }
 }
 
@@ -448,11 +1086,24 @@ struct filter *filter_new(int input_length, int impulse_length)
     f->L = input_length;
     f->M = impulse_length;
     f->N = f->L + f->M - 1;
-    f->fir_coeff = fftw_alloc_complex(f->N);
+    f->fir_coeff = DSP_FFTW(alloc_complex)(f->N);
+    f->n_fft = f->N;
+    f->partitions = 1;
 
     return f;
 }
 
+// Splits the impulse response for the partitioned overlap-save with
+// block_size samples blocks. The first partition has block_size + 1 taps,
+// and the others block_size taps each, which fit the 2 * block_size fft.
+void filter_partition(struct filter *f, int block_size)
+{
+    assert((f->M - 1) % block_size == 0);
+    f->n_fft = 2 * block_size;
+    f->partitions = (f->M - 1) / block_size;
+    assert(f->partitions * f->n_fft <= f->N);
+}
+
 int filter_tune(struct filter *f, double const low, double const high, double const kaiser_beta)
 {
     if(isnan(low) || isnan(high) || isnan(kaiser_beta))
@@ -465,6 +1116,9 @@ int filter_tune(struct filter *f, double const low, double const high, double co
     //printf("# Gain is %lf\n", gain);
 	//printf("# filter elements %d\n", f->N);
 
+    // designed in double, stored in the pipeline precision
+    complex double response[f->N];
+
     for(int n = 0; n < f->N; n++)
     {
         double s;
@@ -475,14 +1129,45 @@ int filter_tune(struct filter *f, double const low, double const high, double co
             s = (double) (n-f->N) / f->N;
 
         if(s >= low && s <= high)
-            f->fir_coeff[n] = gain;
+            response[n] = gain;
         else
-            f->fir_coeff[n] = 0;
-        // printf("#1 %d  %g  %g %g before windowing: %g,%g\n", n, s, low, high, creal(f->fir_coeff[n]), cimag(f->fir_coeff[n]));
+            response[n] = 0;
+        // printf("#1 %d  %g  %g %g before windowing: %g,%g\n", n, s, low, high, creal(response[n]), cimag(response[n]));
   }
 
 
-    window_filter(f->L, f->M, f->fir_coeff, kaiser_beta);
+    window_filter(f->L, f->M, response, kaiser_beta);
+
+    if (f->partitions == 1)
+    {
+        for(int n = 0; n < f->N; n++)
+            f->fir_coeff[n] = (dsp_complex) response[n];
+        return 0;
+    }
+
+    // back to the (causal, M taps) impulse response, scaled by N
+    memcpy(buffer_filter, response, f->N * sizeof(*buffer_filter));
+    fftw_execute(rev_filter_plan);
+
+    complex double impulse[f->M];
+    memcpy(impulse, buffer_filter, f->M * sizeof(*buffer_filter));
+
+    int const B = f->n_fft / 2;
+    for (int p = 0; p < f->partitions; p++)
+    {
+        // partition p holds the taps p * B + m, it is applied to the block
+        // received p blocks ago
+        memset(buffer_filter, 0, f->N * sizeof(*buffer_filter));
+        for (int m = (p == 0) ? 0 : 1; m <= B; m++)
+            buffer_filter[m] = impulse[p * B + m];
+
+        // a n_fft points dft is every (N / n_fft)-th bin of the zero padded N
+        // points one, and the 1 / n_fft keeps the gain of the N points filter
+        fftw_execute(fwd_filter_plan);
+        for (int k = 0; k < f->n_fft; k++)
+            f->fir_coeff[p * f->n_fft + k] = (dsp_complex) (buffer_filter[k * (f->N / f->n_fft)] / f->n_fft);
+    }
+
     return 0;
 }
 
@@ -588,7 +1273,7 @@ const double i0(double const z)
     return sum;
 }
 
-void rational_resampler(double * in, int in_size, double * out, int rate, int interpolation_decimation)
+void rational_resampler(dsp_real * in, int in_size, dsp_real * out, int rate, int interpolation_decimation)
 {
 	if (interpolation_decimation==DECIMATION)
 	{
@@ -624,82 +1309,14 @@ double interpolate_linear(double  a,double a_x,double b,double b_x,double x)
 	return return_val;
 }
 
-//we define one more than needed to cover the boundary of quadrature
-#define MAX_PHASE_COUNT (16385)
-static int	phase_table[MAX_PHASE_COUNT];
-int sampling_freq = 96000;
-
-void vfo_init_phase_table()
-{
-    for (int i = 0; i < MAX_PHASE_COUNT; i++)
-    {
-        double d = (M_PI/2) * ((double)i)/((double)MAX_PHASE_COUNT);
-        phase_table[i] = (int)(sin(d) * 1073741824.0);
-    }
-}
-
-void vfo_start(struct vfo *v, int frequency_hz, int start_phase)
-{
-    v->phase_increment = (frequency_hz * 65536) / sampling_freq;
-    v->phase = start_phase;
-    v->freq_hz = frequency_hz;
-}
-
-int vfo_read(struct vfo *v)
-{
-    int i = 0;
-    if (v->phase < 16384)
-        i = phase_table[v->phase];
-    else if (v->phase < 32768)
-        i = phase_table[32767 - v->phase];
-    else if (v->phase < 49152)
-        i =  -phase_table[v->phase - 32768];
-    else
-        i = -phase_table[65535- v->phase];
-
-//increment the phase and modulo-65536
-    v->phase += v->phase_increment;
-    v->phase &= 0xffff;
-
-    return i;
-}
-
-
 // TODO: We need to define our reference and implement the ALC in the rx alsa input
-//
-// TODO: Add to DSP a de-noise function with libspecbleach
-//       https://github.com/Rhizomatica/libspecbleach/blob/main/example/adenoiser_demo.c
 
-void dsp_process_agc()
+void dsp_process_agc(dsp_real *samples, uint32_t block_size)
 {
-    static float input_buffer[1024]; // block_size == 1024
-    static float output_buffer[1024]; // block_size == 1024
-
-    int block_size = MAX_BINS / 2;
-
-    // TODO: define the SLOW, MEDIUM and FAST AGCs
-    short hang_time=400; // in frames
-    float reference=0.2; // reference level
-    float attack_rate=0.02;
-    float decay_rate=0.0002;
-    float max_gain=20; // in db
-    short attack_wait=0;
-    float filter_alpha=0.999;//0.001;
-
-    static float last_gain=1.0;
-
-    for (int i = 0; i < MAX_BINS / 2; i++)
-    {
-        input_buffer[i] = (float) cimag(fft_time[i + (MAX_BINS / 2)]);
-    }
-
-    last_gain = agc_ff(input_buffer, output_buffer, block_size, reference, attack_rate, decay_rate, max_gain, hang_time, attack_wait, filter_alpha, last_gain);
-
-    for (int i = 0; i < MAX_BINS / 2; i++)
-    {
-        __imag__ (fft_time[i + (MAX_BINS / 2)]) = (double) output_buffer[i];
-    }
+    agc_process(&rx_agc, samples, block_size, radio_h_dsp->profiles[radio_h_dsp->profile_active_idx].agc);
 
+    radio_h_dsp->signal_level = (int32_t) lrintf(agc_level_db(&rx_agc) * 10);
+    radio_h_dsp->agc_gain = (int32_t) lrintf(agc_gain_db(&rx_agc) * 10);
 }
 
 // old tests for AGC
@@ -34,19 +34,69 @@
 #define INTERPOLATION 0
 #define DECIMATION 1
 
+// Sample type of the DSP pipeline. "make DSP_FLOAT=1" builds the single
+// precision (fftwf) pipeline, which doubles the number of samples per NEON
+// register and halves the memory traffic. The filter design is always done
+// in double precision.
+#ifdef DSP_FLOAT
+typedef float dsp_real;
+typedef float complex dsp_complex;
+#define DSP_FFTW(name) fftwf_ ## name
+#else
+typedef double dsp_real;
+typedef double complex dsp_complex;
+#define DSP_FFTW(name) fftw_ ## name
+#endif
+
 struct filter
 {
-    complex double *fir_coeff;
-    complex double *overlap;
+    dsp_complex *fir_coeff; // N bins, or partitions * n_fft bins when partitioned
+    dsp_complex *overlap;
     int N;
     int L;
     int M;
+    int n_fft; // fft size of the partitioned overlap-save, N when not partitioned
+    int partitions;
 };
 
-struct vfo {
-	int freq_hz;
-	int phase;
-	int phase_increment;
+#define MAX_BIN_SPANS 4
+
+// a run of contiguous bins of the fused rotate + sideband + filter kernel:
+// out[dst + k] = in[src + k] * coeff[k], bins above n_fft/2 of the real
+// input are read backwards from the hermitian mirror (mirror == true)
+struct bin_span
+{
+    int dst;
+    int src;
+    int count;
+    bool mirror;
+    dsp_complex *coeff;
+};
+
+// a filter pre-rotated and pre-masked for one direction and sideband
+struct filter_bins
+{
+    struct bin_span spans[MAX_BIN_SPANS];
+    int n_spans;
+    struct bin_span zero[2]; // output bins not written by the spans (dst and count only)
+    int n_zero;
+    int n_fft;
+    int n_out;
+    bool fold; // sum the output bins modulo n_out (partitioned rx with decimation)
+    int partitions;
+    int n_coeff; // per partition
+    dsp_complex *coeff;
+};
+
+// filter bank entry: the rx and tx bins of one (mode, bpf_low, bpf_high)
+struct filter_bank_entry
+{
+    bool valid;
+    uint16_t mode;
+    uint32_t bpf_low;
+    uint32_t bpf_high;
+    struct filter_bins rx;
+    struct filter_bins tx;
 };
 
 
@@ -54,35 +104,47 @@ struct vfo {
 void dsp_init(radio *radio_h);
 void dsp_free(radio *radio_h);
 
-// main DSP calls
+// fftw wisdom of this cpu: load before dsp_init(), save after it (when it was
+// not loaded), or generate all of it with FFTW_PATIENT
+bool dsp_wisdom_load();
+bool dsp_wisdom_save();
+bool dsp_wisdom_generate();
+
+// main DSP calls. rx and tx have their own fft state and may run concurrently
+// from two threads; outputs the caller does not own may be NULL
 void dsp_process_rx(uint8_t *buffer_radio_to_dsp, uint8_t *output_speaker, uint8_t *output_loopback, uint8_t * output_tx, uint32_t block_size);
 void dsp_process_tx(uint8_t *signal_input, uint8_t *output_speaker, uint8_t *output_loopback, uint8_t *output_tx, uint32_t block_size, bool input_is_48k_stereo);
 
 // zero fft previous bins
 void fft_reset_m_bins();
 
+// algorithmic latency of the rx or tx chain, in 96 kHz samples
+uint32_t dsp_latency(bool tx);
+
 // set the filters according to bpf_low and bpf_high of current profile
 void dsp_set_filters();
 
-// call the agc code
-void dsp_process_agc();
+// the agc of the profile (see sbitx_agc.h), in place over the block of output
+// samples, and the signal level and agc gain of the radio status
+void dsp_process_agc(dsp_real *samples, uint32_t block_size);
 
 // the the tx band multiplier
 double get_band_multiplier();
 
 // by Ashhar Farhan, from https://github.com/afarhan/sbitx/blob/main/fft_filter.c
 struct filter *filter_new(int input_length, int impulse_length);
+void filter_partition(struct filter *f, int block_size);
 int filter_tune(struct filter *f, double const low, double const high, double const kaiser_beta);
 int window_filter(int const L,int const M,complex double * const response, double const beta);
 int make_kaiser(double * const window,unsigned int const M, double const beta);
 const double i0(double const z);
 
-// https://github.com/afarhan/sbitx/blob/main/vfo.c
-void vfo_init_phase_table();
-void vfo_start(struct vfo *v, int frequency_hz, int start_phase);
-int vfo_read(struct vfo *v);
+// fused frequency domain kernel
+void filter_bins_build(struct filter_bins *fb, struct filter *f, bool tx, bool lsb, int decimation);
+void filter_bins_apply(const struct filter_bins *fb, dsp_complex * const *in, dsp_complex *out);
+struct filter_bank_entry *filter_bank_get(uint16_t mode, uint32_t bpf_low, uint32_t bpf_high);
 
-void rational_resampler(double * in, int in_size, double * out, int rate, int interpolation_decimation);
+void rational_resampler(dsp_real * in, int in_size, dsp_real * out, int rate, int interpolation_decimation);
 double interpolate_linear(double  a,double a_x,double b,double b_x,double x);
 
 #endif // SBITX_DSP_H_
@@ -32,6 +32,7 @@
 #include "gpiolib/gpiolib.h"
 
 #include "sbitx_gpio.h"
+#include "sbitx_cw.h"
 
 // global radio handle pointer used for the callback functions
 static radio *radio_gpio_h;
@@ -142,10 +143,24 @@ void ptt_change()
 
 void dash_change()
 {
-    if (get_level(DASH) == 0)
-        radio_gpio_h->dash_down = true;
-    else
-        radio_gpio_h->dash_down = false;
+    // the edge time, for the cw keyer, before anything else
+    uint64_t t_ns = cw_now_ns();
+    bool down = get_level(DASH) == 0;
+
+    if (down == radio_gpio_h->dash_down)
+        return;
+    radio_gpio_h->dash_down = down;
+
+    // the tx dsp reads the edges only during tx: they are queued then, or
+    // when they start a break-in, see io_tick() (and the key up after it)
+    static bool queued_down = false;
+    radio_profile *profile = &radio_gpio_h->profiles[radio_gpio_h->profile_active_idx];
+    if (profile->mode == MODE_CW &&
+        (radio_gpio_h->txrx_state == IN_TX || (profile->enable_ptt && (down || queued_down))))
+    {
+        cw_key_event(down, t_ns);
+        queued_down = down;
+    }
 }
 
 void knob_a_pressed(void)
@@ -328,8 +343,9 @@ void *do_gpio_poll(void *radio_h_v)
                 changed = 1;
             }
         }
+        // the keying jitter of cw is this poll period
         if (!changed)
-            usleep(1000);
+            usleep((radio_gpio_h->profiles[radio_gpio_h->profile_active_idx].mode == MODE_CW) ? CW_GPIO_POLL_US : 1000);
     }
 
     return NULL;
@@ -0,0 +1,168 @@
+/* sBitx controller - numerically controlled oscillator
+ *
+ * Copyright (C) 2025 Rhizomatica
+ * Author: Rafael Diniz <rafael@riseup.net>
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ *
+ */
+
+#include <string.h>
+#include <math.h>
+
+#if defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#define NCO_NEON
+#elif defined(__SSE4_2__)
+#include <immintrin.h>
+#define NCO_SSE
+#endif
+
+#include "sbitx_nco.h"
+
+#define PHASE_TO_RAD (2 * M_PI / 4294967296.0)
+
+void nco_init(struct nco *o, double rate)
+{
+    o->rate = rate;
+    o->n_tones = 0;
+}
+
+void nco_tone(struct nco *o, uint32_t k, double freq_hz, double amplitude)
+{
+    if (k >= NCO_MAX_TONES || k > o->n_tones)
+        return;
+
+    // modulo 2^32, negative frequencies wrap around
+    o->step[k] = (uint32_t) (int64_t) llround(freq_hz / o->rate * 4294967296.0);
+    o->phase[k] = 0;
+    o->amp[k] = amplitude;
+
+    double w = (int32_t) o->step[k] * PHASE_TO_RAD;
+    for (uint32_t l = 0; l < NCO_LANES; l++)
+    {
+        o->lane_re[k][l] = cos(w * l);
+        o->lane_im[k][l] = sin(w * l);
+    }
+    o->rot_re[k] = (float) cos(w * NCO_LANES);
+    o->rot_im[k] = (float) sin(w * NCO_LANES);
+
+    if (k == o->n_tones)
+        o->n_tones++;
+}
+
+void nco_reset(struct nco *o)
+{
+    for (uint32_t k = 0; k < o->n_tones; k++)
+        o->phase[k] = 0;
+}
+
+double nco_freq(const struct nco *o, uint32_t k)
+{
+    return (int32_t) o->step[k] / 4294967296.0 * o->rate;
+}
+
+// adds tone k over n samples, up to NCO_CHUNK
+static void nco_chunk(struct nco *o, uint32_t k, dsp_real *out, uint32_t n)
+{
+    float re[NCO_LANES], im[NCO_LANES];
+    const float rot_re = o->rot_re[k], rot_im = o->rot_im[k];
+
+    // the lanes from the exact phase of the first sample
+    double a = o->phase[k] * PHASE_TO_RAD;
+    double seed_re = o->amp[k] * cos(a), seed_im = o->amp[k] * sin(a);
+    for (uint32_t l = 0; l < NCO_LANES; l++)
+    {
+        re[l] = (float) (seed_re * o->lane_re[k][l] - seed_im * o->lane_im[k][l]);
+        im[l] = (float) (seed_re * o->lane_im[k][l] + seed_im * o->lane_re[k][l]);
+    }
+
+    // the 8 lanes in two vectors of 4, kept in registers over the chunk
+    uint32_t i = 0;
+#if defined(NCO_NEON)
+    float32x4_t re0 = vld1q_f32(re), re1 = vld1q_f32(re + 4);
+    float32x4_t im0 = vld1q_f32(im), im1 = vld1q_f32(im + 4);
+    for (; i + NCO_LANES <= n; i += NCO_LANES)
+    {
+#ifdef DSP_FLOAT
+        vst1q_f32(out + i, vaddq_f32(vld1q_f32(out + i), im0));
+        vst1q_f32(out + i + 4, vaddq_f32(vld1q_f32(out + i + 4), im1));
+#else
+        vst1q_f64(out + i, vaddq_f64(vld1q_f64(out + i), vcvt_f64_f32(vget_low_f32(im0))));
+        vst1q_f64(out + i + 2, vaddq_f64(vld1q_f64(out + i + 2), vcvt_high_f64_f32(im0)));
+        vst1q_f64(out + i + 4, vaddq_f64(vld1q_f64(out + i + 4), vcvt_f64_f32(vget_low_f32(im1))));
+        vst1q_f64(out + i + 6, vaddq_f64(vld1q_f64(out + i + 6), vcvt_high_f64_f32(im1)));
+#endif
+        float32x4_t t0 = vmlsq_n_f32(vmulq_n_f32(re0, rot_re), im0, rot_im);
+        float32x4_t t1 = vmlsq_n_f32(vmulq_n_f32(re1, rot_re), im1, rot_im);
+        im0 = vmlaq_n_f32(vmulq_n_f32(re0, rot_im), im0, rot_re);
+        im1 = vmlaq_n_f32(vmulq_n_f32(re1, rot_im), im1, rot_re);
+        re0 = t0;
+        re1 = t1;
+    }
+    vst1q_f32(im, im0);
+    vst1q_f32(im + 4, im1);
+#elif defined(NCO_SSE)
+    const __m128 cr = _mm_set1_ps(rot_re), ci = _mm_set1_ps(rot_im);
+    __m128 re0 = _mm_loadu_ps(re), re1 = _mm_loadu_ps(re + 4);
+    __m128 im0 = _mm_loadu_ps(im), im1 = _mm_loadu_ps(im + 4);
+    for (; i + NCO_LANES <= n; i += NCO_LANES)
+    {
+#ifdef DSP_FLOAT
+        _mm_storeu_ps(out + i, _mm_add_ps(_mm_loadu_ps(out + i), im0));
+        _mm_storeu_ps(out + i + 4, _mm_add_ps(_mm_loadu_ps(out + i + 4), im1));
+#else
+        _mm_storeu_pd(out + i, _mm_add_pd(_mm_loadu_pd(out + i), _mm_cvtps_pd(im0)));
+        _mm_storeu_pd(out + i + 2, _mm_add_pd(_mm_loadu_pd(out + i + 2), _mm_cvtps_pd(_mm_movehl_ps(im0, im0))));
+        _mm_storeu_pd(out + i + 4, _mm_add_pd(_mm_loadu_pd(out + i + 4), _mm_cvtps_pd(im1)));
+        _mm_storeu_pd(out + i + 6, _mm_add_pd(_mm_loadu_pd(out + i + 6), _mm_cvtps_pd(_mm_movehl_ps(im1, im1))));
+#endif
+        __m128 t0 = _mm_sub_ps(_mm_mul_ps(re0, cr), _mm_mul_ps(im0, ci));
+        __m128 t1 = _mm_sub_ps(_mm_mul_ps(re1, cr), _mm_mul_ps(im1, ci));
+        im0 = _mm_add_ps(_mm_mul_ps(re0, ci), _mm_mul_ps(im0, cr));
+        im1 = _mm_add_ps(_mm_mul_ps(re1, ci), _mm_mul_ps(im1, cr));
+        re0 = t0;
+        re1 = t1;
+    }
+    _mm_storeu_ps(im, im0);
+    _mm_storeu_ps(im + 4, im1);
+#else
+    for (; i + NCO_LANES <= n; i += NCO_LANES)
+    {
+        for (uint32_t l = 0; l < NCO_LANES; l++)
+        {
+            out[i + l] += im[l];
+            float t = re[l] * rot_re - im[l] * rot_im;
+            im[l] = re[l] * rot_im + im[l] * rot_re;
+            re[l] = t;
+        }
+    }
+#endif
+    // the last samples, from the lanes of the next step
+    for (uint32_t l = 0; i < n; i++, l++)
+        out[i] += im[l];
+
+    o->phase[k] += n * o->step[k];
+}
+
+void nco_fill(struct nco *o, dsp_real *out, uint32_t n)
+{
+    memset(out, 0, n * sizeof(dsp_real));
+
+    for (uint32_t k = 0; k < o->n_tones; k++)
+        for (uint32_t i = 0; i < n; i += NCO_CHUNK)
+            nco_chunk(o, k, out + i, (n - i < NCO_CHUNK) ? n - i : NCO_CHUNK);
+}
@@ -0,0 +1,74 @@
+/* sBitx controller - numerically controlled oscillator
+ *
+ * Copyright (C) 2025 Rhizomatica
+ * Author: Rafael Diniz <rafael@riseup.net>
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ *
+ */
+
+#ifndef SBITX_NCO_H_
+#define SBITX_NCO_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "sbitx_dsp.h"
+
+// Block oscillator for the tx test tones and the cw keyer: a 32 bit phase
+// accumulator per tone (frequency steps of rate / 2^32, 22 uHz at 96 kHz,
+// and no phase drift over any run), and the samples of a block from a
+// recursive oscillator seeded at the exact phase of the block, NCO_LANES
+// samples apart, so the fill is a plain complex multiply over independent
+// lanes, two NEON or SSE vectors of 4 (a scalar loop elsewhere). It is
+// reseeded every NCO_CHUNK samples, before the float rounding of the
+// recursion reaches -100 dB.
+
+#define NCO_MAX_TONES 4
+#define NCO_LANES 8
+#define NCO_CHUNK 1024
+
+// the peak of the tx tone, the one of the band power calibration
+#define NCO_TONE_LEVEL (1073741824.0 / 4800000000.0)
+
+struct nco
+{
+    double rate;
+    uint32_t n_tones;
+    uint32_t phase[NCO_MAX_TONES];
+    uint32_t step[NCO_MAX_TONES];
+    double amp[NCO_MAX_TONES];
+    double lane_re[NCO_MAX_TONES][NCO_LANES], lane_im[NCO_MAX_TONES][NCO_LANES]; // e^(j w l)
+    float rot_re[NCO_MAX_TONES], rot_im[NCO_MAX_TONES]; // e^(j w NCO_LANES)
+};
+
+// no tones, at rate samples per second
+void nco_init(struct nco *o, double rate);
+
+// tone k (up to NCO_MAX_TONES, the following ones after the previous ones)
+// at freq_hz with a peak of amplitude, from phase 0
+void nco_tone(struct nco *o, uint32_t k, double freq_hz, double amplitude);
+
+// all the tones back to phase 0
+void nco_reset(struct nco *o);
+
+// the sum of the tones over the next n samples
+void nco_fill(struct nco *o, dsp_real *out, uint32_t n);
+
+// the frequency tone k really has, from its phase step
+double nco_freq(const struct nco *o, uint32_t k);
+
+#endif // SBITX_NCO_H_
@@ -0,0 +1,256 @@
+/* sBitx controller - adaptive resampler for the loopback clock domain
+ *
+ * Copyright (C) 2025 Rhizomatica
+ * Author: Rafael Diniz <rafael@riseup.net>
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+
+#include "sbitx_resampler.h"
+#include "sbitx_dsp.h"
+
+// cutoff (fraction of the 24 kHz nyquist) and kaiser beta of the prototype
+#define RESAMPLER_CUTOFF 0.9
+#define RESAMPLER_BETA 8.0
+
+// fill low pass time constant, and the PI gains (critically damped,
+// Ki = Kp^2 / 4, ~20 s to settle)
+#define FILL_TAU 0.5
+#define CONTROL_KP 0.1
+#define CONTROL_KI 0.0025
+
+// the integral only follows errors smaller than this (in seconds), a ring
+// cleared or refilled at once is a step, not drift
+#define INTEGRATE_WINDOW 0.005
+
+// phase p delays by p / RESAMPLER_PHASES of a frame, the extra last phase is
+// the first one shifted by a frame, for the interpolation
+static float coeffs[RESAMPLER_PHASES + 1][RESAMPLER_TAPS];
+static pthread_once_t coeffs_once = PTHREAD_ONCE_INIT;
+
+static void make_coeffs()
+{
+    const double half = RESAMPLER_TAPS / 2;
+
+    for (int p = 0; p <= RESAMPLER_PHASES; p++)
+    {
+        double frac = (double) p / RESAMPLER_PHASES;
+        double sum = 0;
+        double h[RESAMPLER_TAPS];
+
+        for (int k = 0; k < RESAMPLER_TAPS; k++)
+        {
+            // distance of tap k to the output instant
+            double d = k - half + 1 - frac;
+            double x = M_PI * RESAMPLER_CUTOFF * d;
+            double sinc = (d == 0) ? 1 : sin(x) / x;
+            double w = d / half;
+            double kaiser = (fabs(w) < 1) ? i0(RESAMPLER_BETA * sqrt(1 - w * w)) / i0(RESAMPLER_BETA) : 0;
+            h[k] = sinc * kaiser;
+            sum += h[k];
+        }
+
+        // unity gain at DC on every phase
+        for (int k = 0; k < RESAMPLER_TAPS; k++)
+            coeffs[p][k] = h[k] / sum;
+    }
+}
+
+void resampler_reset(struct resampler *r)
+{
+    r->ratio = 1.0;
+
+    // TAPS - 1 frames of silence, the output is delayed by TAPS / 2 frames
+    r->n_hist = RESAMPLER_TAPS - 1;
+    r->t = RESAMPLER_TAPS / 2 - 1;
+    memset(r->hist, 0, sizeof(r->hist));
+
+    r->last_ns = 0;
+    r->correction_ppm = 0;
+}
+
+void resampler_init(struct resampler *r, uint32_t channels, uint32_t rate, uint32_t block_frames, uint32_t target_frames, bool producer)
+{
+    pthread_once(&coeffs_once, make_coeffs);
+
+    if (channels > RESAMPLER_MAX_CHANNELS)
+        channels = RESAMPLER_MAX_CHANNELS;
+
+    r->channels = channels;
+    r->producer = producer;
+    r->rate = rate;
+    r->block = (double) block_frames / rate;
+    r->target = (double) target_frames / rate;
+    r->block_ns = 0;
+    r->integral = 0;
+    r->ppm = 0;
+    r->fill = 0;
+
+    resampler_reset(r);
+}
+
+void resampler_block(struct resampler *r, uint64_t now_ns)
+{
+    r->block_ns = now_ns;
+}
+
+void resampler_control(struct resampler *r, uint32_t fill_frames, uint64_t now_ns)
+{
+    double fill = fill_frames / r->rate;
+
+    // The fill jumps by a block when the dsp thread moves one, and the alsa
+    // periods sample this sawtooth at a phase that slowly walks with the
+    // drift itself: seen as if the block went in (or out) evenly until the
+    // next one, which leaves the fill just before the next block
+    uint64_t block_ns = r->block_ns;
+    if (block_ns != 0 && now_ns >= block_ns)
+    {
+        double since = (now_ns - block_ns) * 1e-9;
+        double pending = (since < r->block) ? r->block - since : 0;
+        fill += r->producer ? pending : -pending;
+    }
+
+    if (r->last_ns == 0 || now_ns <= r->last_ns)
+    {
+        r->fill_avg = fill;
+        r->last_ns = now_ns;
+        return;
+    }
+
+    double dt = (now_ns - r->last_ns) * 1e-9;
+    r->last_ns = now_ns;
+    if (dt > FILL_TAU)
+        dt = FILL_TAU;
+
+    r->fill_avg += (fill - r->fill_avg) * (dt / FILL_TAU);
+
+    // a fill above the target is too many input frames for the output:
+    // consume more (playback) or produce less (capture), both a ratio > 1
+    double e = r->fill_avg - r->target;
+    double max = RESAMPLER_MAX_PPM * 1e-6;
+
+    if (fabs(e) < INTEGRATE_WINDOW)
+    {
+        r->integral += CONTROL_KI * e * dt;
+        if (r->integral > max)
+            r->integral = max;
+        if (r->integral < -max)
+            r->integral = -max;
+    }
+
+    double correction = CONTROL_KP * e + r->integral;
+    if (correction > max)
+        correction = max;
+    if (correction < -max)
+        correction = -max;
+
+    r->ratio = 1.0 + correction;
+
+    // the integral settles at the clock offset: capture ratio is the loopback
+    // over the codec rate, playback ratio the codec over the loopback one
+    r->ppm = (float) ((r->producer ? r->integral : -r->integral) * 1e6);
+    r->correction_ppm = (float) (correction * 1e6);
+    r->fill = (uint32_t) (r->fill_avg * r->rate);
+}
+
+uint32_t resampler_needed(struct resampler *r, uint32_t out_frames)
+{
+    if (out_frames == 0)
+        return 0;
+
+    // the same accumulation as resampler_process(), so the count is exact
+    double t = r->t;
+    for (uint32_t i = 1; i < out_frames; i++)
+        t += r->ratio;
+
+    int64_t last = (int64_t) floor(t) + RESAMPLER_TAPS / 2;
+    int64_t needed = last + 1 - r->n_hist;
+
+    return (needed > 0) ? (uint32_t) needed : 0;
+}
+
+static inline int32_t float_to_s32(float x)
+{
+    if (x >= 2147483520.0f)
+        return INT32_MAX;
+    if (x <= -2147483648.0f)
+        return INT32_MIN;
+    return (int32_t) lrintf(x);
+}
+
+uint32_t resampler_process(struct resampler *r, const int32_t *in, uint32_t in_frames, int32_t *out, uint32_t max_out)
+{
+    const uint32_t ch = r->channels;
+    const uint32_t capacity = RESAMPLER_TAPS + RESAMPLER_MAX_FRAMES;
+
+    if (r->n_hist + in_frames > capacity)
+    {
+        fprintf(stderr, "resampler: %u input frames dropped\n", r->n_hist + in_frames - capacity);
+        in_frames = capacity - r->n_hist;
+    }
+
+    float *h = r->hist + r->n_hist * ch;
+    for (uint32_t i = 0; i < in_frames * ch; i++)
+        h[i] = (float) in[i];
+    r->n_hist += in_frames;
+
+    uint32_t n_out = 0;
+    while (n_out < max_out)
+    {
+        double ti = floor(r->t);
+        int32_t base = (int32_t) ti;
+
+        if (base + RESAMPLER_TAPS / 2 >= (int32_t) r->n_hist)
+            break;
+
+        float phase = (float) ((r->t - ti) * RESAMPLER_PHASES);
+        int p = (int) phase;
+        float mu = phase - p;
+        const float *h0 = coeffs[p];
+        const float *h1 = coeffs[p + 1];
+        const float *x = r->hist + (base - RESAMPLER_TAPS / 2 + 1) * ch;
+
+        for (uint32_t c = 0; c < ch; c++)
+        {
+            float acc = 0;
+            for (int k = 0; k < RESAMPLER_TAPS; k++)
+                acc += (h0[k] + mu * (h1[k] - h0[k])) * x[k * ch + c];
+            out[n_out * ch + c] = float_to_s32(acc);
+        }
+
+        r->t += r->ratio;
+        n_out++;
+    }
+
+    // keep from the first frame the next output still needs
+    int32_t drop = (int32_t) floor(r->t) - RESAMPLER_TAPS / 2 + 1;
+    if (drop > (int32_t) r->n_hist)
+        drop = r->n_hist;
+    if (drop > 0)
+    {
+        memmove(r->hist, r->hist + drop * ch, (r->n_hist - drop) * ch * sizeof(float));
+        r->n_hist -= drop;
+        r->t -= drop;
+    }
+
+    return n_out;
+}
@@ -0,0 +1,92 @@
+/* sBitx controller - adaptive resampler for the loopback clock domain
+ *
+ * Copyright (C) 2025 Rhizomatica
+ * Author: Rafael Diniz <rafael@riseup.net>
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ *
+ */
+
+#ifndef SBITX_RESAMPLER_H_
+#define SBITX_RESAMPLER_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+// The wm8731 and the snd-aloop run from different clocks, so the 48 kHz on
+// each side of a loopback ring differ by some ppm, and the ring slowly fills
+// up or drains. The loopback alsa thread resamples by a ratio close to 1,
+// steered by a PI controller on the (low pass filtered) fill of its ring.
+//
+// Polyphase windowed sinc: RESAMPLER_TAPS taps, RESAMPLER_PHASES fractional
+// delays, linear interpolation between two adjacent phases.
+
+#define RESAMPLER_TAPS 16
+#define RESAMPLER_PHASES 64
+#define RESAMPLER_MAX_FRAMES 2048 // input frames per call
+#define RESAMPLER_MAX_CHANNELS 2
+
+// the correction is clamped to +- RESAMPLER_MAX_PPM
+#define RESAMPLER_MAX_PPM 1000
+
+struct resampler
+{
+    uint32_t channels;
+    bool producer; // true: the resampler writes the ring (capture), false: reads it (playback)
+
+    double ratio; // input frames per output frame
+    double t; // position of the next output frame, in input frames from hist[0]
+    uint32_t n_hist; // frames in hist
+    float hist[(RESAMPLER_TAPS + RESAMPLER_MAX_FRAMES) * RESAMPLER_MAX_CHANNELS];
+
+    // fill controller, in seconds
+    double rate;
+    double block; // the dsp thread moves a block at a time
+    double target;
+    double fill_avg;
+    double integral;
+    uint64_t last_ns; // previous resampler_control()
+    _Atomic uint64_t block_ns; // last block moved by the dsp thread, see resampler_block()
+
+    // statistics, written by the alsa thread
+    _Atomic float ppm; // estimated clock offset of the loopback against the codec, > 0 when the loopback is faster
+    _Atomic float correction_ppm; // (ratio - 1) * 1e6 being applied
+    _Atomic uint32_t fill; // filtered ring fill, in frames
+};
+
+// rate: frames per second, block_frames: the frames the dsp thread moves at
+// once, target_frames: the fill the controller keeps, taken just before the
+// dsp thread writes (playback) or reads (capture) its next block
+void resampler_init(struct resampler *r, uint32_t channels, uint32_t rate, uint32_t block_frames, uint32_t target_frames, bool producer);
+
+// back to ratio 1 and empty history, the drift estimate is kept
+void resampler_reset(struct resampler *r);
+
+// called by the dsp thread each time it moves a block through the ring
+void resampler_block(struct resampler *r, uint64_t now_ns);
+
+// called by the alsa thread once per period with the ring fill in frames
+void resampler_control(struct resampler *r, uint32_t fill_frames, uint64_t now_ns);
+
+// new input frames needed to output exactly out_frames
+uint32_t resampler_needed(struct resampler *r, uint32_t out_frames);
+
+// consumes all the in_frames (interleaved S32), writes up to max_out frames,
+// returns the number of frames written. Input left over stays in the history
+uint32_t resampler_process(struct resampler *r, const int32_t *in, uint32_t in_frames, int32_t *out, uint32_t max_out);
+
+#endif // SBITX_RESAMPLER_H_
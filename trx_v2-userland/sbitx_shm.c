@@ -42,6 +42,7 @@
 #include "shm_utils.h"
 #include "sbitx_shm.h"
 #include "sbitx_io.h"
+#include "sbitx_alsa.h"
 
 #include "radio_cmds.h"
 
@@ -347,7 +348,10 @@ void process_radio_command(uint8_t *cmd, uint8_t *response)
 
    case CMD_SET_TONE: // SET_TONE
        response[0] = CMD_RESP_ACK;
-       memcpy(&radio_h->tone_generation, cmd, 1);
+       if (cmd[0] <= TONE_TWO)
+           radio_h->tone_generation = cmd[0];
+       else
+           response[0] = CMD_RESP_WRONG_COMMAND;
        break;
 
    case CMD_GET_BITRATE: // CMD_GET_BITRATE
@@ -390,6 +394,61 @@ void process_radio_command(uint8_t *cmd, uint8_t *response)
        memcpy(response+1, &radio_h->bytes_transmitted, 4);
        break;
 
+   case CMD_GET_AGC: // GET AGC
+       profile = cmd[4] >> 6;
+       if (profile < radio_h->profiles_count)
+       {
+           response[0] = CMD_RESP_GET_AGC;
+           response[1] = (uint8_t) radio_h->profiles[profile].agc;
+       }
+       break;
+
+   case CMD_SET_AGC: // SET AGC
+       response[0] = CMD_RESP_ACK;
+       profile = cmd[4] >> 6;
+       if (profile < radio_h->profiles_count && cmd[0] <= AGC_FAST)
+           set_agc(radio_h, cmd[0], profile);
+       else
+           response[0] = CMD_RESP_WRONG_COMMAND;
+       break;
+
+   case CMD_GET_COMPRESSOR: // GET COMPRESSOR
+       profile = cmd[4] >> 6;
+       if (profile < radio_h->profiles_count)
+       {
+           response[0] = CMD_RESP_GET_COMPRESSOR;
+           response[1] = (uint8_t) radio_h->profiles[profile].compressor;
+       }
+       break;
+
+   case CMD_SET_COMPRESSOR: // SET COMPRESSOR
+       response[0] = CMD_RESP_ACK;
+       profile = cmd[4] >> 6;
+       if (profile < radio_h->profiles_count)
+           set_compressor(radio_h, cmd[0] ? COMPRESSOR_ON : COMPRESSOR_OFF, profile);
+       break;
+
+   case CMD_GET_SIGNAL_LEVEL:
+   {
+       response[0] = CMD_RESP_GET_SIGNAL_LEVEL;
+       int16_t level = (int16_t) radio_h->signal_level;
+       int16_t gain = (int16_t) radio_h->agc_gain;
+       memcpy(response+1, &level, 2);
+       memcpy(response+3, &gain, 2);
+       break;
+   }
+
+   case CMD_GET_XRUNS:
+       if (cmd[0] < AUDIO_DEVICE_COUNT)
+       {
+           response[0] = CMD_RESP_GET_XRUNS;
+           uint32_t xruns = audio_xrun_stats[cmd[0]].xruns;
+           memcpy(response+1, &xruns, 4);
+       }
+       else
+           response[0] = CMD_RESP_WRONG_COMMAND;
+       break;
+
 
 // TODO: finish implementig the remaining commands
 #if 0
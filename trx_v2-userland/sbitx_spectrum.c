@@ -0,0 +1,207 @@
+/* sBitx controller - rx spectrum tap
+ *
+ * Copyright (C) 2025 Rhizomatica
+ * Author: Rafael Diniz <rafael@riseup.net>
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ *
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <stdatomic.h>
+#include <semaphore.h>
+
+#include "sbitx_spectrum.h"
+#include "shm_utils.h"
+
+extern _Atomic bool shutdown_;
+
+spectrum_page *spectrum_shm;
+
+// power of the bins 0 to n_fft / 2 - 1, summed over blocks
+struct spectrum_acc
+{
+    float power[SPECTRUM_MAX_BINS * 2];
+    uint32_t blocks;
+    uint32_t n_fft;
+};
+
+// Triple buffer: the rx dsp fills acc[back], then swaps it with the middle
+// one, flagged SPECTRUM_FRESH. The spectrum thread swaps the middle one with
+// acc[front] when it is fresh. A frame the thread had no time for is just
+// replaced by the next one.
+#define SPECTRUM_FRESH 4
+static struct spectrum_acc acc[3];
+static int back = 0, front = 1;
+static _Atomic int middle = 2;
+
+static _Atomic bool enabled = false;
+static uint32_t blocks_per_frame;
+static sem_t spectrum_wakeup;
+static radio *radio_h_spectrum;
+
+void spectrum_tap(const dsp_complex *fft_out, uint32_t n_fft)
+{
+    if (!enabled)
+        return;
+
+    struct spectrum_acc *a = &acc[back];
+    uint32_t n = n_fft / 2;
+
+    if (a->blocks == 0)
+    {
+        memset(a->power, 0, n * sizeof(float));
+        a->n_fft = n_fft;
+    }
+
+    for (uint32_t i = 0; i < n; i++)
+    {
+        dsp_real re = __real__ fft_out[i], im = __imag__ fft_out[i];
+        a->power[i] += (float) (re * re + im * im);
+    }
+
+    if (++a->blocks < blocks_per_frame)
+        return;
+
+    back = atomic_exchange(&middle, back | SPECTRUM_FRESH) & ~SPECTRUM_FRESH;
+    acc[back].blocks = 0;
+    sem_post(&spectrum_wakeup);
+}
+
+static void spectrum_publish(struct spectrum_acc *a)
+{
+    spectrum_page *page = spectrum_shm;
+    uint32_t n_fft = a->n_fft;
+    uint32_t n = n_fft / 2;
+    uint32_t n_bins = radio_h_spectrum->spectrum_bins < n ? radio_h_spectrum->spectrum_bins : n;
+    uint32_t group = n / n_bins;
+    double full_bin_hz = 96000.0 / n_fft;
+
+    // a full scale sine is n_fft / 2 in its bin (rectangular window)
+    double scale = 1.0 / ((double) a->blocks * (n_fft / 2.0) * (n_fft / 2.0));
+
+    uint32_t seq = atomic_load_explicit(&page->seq, memory_order_relaxed);
+    atomic_store_explicit(&page->seq, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    for (uint32_t j = 0; j < n_bins; j++)
+    {
+        float peak = 0;
+        for (uint32_t k = j * group; k < (j + 1) * group; k++)
+            if (a->power[k] > peak)
+                peak = a->power[k];
+        page->db[j] = (float) (10.0 * log10(peak * scale + 1e-20));
+    }
+
+    // the dial frequency is at bin n_fft / 4 of the IF
+    page->frame++;
+    page->freq = radio_h_spectrum->profiles[radio_h_spectrum->profile_active_idx].freq;
+    page->bin_hz = (float) (full_bin_hz * group);
+    page->first_hz = (float) (((group - 1) / 2.0 - n_fft / 4.0) * full_bin_hz);
+    page->n_bins = n_bins;
+    page->fps = radio_h_spectrum->spectrum_fps;
+
+    atomic_store_explicit(&page->seq, seq + 2, memory_order_release);
+}
+
+static void *spectrum_thread(void *arg)
+{
+    while (!shutdown_ && enabled)
+    {
+        sem_wait(&spectrum_wakeup);
+
+        if (!(middle & SPECTRUM_FRESH))
+            continue;
+
+        front = atomic_exchange(&middle, front) & ~SPECTRUM_FRESH;
+        spectrum_publish(&acc[front]);
+    }
+
+    return NULL;
+}
+
+uint32_t spectrum_ws_frame(const spectrum_page *page, uint8_t *frame)
+{
+    uint16_t n_bins = page->n_bins;
+    int16_t db_min = SPECTRUM_WS_DB_MIN;
+    uint16_t db_step = (uint16_t) (SPECTRUM_WS_DB_STEP * 100);
+
+    memcpy(frame, "SP", 2);
+    memcpy(frame + 2, &n_bins, 2);
+    memcpy(frame + 4, &page->frame, 4);
+    memcpy(frame + 8, &page->freq, 4);
+    memcpy(frame + 12, &page->first_hz, 4);
+    memcpy(frame + 16, &page->bin_hz, 4);
+    memcpy(frame + 20, &db_min, 2);
+    memcpy(frame + 22, &db_step, 2);
+
+    uint8_t *bins = frame + SPECTRUM_WS_HEADER;
+    for (uint32_t j = 0; j < n_bins; j++)
+    {
+        float v = (page->db[j] - SPECTRUM_WS_DB_MIN) / SPECTRUM_WS_DB_STEP;
+        bins[j] = (v < 0) ? 0 : (v > 255) ? 255 : (uint8_t) lrintf(v);
+    }
+
+    return SPECTRUM_WS_HEADER + n_bins;
+}
+
+void spectrum_init(radio *radio_h, pthread_t *spectrum_tid)
+{
+    radio_h_spectrum = radio_h;
+
+    if (shm_is_created(SYSV_SHM_SPECTRUM_KEY, sizeof(spectrum_page)))
+    {
+        fprintf(stderr, "Spectrum SHM is already created, Destroying it and creating again.\n");
+        shm_destroy(SYSV_SHM_SPECTRUM_KEY, sizeof(spectrum_page));
+    }
+    shm_create(SYSV_SHM_SPECTRUM_KEY, sizeof(spectrum_page));
+
+    spectrum_shm = shm_attach(SYSV_SHM_SPECTRUM_KEY, sizeof(spectrum_page));
+    if (!spectrum_shm)
+    {
+        fprintf(stderr, "Can not attach the spectrum SHM, no spectrum.\n");
+        return;
+    }
+    memset(spectrum_shm, 0, sizeof(spectrum_page));
+
+    if (radio_h->spectrum_fps == 0)
+        return;
+
+    // whole blocks per frame, so the frame rate is approximate
+    double block_rate = 96000.0 / radio_h->dsp_block_size;
+    blocks_per_frame = (uint32_t) lrint(block_rate / radio_h->spectrum_fps);
+    if (blocks_per_frame == 0)
+        blocks_per_frame = 1;
+
+    sem_init(&spectrum_wakeup, 0, 0);
+    enabled = true;
+    pthread_create(spectrum_tid, NULL, spectrum_thread, NULL);
+    pthread_setname_np(*spectrum_tid, "spectrum");
+}
+
+void spectrum_shutdown(pthread_t *spectrum_tid)
+{
+    if (!enabled)
+        return;
+
+    enabled = false;
+    sem_post(&spectrum_wakeup);
+    pthread_join(*spectrum_tid, NULL);
+}
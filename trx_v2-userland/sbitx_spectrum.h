@@ -0,0 +1,62 @@
+/* sBitx controller - rx spectrum tap
+ *
+ * Copyright (C) 2025 Rhizomatica
+ * Author: Rafael Diniz <rafael@riseup.net>
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ *
+ */
+
+#ifndef SBITX_SPECTRUM_H_
+#define SBITX_SPECTRUM_H_
+
+#include <stdint.h>
+#include <pthread.h>
+
+#include "sbitx_core.h"
+#include "sbitx_dsp.h"
+#include "sbitx_io.h"
+
+// The rx dsp adds the power of each bin of its forward fft (the whole
+// 96 kHz IF, the dial frequency at 24 kHz) to an accumulator, and every
+// 1 / spectrum_fps seconds hands it over to the spectrum thread, without
+// locks. The spectrum thread averages, decimates to spectrum_bins (the peak
+// of each group of bins), converts to dBFS and publishes the frame in the
+// spectrum_page shared memory (see sbitx_io.h), for the websocket and any
+// other client.
+
+#define SPECTRUM_MAX_FPS 25
+
+// websocket binary frame: a SPECTRUM_WS_HEADER bytes header, little endian:
+// "SP", n_bins (u16), frame (u32), freq (u32), first_hz (f32), bin_hz (f32),
+// db_min (i16, dB), db_step (u16, centi dB), then n_bins bytes, each
+// db_min + value * db_step dBFS
+#define SPECTRUM_WS_HEADER 24
+#define SPECTRUM_WS_DB_MIN -160
+#define SPECTRUM_WS_DB_STEP 0.625
+
+extern spectrum_page *spectrum_shm;
+
+// rx dsp thread, once per block
+void spectrum_tap(const dsp_complex *fft_out, uint32_t n_fft);
+
+// websocket frame of a page, returns its size
+uint32_t spectrum_ws_frame(const spectrum_page *page, uint8_t *frame);
+
+void spectrum_init(radio *radio_h, pthread_t *spectrum_tid);
+void spectrum_shutdown(pthread_t *spectrum_tid);
+
+#endif // SBITX_SPECTRUM_H_
@@ -32,6 +32,9 @@
 #include "sbitx_websocket.h"
 #include "sbitx_core.h"
 #include "sbitx_io.h"
+#include "sbitx_alsa.h"
+#include "sbitx_spectrum.h"
+#include "sbitx_cw.h"
 
 static const char *s_listen_on = "wss://0.0.0.0:8080";
 static char s_web_root[1000];
@@ -48,6 +51,9 @@ extern controller_conn *connector_local;
 char request[200];
 int request_index = 0;
 
+// c->data[WS_DATA_SPECTRUM] is set when the client asked for the spectrum frames
+#define WS_DATA_SPECTRUM 0
+
 static void web_respond(struct mg_connection *c, char *message)
 {
     mg_ws_send(c, message, strlen(message), WEBSOCKET_OP_TEXT);
@@ -61,11 +67,11 @@ static void web_despatcher(struct mg_connection *c, struct mg_ws_message *wm){
     request[wm->data.len] = 0;
     char *cookie = NULL;
     char *field = NULL;
-    // char *value = NULL;
+    char *value = NULL;
 
     cookie = strtok(request, "\n");
     field = strtok(NULL, "=");
-    // value = strtok(NULL, "\n");
+    value = strtok(NULL, "\n");
 
     if (cookie != NULL)
     {
@@ -84,6 +90,37 @@ static void web_despatcher(struct mg_connection *c, struct mg_ws_message *wm){
         web_respond(c, "quit Ill formed request");
         c->is_draining = 1;
     }
+    else if (!strcmp(field, "spectrum") && value != NULL)
+    {
+        // "spectrum=1" subscribes to the binary spectrum frames, "spectrum=0" stops them
+        c->data[WS_DATA_SPECTRUM] = (value[0] == '1');
+    }
+}
+
+// one binary frame per new spectrum page, to the subscribed clients only
+static void web_spectrum_send(uint32_t *last_frame)
+{
+    static spectrum_page page;
+    static uint8_t frame[SPECTRUM_WS_HEADER + SPECTRUM_MAX_BINS];
+
+    if (spectrum_shm == NULL)
+        return;
+
+    spectrum_read(spectrum_shm, &page);
+    if (page.frame == *last_frame || page.n_bins == 0)
+        return;
+    *last_frame = page.frame;
+
+    uint32_t len = 0;
+    for (struct mg_connection *c = mgr.conns; c != NULL; c = c->next)
+    {
+        if (c->is_accepted && c->is_websocket && !c->is_draining && c->data[WS_DATA_SPECTRUM])
+        {
+            if (len == 0)
+                len = spectrum_ws_frame(&page, frame);
+            mg_ws_send(c, frame, len, WEBSOCKET_OP_BINARY);
+        }
+    }
 }
 
 // This RESTful server implements the following endpoints:
@@ -143,7 +180,8 @@ static void fn(struct mg_connection *c, int ev, void *ev_data, void *fn_data) {
 
 void *webserver_thread_function(void *radio_h_v)
 {
-    uint64_t counter = 0;
+    uint64_t next_status = 0;
+    uint32_t spectrum_frame = 0;
     char message[MAX_MESSAGE_SIZE];
     mg_mgr_init(&mgr);  // Initialise event manager
     mg_http_listen(&mgr, s_listen_on, fn, NULL);  // Create HTTPS listener
@@ -152,13 +190,24 @@ void *webserver_thread_function(void *radio_h_v)
 
     memset(message, 0, MAX_MESSAGE_SIZE);
 
-    mg_mgr_poll(&mgr, 100);
+    // status every 500 ms (or when asked), spectrum frames as they come
+    int poll_ms = 100;
+    if (radio_h->spectrum_fps && 500 / radio_h->spectrum_fps < poll_ms)
+        poll_ms = 500 / radio_h->spectrum_fps;
+
+    mg_mgr_poll(&mgr, poll_ms);
 
     while (!shutdown_)
     {
-        counter++;
-        if ((counter % 5) && !radio_h->send_ws_update)
+        web_spectrum_send(&spectrum_frame);
+
+        if (mg_millis() < next_status && !radio_h->send_ws_update)
             goto socket_poll;
+        next_status = mg_millis() + 500;
+
+        // the text decoded since the last status, the same for every client
+        char cw_text[CW_TEXT_SIZE];
+        cw_text_read(cw_text, sizeof(cw_text));
 
         for(struct mg_connection* c = mgr.conns; c != NULL; c = c->next)
         {
@@ -170,6 +219,12 @@ void *webserver_thread_function(void *radio_h_v)
                 sprintf(buff+strlen(buff), "\"swr\": %u,\n", get_swr(radio_h));
                 sprintf(buff+strlen(buff), "\"bitrate\": %u,\n", radio_h->bitrate);
                 sprintf(buff+strlen(buff), "\"snr\": %d,\n", radio_h->snr);
+                // rx audio level before the agc (dBFS) and agc gain (dB), the s-meter
+                sprintf(buff+strlen(buff), "\"signal_level\": %.1f,\n", radio_h->signal_level / 10.0);
+                sprintf(buff+strlen(buff), "\"agc_gain\": %.1f,\n", radio_h->agc_gain / 10.0);
+                // cw decoder, only json safe characters
+                sprintf(buff+strlen(buff), "\"cw_text\": \"%s\",\n", cw_text);
+                sprintf(buff+strlen(buff), "\"cw_wpm\": %u,\n", cw_rx_wpm);
                 sprintf(buff+strlen(buff), "\"rx\": %s,\n", radio_h->txrx_state ? "false":"true");
                 sprintf(buff+strlen(buff), "\"tx\": %s,\n", radio_h->txrx_state ? "true":"false");
                 sprintf(buff+strlen(buff), "\"led\": %s,\n", radio_h->system_is_ok ? "true":"false");
@@ -189,6 +244,39 @@ void *webserver_thread_function(void *radio_h_v)
                 struct tm tm = *localtime(&t);
                 sprintf(buff+strlen(buff), "\"datetime\": \"%02d/%02d/%d %02d:%02d:%02d\",\n", tm.tm_mday, tm.tm_mon + 1, tm.tm_year + 1900, tm.tm_hour, tm.tm_min, tm.tm_sec);
 
+                // cpu load of the audio threads, in per mille of one core
+                for (int i = 0; i < AUDIO_THREAD_COUNT; i++)
+                    sprintf(buff+strlen(buff), "\"load_%s\": %u,\n", audio_thread_stats[i].name, audio_thread_stats[i].cpu_load);
+                sprintf(buff+strlen(buff), "\"block_us_dsp_rx\": %u,\n", audio_thread_stats[AUDIO_THREAD_DSP_RX].block_max_us);
+                sprintf(buff+strlen(buff), "\"block_us_dsp_tx\": %u,\n", audio_thread_stats[AUDIO_THREAD_DSP_TX].block_max_us);
+
+                // xruns of each alsa device, the time is CLOCK_REALTIME in ms
+                for (int i = 0; i < AUDIO_DEVICE_COUNT; i++)
+                {
+                    struct audio_xrun_stats *x = &audio_xrun_stats[i];
+                    const char *name = audio_thread_stats[i].name;
+                    sprintf(buff+strlen(buff), "\"xruns_%s\": %u,\n", name, x->xruns);
+                    sprintf(buff+strlen(buff), "\"xrun_errors_%s\": %u,\n", name, x->errors);
+                    sprintf(buff+strlen(buff), "\"xrun_time_%s\": %llu,\n", name, (unsigned long long) x->last_xrun_ms);
+                    sprintf(buff+strlen(buff), "\"xrun_fill_%s\": %u,\n", name, x->last_xrun_fill);
+                    if (i == AUDIO_THREAD_RADIO_PLAYBACK || i == AUDIO_THREAD_LOOP_PLAYBACK)
+                    {
+                        sprintf(buff+strlen(buff), "\"xrun_prefill_%s\": %u,\n", name, x->prefill);
+                        sprintf(buff+strlen(buff), "\"resyncs_%s\": %u,\n", name, x->resyncs);
+                    }
+                }
+                sprintf(buff+strlen(buff), "\"drops_dsp_rx\": %u,\n", audio_thread_stats[AUDIO_THREAD_DSP_RX].drops);
+                sprintf(buff+strlen(buff), "\"drops_dsp_tx\": %u,\n", audio_thread_stats[AUDIO_THREAD_DSP_TX].drops);
+                sprintf(buff+strlen(buff), "\"starved_dsp_tx\": %u,\n", audio_thread_stats[AUDIO_THREAD_DSP_TX].starved);
+
+                // loopback clock offset against the codec (ppm), the correction applied and the ring fill (frames)
+                sprintf(buff+strlen(buff), "\"ppm_loop_capture\": %.1f,\n", loop_capture_resampler.ppm);
+                sprintf(buff+strlen(buff), "\"ppm_loop_playback\": %.1f,\n", loop_playback_resampler.ppm);
+                sprintf(buff+strlen(buff), "\"correction_ppm_loop_capture\": %.1f,\n", loop_capture_resampler.correction_ppm);
+                sprintf(buff+strlen(buff), "\"correction_ppm_loop_playback\": %.1f,\n", loop_playback_resampler.correction_ppm);
+                sprintf(buff+strlen(buff), "\"fill_loop_capture\": %u,\n", loop_capture_resampler.fill);
+                sprintf(buff+strlen(buff), "\"fill_loop_playback\": %u,\n", loop_playback_resampler.fill);
+
                 for (int i = 0; i < radio_h->profiles_count; i++)
                 {
                     radio_profile *curr_prof = &radio_h->profiles[i];
@@ -201,6 +289,9 @@ void *webserver_thread_function(void *radio_h_v)
                     else if (curr_prof->mode == MODE_CW)
                         sprintf(buff+strlen(buff), "\"p%d_mode\": \"CW\",\n", i);
                     sprintf(buff+strlen(buff), "\"p%d_digital_voice\": %s,\n", i, curr_prof->digital_voice ? "true" : "false");
+                    sprintf(buff+strlen(buff), "\"p%d_denoise\": %s,\n", i, curr_prof->denoise ? "true" : "false");
+                    sprintf(buff+strlen(buff), "\"p%d_agc\": \"%s\",\n", i, agc_names[curr_prof->agc <= AGC_FAST ? curr_prof->agc : AGC_OFF]);
+                    sprintf(buff+strlen(buff), "\"p%d_compressor\": %s,\n", i, (curr_prof->compressor == COMPRESSOR_ON) ? "true" : "false");
                 }
                 sprintf(buff+strlen(buff), "\"protection\": %s}", radio_h->swr_protection_enabled ?"true":"false");
 
@@ -212,7 +303,7 @@ void *webserver_thread_function(void *radio_h_v)
             radio_h->send_ws_update = false;
 
     socket_poll:
-        mg_mgr_poll(&mgr, 100);
+        mg_mgr_poll(&mgr, poll_ms);
     }
 
     for(struct mg_connection* c = mgr.conns; c != NULL; c = c->next )